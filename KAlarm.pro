@@ -4,11 +4,14 @@
 #
 #-------------------------------------------------
 
-QT       += core gui
+QT       += core gui network
 
 greaterThan(QT_MAJOR_VERSION, 4) {
-    QT += widgets multimedia
+    QT += widgets multimedia concurrent
     DEFINES += CONFIG_QT5
+
+    SOURCES += kalarmaudioengine.cpp
+    HEADERS += kalarmaudioengine.h
 }
 
 TARGET = KAlarm
@@ -19,12 +22,49 @@ SOURCES += main.cpp\
         kalarm.cpp \
     kalarmitemwidget.cpp \
     kalarmconfigdialog.cpp \
-    kalarmqueue.cpp
+    kalarmqueue.cpp \
+    kalarmstartupprofile.cpp \
+    kalarmsearchindex.cpp \
+    kalarmlistitem.cpp \
+    kalarmitem.cpp \
+    kalarmnotifier.cpp \
+    kalarmpaths.cpp \
+    kalarmwatchdog.cpp \
+    kalarmstatsdialog.cpp \
+    kalarmdispatcher.cpp \
+    kalarmresourceregistry.cpp \
+    kalarmjournal.cpp \
+    kalarmhistory.cpp \
+    kalarmmetricsserver.cpp \
+    kalarmgroupwidget.cpp \
+    kalarmcalendar.cpp \
+    kalarmstringpool.cpp \
+    kalarmdaemonprotocol.cpp \
+    kalarmdaemonclient.cpp
 
 HEADERS  += kalarm.h \
     kalarmitemwidget.h \
     kalarmconfigdialog.h \
-    kalarmqueue.h
+    kalarmqueue.h \
+    kalarmstartupprofile.h \
+    kalarmsearchindex.h \
+    kalarmlistitem.h \
+    kalarmitem.h \
+    kalarmnotifier.h \
+    kalarmpaths.h \
+    kalarmwatchdog.h \
+    kalarmstatsdialog.h \
+    kalarmschedule.h \
+    kalarmdispatcher.h \
+    kalarmresourceregistry.h \
+    kalarmjournal.h \
+    kalarmhistory.h \
+    kalarmmetricsserver.h \
+    kalarmgroupwidget.h \
+    kalarmcalendar.h \
+    kalarmstringpool.h \
+    kalarmdaemonprotocol.h \
+    kalarmdaemonclient.h
 
 FORMS    += kalarm.ui
 
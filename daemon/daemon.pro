@@ -0,0 +1,50 @@
+#-------------------------------------------------
+#
+# K Alarm daemon
+#
+#-------------------------------------------------
+
+QT       += core network
+QT       -= gui
+
+greaterThan(QT_MAJOR_VERSION, 4): QT += concurrent
+
+TARGET = kalarmd
+CONFIG   += console
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+INCLUDEPATH += ..
+
+SOURCES += main.cpp \
+    kalarmdaemon.cpp \
+    kalarmuserprocess.cpp \
+    ../kalarmitem.cpp \
+    ../kalarmcalendar.cpp \
+    ../kalarmstringpool.cpp \
+    ../kalarmqueue.cpp \
+    ../kalarmdispatcher.cpp \
+    ../kalarmresourceregistry.cpp \
+    ../kalarmhistory.cpp \
+    ../kalarmjournal.cpp \
+    ../kalarmwatchdog.cpp \
+    ../kalarmpaths.cpp \
+    ../kalarmmetricsserver.cpp \
+    ../kalarmdaemonprotocol.cpp
+
+HEADERS  += kalarmdaemon.h \
+    kalarmuserprocess.h \
+    ../kalarmitem.h \
+    ../kalarmcalendar.h \
+    ../kalarmstringpool.h \
+    ../kalarmschedule.h \
+    ../kalarmqueue.h \
+    ../kalarmdispatcher.h \
+    ../kalarmresourceregistry.h \
+    ../kalarmhistory.h \
+    ../kalarmjournal.h \
+    ../kalarmwatchdog.h \
+    ../kalarmpaths.h \
+    ../kalarmmetricsserver.h \
+    ../kalarmdaemonprotocol.h
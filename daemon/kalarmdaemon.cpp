@@ -0,0 +1,887 @@
+/****************************************************************************
+**
+** KAlarmDaemon, schedules alarms of many users in one process
+**
+** Copyright (C) 2015 by KO Myung-Hun
+** All rights reserved.
+** Contact: KO Myung-Hun (komh@chollian.net)
+**
+** This file is part of K Alarm
+**
+** $BEGIN_LICENSE$
+**
+** GNU General Public License Usage
+** This file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+** $END_LICENSE$
+**
+****************************************************************************/
+
+
+#include "kalarmdaemon.h"
+#include "kalarmuserprocess.h"
+
+#include "kalarmjournal.h"
+#include "kalarmwatchdog.h"
+#include "kalarmdaemonprotocol.h"
+
+#include <QCoreApplication>
+#include <QSettings>
+#include <QScopedPointer>
+#include <QFile>
+#include <QFileInfo>
+#include <QTemporaryFile>
+#include <QDataStream>
+#include <QProcessEnvironment>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <pwd.h>
+#include <unistd.h>
+
+#ifdef Q_OS_LINUX
+#include <sys/fsuid.h>
+#endif
+
+// Settings or a journal of 1M alarms fit, but not an endless file
+static const qint64 maxUserFileSize = 256 * 1024 * 1024;
+
+KAlarmDaemon::KAlarmDaemon(QObject *parent)
+    : QObject(parent)
+    , _lastId(0)
+{
+    // One queue in a main thread serves all the users. Nothing else runs
+    // here, so a scheduler thread is not needed.
+    _queue = new KAlarmQueue(this);
+    _queue->setBackend(KAlarmQueue::TimerFdBackend);
+    _queue->setWarmUpLeadTime(2000);
+
+    KAlarmDispatcher *dispatcher = _queue->dispatcher();
+
+    // Alarms of users are presented by their own K Alarm at the same time
+    dispatcher->setMaxInFlight(64);
+    dispatcher->setProcessFactory(this);
+
+    connect(_queue, SIGNAL(alarmScheduled(quint32,QDateTime)),
+            this, SLOT(alarmScheduled(quint32,QDateTime)));
+    connect(_queue, SIGNAL(alarmTriggered(KAlarmItem,QDateTime)),
+            this, SLOT(alarmTriggered(KAlarmItem,QDateTime)));
+    connect(_queue, SIGNAL(alarmWarmUp(KAlarmItem,QDateTime)),
+            this, SLOT(alarmWarmUp(KAlarmItem,QDateTime)));
+
+    // A queue is modified when it is disabled, so not while alarming
+    connect(_queue, SIGNAL(alarmDisabled(quint32)),
+            this, SLOT(alarmDisabled(quint32)), Qt::QueuedConnection);
+
+    // Alarms are read again after writes of K Alarm settle
+    _reloadTimer = new QTimer(this);
+    _reloadTimer->setSingleShot(true);
+    _reloadTimer->setInterval(500);
+    connect(_reloadTimer, SIGNAL(timeout()),
+            this, SLOT(reloadChangedUsers()));
+
+    connect(&_watcher, SIGNAL(fileChanged(QString)),
+            this, SLOT(pathChanged(QString)));
+    connect(&_watcher, SIGNAL(directoryChanged(QString)),
+            this, SLOT(pathChanged(QString)));
+
+    connect(&_server, SIGNAL(newConnection()),
+            this, SLOT(newConnection()));
+}
+
+KAlarmDaemon::~KAlarmDaemon()
+{
+    _queue->stop();
+}
+
+bool KAlarmDaemon::listen(const QString &name)
+{
+    // Another user must not be able to replace a socket in a directory
+    if (QFileInfo(name).isAbsolute() && !makeSocketDirectory(name))
+        return false;
+
+    // A socket left by a killed daemon
+    QLocalServer::removeServer(name);
+
+    // Every user may connect. A user is identified by credentials of a
+    // peer, and is sent only alarms of the user.
+#if QT_VERSION >= QT_VERSION_CHECK(5, 0, 0)
+    _server.setSocketOptions(QLocalServer::WorldAccessOption);
+#endif
+
+    if (!_server.listen(name))
+    {
+        qWarning("KAlarmDaemon: Cannot listen on %s: %s", qPrintable(name),
+                 qPrintable(_server.errorString()));
+
+        return false;
+    }
+
+#if QT_VERSION < QT_VERSION_CHECK(5, 0, 0)
+    QFile::setPermissions(_server.fullServerName(),
+                          QFile::ReadOwner | QFile::WriteOwner
+                          | QFile::ReadGroup | QFile::WriteGroup
+                          | QFile::ReadOther | QFile::WriteOther);
+#endif
+
+    return true;
+}
+
+bool KAlarmDaemon::makeSocketDirectory(const QString &name)
+{
+    QByteArray dir(QFile::encodeName(QFileInfo(name).absolutePath()));
+
+    if (::mkdir(dir.constData(), 0755) != 0 && errno != EEXIST)
+    {
+        qWarning("KAlarmDaemon: Cannot create %s: %s", dir.constData(),
+                 strerror(errno));
+
+        return false;
+    }
+
+    struct stat st;
+
+    if (::lstat(dir.constData(), &st) != 0 || !S_ISDIR(st.st_mode)
+            || st.st_uid != ::geteuid() || (st.st_mode & (S_IWGRP | S_IWOTH)))
+    {
+        qWarning("KAlarmDaemon: %s must be a directory writable only by "
+                 "this user", dir.constData());
+
+        return false;
+    }
+
+    return true;
+}
+
+bool KAlarmDaemon::addUser(const QString &name)
+{
+    struct passwd *pw = ::getpwnam(name.toLocal8Bit().constData());
+
+    if (!pw)
+    {
+        qWarning("KAlarmDaemon: Unknown user %s", qPrintable(name));
+
+        return false;
+    }
+
+    return addUser(pw->pw_uid);
+}
+
+bool KAlarmDaemon::addUser(uint uid)
+{
+    if (_users.contains(uid))
+        return true;
+
+    // Alarms of others can be read and executed only by root
+    if (::getuid() != 0 && ::getuid() != uid)
+    {
+        qWarning("KAlarmDaemon: Alarms of uid %u are not served without "
+                 "root privileges", uid);
+
+        return false;
+    }
+
+    struct passwd *pw = ::getpwuid(uid);
+
+    if (!pw)
+    {
+        qWarning("KAlarmDaemon: Unknown uid %u", uid);
+
+        return false;
+    }
+
+    User user;
+    user.uid = uid;
+    user.gid = pw->pw_gid;
+    user.name = QString::fromLocal8Bit(pw->pw_name);
+    user.home = QString::fromLocal8Bit(pw->pw_dir);
+
+    // The same paths as QSettings and KAlarmPaths of K Alarm, with a
+    // default configuration directory
+    QString configDir(user.home + "/.config/"
+                      + QCoreApplication::organizationName());
+
+    user.settingsFile = configDir + "/"
+                        + QCoreApplication::applicationName() + ".conf";
+    user.dataDir = configDir + "/" + QCoreApplication::applicationName();
+
+    _users.insert(uid, user);
+
+    load(&_users[uid]);
+
+    return true;
+}
+
+void KAlarmDaemon::start()
+{
+    _queue->start();
+}
+
+QProcess *KAlarmDaemon::createProcess(const KAlarmItem &item,
+                                      QObject *parent)
+{
+    QHash<quint32, Owner>::const_iterator it = _owners.constFind(item.id());
+
+    if (it == _owners.constEnd())
+        return 0;
+
+    const User &user = _users[it.value().uid];
+
+    KAlarmUserProcess *process = new KAlarmUserProcess(user.uid, user.gid,
+                                                       user.name, parent);
+
+    // Not an environment of a daemon, which may be one of root
+    QProcessEnvironment system(QProcessEnvironment::systemEnvironment());
+    QProcessEnvironment environment;
+
+    environment.insert("PATH", system.value("PATH", "/usr/bin:/bin"));
+    environment.insert("LANG", system.value("LANG", "C"));
+    environment.insert("HOME", user.home);
+    environment.insert("USER", user.name);
+    environment.insert("LOGNAME", user.name);
+
+    // A display and a session bus of K Alarm of a user, if connected once
+    QHash<QString, QString>::const_iterator variable;
+    for (variable = user.sessionEnvironment.constBegin();
+         variable != user.sessionEnvironment.constEnd(); ++variable)
+        environment.insert(variable.key(), variable.value());
+
+    process->setProcessEnvironment(environment);
+    process->setWorkingDirectory(user.home);
+
+    return process;
+}
+
+void KAlarmDaemon::load(User *user)
+{
+    KAlarmActivityScope activity("KAlarmDaemon::load()");
+
+    // Files of a user are copied before being parsed, so that root never
+    // parses what a user may not read
+    QTemporaryFile settingsCopy;
+
+    if (!copyUserSettings(*user, user->settingsFile, &settingsCopy))
+        return;
+
+    QSettings settings(settingsCopy.fileName(), QSettings::IniFormat);
+
+    QString profile(settings.value("Profile").toString());
+    QString prefix(user->name + "/");
+
+    // Calendars are shared by all the profiles of a user
+    QByteArray calendarData;
+    QDataStream calendarOut(&calendarData, QIODevice::WriteOnly);
+    QList<KAlarmCalendar> calendars;
+
+    settings.beginGroup("Calendars");
+
+    foreach (const QString &name, settings.childGroups())
+    {
+        KAlarmCalendar calendar;
+
+        calendar.load(settings, name);
+        calendar.setName(prefix + name);
+        calendars.append(calendar);
+
+        calendarOut << name << settings.value(name + "/Mode")
+                    << settings.value(name + "/Days");
+    }
+
+    settings.endGroup();
+
+    // The same files as K Alarm uses for a profile
+    QString storeFile(user->settingsFile);
+    QString journalFile(user->dataDir + "/alarms.journal");
+
+    QTemporaryFile storeCopy;
+    QScopedPointer<QSettings> profileStore;
+
+    if (!profile.isEmpty())
+    {
+        // Not a path out of a data directory
+        if (profile.contains('/'))
+            return;
+
+        QString base(user->dataDir + "/profile-" + profile);
+
+        storeFile = base + ".ini";
+        journalFile = base + ".journal";
+
+        if (!copyUserSettings(*user, storeFile, &storeCopy))
+            return;
+
+        profileStore.reset(new QSettings(storeCopy.fileName(),
+                                         QSettings::IniFormat));
+    }
+
+    QByteArray journalData;
+
+    if (!readUserFile(*user, journalFile, &journalData))
+        return;
+
+    QSettings *store = profileStore ? profileStore.data() : &settings;
+
+    QStringList disabledGroups;
+    foreach (const QString &group,
+             store->value("DisabledGroups").toStringList())
+        disabledGroups.append(prefix + group);
+
+    QHash<QString, QString> groupCalendars;
+    QStringList pairs(store->value("GroupCalendars").toStringList());
+    for (int i = 0; i + 1 < pairs.size(); i += 2)
+        groupCalendars.insert(prefix + pairs.at(i), prefix + pairs.at(i + 1));
+
+    QList<KAlarmItem> items;
+    KAlarmStringTable strings;
+    strings.load(*store);
+
+    int count = store->value("AlarmCount").toInt();
+    for (int i = 0; i < count; ++i)
+    {
+        KAlarmItem item;
+
+        item.loadAlarm(*store, i, &strings);
+        items.append(item);
+    }
+
+    // Changes after the last snapshot, left as they are for K Alarm
+    KAlarmJournal(journalFile).read(journalData, &items);
+
+    // Only alarms changed since the last load are rescheduled
+    QHash<quint32, KAlarmItem> loadedItems;
+    QList<KAlarmItem> changedItems;
+
+    foreach (KAlarmItem item, items)
+    {
+        QHash<quint32, QByteArray>::iterator fired =
+                user->firedSingleShots.find(item.id());
+
+        // A single-shot alarm alarmed here stays disabled until K Alarm
+        // saves it disabled, or it is changed
+        if (fired != user->firedSingleShots.end())
+        {
+            if (fired.value() == itemData(item))
+                item.setAlarmEnabled(false);
+            else
+                user->firedSingleShots.erase(fired);
+        }
+
+        QHash<quint32, KAlarmItem>::const_iterator old =
+                user->items.constFind(item.id());
+
+        if (old == user->items.constEnd()
+                || itemData(old.value()) != itemData(item))
+            changedItems.append(globalItem(user, item));
+
+        loadedItems.insert(item.id(), item);
+    }
+
+    QList<quint32> removedIds;
+
+    QHash<quint32, KAlarmItem>::const_iterator it;
+    for (it = user->items.constBegin(); it != user->items.constEnd(); ++it)
+    {
+        if (loadedItems.contains(it.key()))
+            continue;
+
+        quint32 id = user->globalIds.take(it.key());
+
+        _owners.remove(id);
+        removedIds.append(id);
+
+        user->firedSingleShots.remove(it.key());
+    }
+
+    user->items = loadedItems;
+
+    if (disabledGroups != user->disabledGroups)
+    {
+        user->disabledGroups = disabledGroups;
+
+        QStringList allGroups;
+        foreach (const User &u, _users)
+            allGroups.append(u.disabledGroups);
+
+        _queue->setDisabledGroups(allGroups);
+    }
+
+    // All the alarms are rescheduled, so only if changed
+    if (calendarData != user->calendarData
+            || groupCalendars != user->groupCalendars)
+    {
+        user->calendarData = calendarData;
+        user->calendars = calendars;
+        user->groupCalendars = groupCalendars;
+
+        QList<KAlarmCalendar> allCalendars;
+        QHash<QString, QString> allGroupCalendars;
+
+        foreach (const User &u, _users)
+        {
+            allCalendars.append(u.calendars);
+            allGroupCalendars.unite(u.groupCalendars);
+        }
+
+        _queue->setCalendars(allCalendars, allGroupCalendars);
+    }
+
+    if (!removedIds.isEmpty())
+        _queue->remove(removedIds);
+
+    if (!changedItems.isEmpty())
+        _queue->modify(changedItems);
+
+    // Files are watched for appends, and directories for files replaced
+    watch(user->uid, QStringList() << QFileInfo(user->settingsFile).path()
+                                   << user->settingsFile << user->dataDir
+                                   << storeFile << journalFile);
+}
+
+bool KAlarmDaemon::readUserFile(const User &user, const QString &path,
+                                QByteArray *data)
+{
+    data->clear();
+
+#ifdef Q_OS_LINUX
+    // A path is resolved with permissions of a user, not of root. Only
+    // a calling thread is affected.
+    int oldFsGid = ::setfsgid(user.gid);
+    int oldFsUid = ::setfsuid(user.uid);
+#endif
+
+    int fd = ::open(QFile::encodeName(path).constData(),
+                    O_RDONLY | O_NOFOLLOW | O_NONBLOCK | O_CLOEXEC);
+    int openErrno = errno;
+
+#ifdef Q_OS_LINUX
+    ::setfsuid(oldFsUid);
+    ::setfsgid(oldFsGid);
+#endif
+
+    if (fd == -1)
+    {
+        if (openErrno == ENOENT)
+            return true;
+
+        qWarning("KAlarmDaemon: Cannot open %s: %s", qPrintable(path),
+                 strerror(openErrno));
+
+        return false;
+    }
+
+    struct stat st;
+
+    bool ok = ::fstat(fd, &st) == 0 && S_ISREG(st.st_mode)
+              && st.st_uid == user.uid && st.st_size <= maxUserFileSize;
+
+    if (ok)
+    {
+        data->resize(static_cast<int>(st.st_size));
+
+        // A file may be truncated while being read
+        int pos = 0;
+        while (pos < data->size())
+        {
+            ssize_t n = ::read(fd, data->data() + pos, data->size() - pos);
+
+            if (n == -1 && errno == EINTR)
+                continue;
+
+            if (n <= 0)
+                break;
+
+            pos += n;
+        }
+
+        data->resize(pos);
+    }
+    else
+        qWarning("KAlarmDaemon: %s is not a regular file of %s, or is too "
+                 "large", qPrintable(path), qPrintable(user.name));
+
+    ::close(fd);
+
+    return ok;
+}
+
+bool KAlarmDaemon::copyUserSettings(const User &user, const QString &path,
+                                    QTemporaryFile *copy)
+{
+    QByteArray data;
+
+    if (!readUserFile(user, path, &data))
+        return false;
+
+    // Readable only by a daemon
+    return copy->open() && copy->write(data) == data.size()
+            && copy->flush();
+}
+
+void KAlarmDaemon::watch(uint uid, const QStringList &paths)
+{
+    // A replaced file is not watched any more, so watch it again
+    QStringList watched(_watcher.files() + _watcher.directories());
+
+    foreach (const QString &path, paths)
+    {
+        if (watched.contains(path) || !QFileInfo(path).exists())
+            continue;
+
+        _watcher.addPath(path);
+        _watchedPaths.insert(path, uid);
+    }
+}
+
+KAlarmItem KAlarmDaemon::globalItem(User *user, const KAlarmItem &item)
+{
+    quint32 &id = user->globalIds[item.id()];
+
+    if (id == 0)
+    {
+        id = ++_lastId;
+
+        Owner owner;
+        owner.uid = user->uid;
+        owner.id = item.id();
+
+        _owners.insert(id, owner);
+    }
+
+    KAlarmItem global(item);
+    QString prefix(user->name + "/");
+
+    global.setId(id);
+
+    if (!item.group().isEmpty())
+        global.setGroup(prefix + item.group());
+
+    if (!item.calendar().isEmpty())
+        global.setCalendar(prefix + item.calendar());
+
+    return global;
+}
+
+bool KAlarmDaemon::localItem(quint32 id, User **user, KAlarmItem *item)
+{
+    QHash<quint32, Owner>::const_iterator it = _owners.constFind(id);
+
+    if (it == _owners.constEnd())
+        return false;
+
+    *user = &_users[it.value().uid];
+    *item = (*user)->items.value(it.value().id);
+
+    return true;
+}
+
+void KAlarmDaemon::send(const User &user, const QByteArray &payload)
+{
+    QByteArray frame(KAlarmDaemonProtocol::frame(payload));
+
+    foreach (QLocalSocket *socket, user.clients)
+        socket->write(frame);
+}
+
+void KAlarmDaemon::sendSchedule(const User &user, QLocalSocket *socket)
+{
+    QByteArray data;
+
+    QHash<quint32, quint32>::const_iterator it;
+    for (it = user.globalIds.constBegin(); it != user.globalIds.constEnd();
+         ++it)
+    {
+        QByteArray payload;
+        QDataStream out(&payload, QIODevice::WriteOnly);
+        out.setVersion(QDataStream::Qt_4_6);
+
+        out << static_cast<quint8>(KAlarmDaemonProtocol::ScheduledMessage)
+            << it.key() << _queue->nextAlarm(it.value());
+
+        data.append(KAlarmDaemonProtocol::frame(payload));
+    }
+
+    socket->write(data);
+}
+
+void KAlarmDaemon::receive(QLocalSocket *socket, const QByteArray &payload)
+{
+    QDataStream in(payload);
+    in.setVersion(QDataStream::Qt_4_6);
+
+    quint8 message;
+
+    in >> message;
+
+    // A client may tell only about alarms of its own user
+    User &user = _users[_clientUsers.value(socket)];
+
+    if (in.status() == QDataStream::Ok
+            && message == KAlarmDaemonProtocol::RefreshMessage)
+    {
+        sendSchedule(user, socket);
+
+        return;
+    }
+
+    if (in.status() == QDataStream::Ok
+            && message == KAlarmDaemonProtocol::EnvironmentMessage)
+    {
+        QStringList environment;
+
+        in >> environment;
+
+        if (in.status() != QDataStream::Ok)
+            return;
+
+        // Only variables of a session, not ones like LD_PRELOAD
+        QStringList names(KAlarmDaemonProtocol::sessionVariables());
+
+        user.sessionEnvironment.clear();
+
+        foreach (const QString &variable, environment)
+        {
+            int equal = variable.indexOf('=');
+
+            if (equal > 0 && names.contains(variable.left(equal)))
+                user.sessionEnvironment.insert(variable.left(equal),
+                                               variable.mid(equal + 1));
+        }
+
+        return;
+    }
+
+    quint32 id;
+
+    in >> id;
+
+    if (in.status() != QDataStream::Ok
+            || message != KAlarmDaemonProtocol::PresentedMessage)
+        return;
+
+    quint32 globalId = user.globalIds.value(id);
+
+    QHash<quint32, int>::iterator it = _presenting.find(globalId);
+
+    if (it == _presenting.end())
+        return;
+
+    if (--it.value() == 0)
+        _presenting.erase(it);
+
+    _queue->dispatcher()->presented(globalId);
+}
+
+QByteArray KAlarmDaemon::itemData(const KAlarmItem &item)
+{
+    QByteArray data;
+    QDataStream out(&data, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_4_6);
+
+    out << item;
+
+    return data;
+}
+
+void KAlarmDaemon::pathChanged(const QString &path)
+{
+    QHash<QString, uint>::const_iterator it = _watchedPaths.constFind(path);
+
+    if (it == _watchedPaths.constEnd())
+        return;
+
+    _changedUsers.insert(it.value());
+    _reloadTimer->start();
+}
+
+void KAlarmDaemon::reloadChangedUsers()
+{
+    foreach (uint uid, _changedUsers)
+        load(&_users[uid]);
+
+    _changedUsers.clear();
+}
+
+void KAlarmDaemon::alarmScheduled(quint32 id, const QDateTime &dt)
+{
+    User *user;
+    KAlarmItem item;
+
+    if (!localItem(id, &user, &item) || user->clients.isEmpty())
+        return;
+
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_4_6);
+
+    out << static_cast<quint8>(KAlarmDaemonProtocol::ScheduledMessage)
+        << item.id() << dt;
+
+    send(*user, payload);
+}
+
+void KAlarmDaemon::alarmTriggered(const KAlarmItem &item,
+                                  const QDateTime &dt)
+{
+    User *user;
+    KAlarmItem userItem;
+
+    if (!localItem(item.id(), &user, &userItem) || user->clients.isEmpty())
+    {
+        // Nobody presents it, so let a dispatcher go on. Not at once,
+        // because a dispatcher is emitting this.
+        QMetaObject::invokeMethod(_queue->dispatcher(), "presented",
+                                  Qt::QueuedConnection,
+                                  Q_ARG(quint32, item.id()));
+
+        return;
+    }
+
+    ++_presenting[item.id()];
+
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_4_6);
+
+    out << static_cast<quint8>(KAlarmDaemonProtocol::TriggeredMessage)
+        << userItem << dt;
+
+    send(*user, payload);
+}
+
+void KAlarmDaemon::alarmWarmUp(const KAlarmItem &item, const QDateTime &dt)
+{
+    User *user;
+    KAlarmItem userItem;
+
+    if (!localItem(item.id(), &user, &userItem) || user->clients.isEmpty())
+        return;
+
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_4_6);
+
+    out << static_cast<quint8>(KAlarmDaemonProtocol::WarmUpMessage)
+        << userItem << dt;
+
+    send(*user, payload);
+}
+
+void KAlarmDaemon::alarmDisabled(quint32 id)
+{
+    User *user;
+    KAlarmItem item;
+
+    if (!localItem(id, &user, &item))
+        return;
+
+    // Remember an alarm as saved, so that it is not enabled again by the
+    // next load before K Alarm saves it disabled
+    user->firedSingleShots.insert(item.id(), itemData(item));
+
+    item.setAlarmEnabled(false);
+    user->items.insert(item.id(), item);
+
+    _queue->modify(globalItem(user, item));
+
+    if (user->clients.isEmpty())
+        return;
+
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_4_6);
+
+    out << static_cast<quint8>(KAlarmDaemonProtocol::DisabledMessage)
+        << item.id();
+
+    send(*user, payload);
+}
+
+void KAlarmDaemon::newConnection()
+{
+    while (QLocalSocket *socket = _server.nextPendingConnection())
+    {
+        uint uid;
+
+        // A user connecting is served from now on
+        if (!KAlarmDaemonProtocol::peerUid(socket, &uid) || !addUser(uid))
+        {
+            socket->abort();
+            socket->deleteLater();
+
+            continue;
+        }
+
+        _users[uid].clients.append(socket);
+        _clientUsers.insert(socket, uid);
+
+        connect(socket, SIGNAL(readyRead()), this, SLOT(socketReadyRead()));
+        connect(socket, SIGNAL(disconnected()),
+                this, SLOT(socketDisconnected()));
+    }
+}
+
+void KAlarmDaemon::socketReadyRead()
+{
+    QLocalSocket *socket = qobject_cast<QLocalSocket *>(sender());
+
+    QByteArray &buffer = _buffers[socket];
+    buffer.append(socket->readAll());
+
+    QByteArray payload;
+    bool invalid;
+
+    while (KAlarmDaemonProtocol::takeFrame(&buffer, &payload, &invalid))
+        receive(socket, payload);
+
+    if (invalid)
+        socket->abort();
+}
+
+void KAlarmDaemon::socketDisconnected()
+{
+    QLocalSocket *socket = qobject_cast<QLocalSocket *>(sender());
+
+    if (!_clientUsers.contains(socket))
+        return;
+
+    uint uid = _clientUsers.take(socket);
+    User &user = _users[uid];
+
+    _buffers.remove(socket);
+    user.clients.removeAll(socket);
+
+    socket->deleteLater();
+
+    if (!user.clients.isEmpty())
+        return;
+
+    // Alarms being presented by the last client of a user, or of alarms
+    // removed since, are given up
+    QHash<quint32, int>::iterator it = _presenting.begin();
+    while (it != _presenting.end())
+    {
+        QHash<quint32, Owner>::const_iterator owner =
+                _owners.constFind(it.key());
+
+        if (owner != _owners.constEnd() && owner.value().uid != uid)
+        {
+            ++it;
+
+            continue;
+        }
+
+        for (int i = 0; i < it.value(); ++i)
+            _queue->dispatcher()->presented(it.key());
+
+        it = _presenting.erase(it);
+    }
+}
@@ -0,0 +1,177 @@
+/****************************************************************************
+**
+** KAlarmDaemon, schedules alarms of many users in one process
+**
+** Copyright (C) 2015 by KO Myung-Hun
+** All rights reserved.
+** Contact: KO Myung-Hun (komh@chollian.net)
+**
+** This file is part of K Alarm
+**
+** $BEGIN_LICENSE$
+**
+** GNU General Public License Usage
+** This file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+** $END_LICENSE$
+**
+****************************************************************************/
+
+
+#ifndef KALARMDAEMON_H
+#define KALARMDAEMON_H
+
+#include <QObject>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QFileSystemWatcher>
+#include <QTimer>
+#include <QHash>
+#include <QSet>
+#include <QList>
+#include <QStringList>
+#include <QByteArray>
+#include <QDateTime>
+
+#include "kalarmitem.h"
+#include "kalarmcalendar.h"
+#include "kalarmqueue.h"
+#include "kalarmdispatcher.h"
+
+class QTemporaryFile;
+
+/*
+ * KAlarmDaemon hosts alarms of many users in one KAlarmQueue, so that one
+ * timer serves all of them. Alarms of a user are read from the settings
+ * and the journal of K Alarm in a home directory, and are read again when
+ * they are changed. Programs are executed with privileges of a user who
+ * owns an alarm. Alarm windows and sounds are presented by K Alarm of a
+ * user connected to a local socket, which is identified by credentials of
+ * a peer.
+ *
+ * In a queue, ids are given by a daemon, and groups and calendars are
+ * prefixed with a user name, so that alarms of users do not clash.
+ */
+class KAlarmDaemon : public QObject, public KAlarmProcessFactory
+{
+    Q_OBJECT
+public:
+    explicit KAlarmDaemon(QObject *parent = 0);
+    ~KAlarmDaemon();
+
+    bool listen(const QString &name);
+
+    /* Serve alarms of a user. Returns false if a user is unknown */
+    bool addUser(const QString &name);
+    bool addUser(uint uid);
+
+    QProcess *createProcess(const KAlarmItem &item, QObject *parent);
+
+public slots:
+    void start();
+
+private:
+    struct User
+    {
+        uint uid;
+        uint gid;
+        QString name;
+        QString home;
+        QString settingsFile;   // of K Alarm
+        QString dataDir;        // of journals of K Alarm
+
+        QHash<quint32, KAlarmItem> items;       // by id of a user
+        QHash<quint32, quint32> globalIds;      // by id of a user
+
+        // Single-shot alarms disabled here, but not yet in a store, and
+        // data of them when they were alarmed
+        QHash<quint32, QByteArray> firedSingleShots;
+
+        QByteArray calendarData;
+        QList<KAlarmCalendar> calendars;        // prefixed
+        QHash<QString, QString> groupCalendars; // prefixed
+        QStringList disabledGroups;             // prefixed
+
+        QList<QLocalSocket *> clients;
+
+        // Variables of a session of the last client, kept after it leaves
+        QHash<QString, QString> sessionEnvironment;
+    };
+
+    struct Owner
+    {
+        uint uid;
+        quint32 id;     // of a user
+    };
+
+    KAlarmQueue *_queue;
+    QLocalServer _server;
+    QFileSystemWatcher _watcher;
+    QTimer *_reloadTimer;
+
+    QHash<uint, User> _users;
+    QHash<quint32, Owner> _owners;          // by id of a daemon
+    quint32 _lastId;
+
+    QHash<QString, uint> _watchedPaths;     // owners of watched paths
+    QSet<uint> _changedUsers;
+
+    QHash<QLocalSocket *, uint> _clientUsers;
+    QHash<QLocalSocket *, QByteArray> _buffers;
+
+    // Alarms sent to clients, and not presented yet, by id of a daemon
+    QHash<quint32, int> _presenting;
+
+    void load(User *user);
+
+    /*
+     * Read a file of user. It is opened with permissions of user, and
+     * only a regular file owned by user, not a symbolic link, of a limited
+     * size is read. A missing file is read as empty. Returns false if a
+     * file is refused.
+     */
+    static bool readUserFile(const User &user, const QString &path,
+                             QByteArray *data);
+
+    /* Copy a settings file of user to copy, for QSettings to read */
+    static bool copyUserSettings(const User &user, const QString &path,
+                                 QTemporaryFile *copy);
+    void watch(uint uid, const QStringList &paths);
+
+    /* An item in a queue for an item of user */
+    KAlarmItem globalItem(User *user, const KAlarmItem &item);
+
+    /* An item of a user for an item in a queue, or false if not known */
+    bool localItem(quint32 id, User **user, KAlarmItem *item);
+
+    void send(const User &user, const QByteArray &payload);
+
+    /* Send next alarm times of all the alarms of user to socket */
+    void sendSchedule(const User &user, QLocalSocket *socket);
+    void receive(QLocalSocket *socket, const QByteArray &payload);
+
+    static QByteArray itemData(const KAlarmItem &item);
+
+    /* Create a directory of a socket name, or check that it is safe */
+    static bool makeSocketDirectory(const QString &name);
+
+private slots:
+    void pathChanged(const QString &path);
+    void reloadChangedUsers();
+
+    void alarmScheduled(quint32 id, const QDateTime &dt);
+    void alarmTriggered(const KAlarmItem &item, const QDateTime &dt);
+    void alarmWarmUp(const KAlarmItem &item, const QDateTime &dt);
+    void alarmDisabled(quint32 id);
+
+    void newConnection();
+    void socketReadyRead();
+    void socketDisconnected();
+};
+
+#endif // KALARMDAEMON_H
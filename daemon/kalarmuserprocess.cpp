@@ -0,0 +1,72 @@
+/****************************************************************************
+**
+** KAlarmUserProcess, a process with privileges of a user
+**
+** Copyright (C) 2015 by KO Myung-Hun
+** All rights reserved.
+** Contact: KO Myung-Hun (komh@chollian.net)
+**
+** This file is part of K Alarm
+**
+** $BEGIN_LICENSE$
+**
+** GNU General Public License Usage
+** This file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+** $END_LICENSE$
+**
+****************************************************************************/
+
+
+#include "kalarmuserprocess.h"
+
+#include <sys/types.h>
+#include <grp.h>
+#include <unistd.h>
+
+KAlarmUserProcess::KAlarmUserProcess(uint uid, uint gid, const QString &user,
+                                     QObject *parent)
+    : QProcess(parent)
+    , _uid(uid)
+    , _gid(gid)
+{
+    // Looked up here, because NSS takes locks and allocates, which may
+    // deadlock a child forked from threads
+    QByteArray name(user.toLocal8Bit());
+    int count = 32;
+
+    _groups.resize(count);
+
+    while (::getgrouplist(name.constData(), _gid,
+#ifdef Q_OS_MAC
+                          reinterpret_cast<int *>(_groups.data()),
+#else
+                          _groups.data(),
+#endif
+                          &count) == -1)
+    {
+        // count is set to the number of groups needed
+        if (count <= _groups.size())
+            count = _groups.size() * 2;
+
+        _groups.resize(count);
+    }
+
+    _groups.resize(count);
+}
+
+void KAlarmUserProcess::setupChildProcess()
+{
+    // Called in a child, so only system calls are made
+    if (::geteuid() != 0)
+        return;
+
+    if (::setgroups(_groups.size(), _groups.constData()) != 0
+            || ::setgid(_gid) != 0 || ::setuid(_uid) != 0)
+        ::_exit(127);
+}
@@ -0,0 +1,55 @@
+/****************************************************************************
+**
+** KAlarmUserProcess, a process with privileges of a user
+**
+** Copyright (C) 2015 by KO Myung-Hun
+** All rights reserved.
+** Contact: KO Myung-Hun (komh@chollian.net)
+**
+** This file is part of K Alarm
+**
+** $BEGIN_LICENSE$
+**
+** GNU General Public License Usage
+** This file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+** $END_LICENSE$
+**
+****************************************************************************/
+
+
+#ifndef KALARMUSERPROCESS_H
+#define KALARMUSERPROCESS_H
+
+#include <QProcess>
+#include <QVector>
+
+#include <sys/types.h>
+
+/*
+ * KAlarmUserProcess executes a program with privileges of a user. If a
+ * parent runs as root, a child drops them before a program is executed,
+ * and exits if it fails to, rather than executing a program as root.
+ */
+class KAlarmUserProcess : public QProcess
+{
+    Q_OBJECT
+public:
+    KAlarmUserProcess(uint uid, uint gid, const QString &user,
+                      QObject *parent = 0);
+
+protected:
+    void setupChildProcess();
+
+private:
+    uint _uid;
+    uint _gid;
+    QVector<gid_t> _groups;     // supplementary groups of a user
+};
+
+#endif // KALARMUSERPROCESS_H
@@ -0,0 +1,92 @@
+/****************************************************************************
+**
+** Entry module of K Alarm daemon
+**
+** Copyright (C) 2015 by KO Myung-Hun
+** All rights reserved.
+** Contact: KO Myung-Hun (komh@chollian.net)
+**
+** This file is part of K Alarm
+**
+** $BEGIN_LICENSE$
+**
+** GNU General Public License Usage
+** This file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+** $END_LICENSE$
+**
+****************************************************************************/
+
+
+#include <QtCore>
+
+#include "kalarmdaemon.h"
+#include "kalarmdaemonprotocol.h"
+
+static QTextStream out(stdout);
+
+static void usage()
+{
+    out << "Usage: kalarmd [options]\n"
+           "\n"
+           "Schedule alarms of many users in one process. Users whose "
+           "K Alarm connects\n"
+           "to a socket are served, too.\n"
+           "\n"
+           "  --socket NAME       listen on a local socket NAME\n"
+           "                      (default: "
+        << KAlarmDaemonProtocol::defaultSocketName() << ")\n"
+        << "  --user NAME         serve alarms of a user NAME, "
+           "can be repeated\n";
+    out.flush();
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    // Settings of users are found with these names
+    QCoreApplication::setOrganizationName("KO Myung-Hun");
+    QCoreApplication::setApplicationName("K Alarm");
+
+    QStringList args(QCoreApplication::arguments());
+
+    QString socketName(KAlarmDaemonProtocol::defaultSocketName());
+    QStringList users;
+
+    for (int i = 1; i < args.size(); ++i)
+    {
+        QString arg(args.at(i));
+        QString value(i + 1 < args.size() ? args.at(i + 1) : QString());
+
+        if (arg == "--socket" && !value.isEmpty())
+            socketName = value;
+        else if (arg == "--user" && !value.isEmpty())
+            users.append(value);
+        else
+        {
+            usage();
+
+            return arg == "--help" ? 0 : 1;
+        }
+
+        ++i;
+    }
+
+    KAlarmDaemon daemon;
+
+    if (!daemon.listen(socketName))
+        return 1;
+
+    foreach (const QString &user, users)
+        daemon.addUser(user);
+
+    daemon.start();
+
+    return a.exec();
+}
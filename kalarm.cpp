@@ -34,29 +34,358 @@
 
 #include "kalarmconfigdialog.h"
 #include "kalarmitemwidget.h"
+#include "kalarmlistitem.h"
+#include "kalarmstartupprofile.h"
+#include "kalarmpaths.h"
+
+#include <limits>
+#include <algorithm>
 
 KAlarm::KAlarm(QWidget *parent) :
     QMainWindow(parent),
-    ui(new Ui::KAlarm)
+    ui(new Ui::KAlarm),
+    _filterLine(0),
+    _mainWindowReady(false),
+    _showKAlarmAtStartup(true),
+    _sortOrder(NoSort),
+    _fileMenu(0),
+    _profileMenu(0),
+    _calendarMenu(0),
+    _editMenu(0),
+    _viewMenu(0),
+    _showKAlarmAction(0),
+    _sortOrderGroup(0),
+    _helpMenu(0),
+    _statsDialog(0),
+    _journal(KAlarmPaths::dataFile("alarms.journal")),
+    _history(KAlarmPaths::dataFile("alarms.history")),
+    _daemonClient(0),
+    _metricsServer(0),
+    _storeWatcher(0),
+    _storeReloadTimer(0),
+    _storeReloading(false),
+    _trayAlarmCount(5),
+    _countdownTimer(0)
+{
+    // Only a list widget is required to load alarms. Menus and layouts of
+    // a main window are set up when it is shown at first.
+    _listWidget = new QListWidget(this);
+    _listWidget->setSelectionMode(QAbstractItemView::ExtendedSelection);
+
+    // Alarms are scheduled in a dedicated thread, so that they are not
+    // delayed by modal dialogs or saving in a GUI thread. A thread is
+    // started in startScheduler().
+    _alarmQueue = new KAlarmQueue;
+
+    // Sleep until the next alarm time where supported
+    QSettings settings;
+
+    // Only alarms of an active profile are loaded
+    _profile = settings.value("Profile").toString();
+    _journal.setFileName(profileFile(_profile, "journal"));
+
+    // Ids are unique only in a profile, so is a history
+    _history.setFileName(profileFile(_profile, "history"));
+
+    // Alarms changed outside, for example, by configuration management,
+    // are reloaded after writes settle
+    _storeWatcher = new QFileSystemWatcher(this);
+    connect(_storeWatcher, SIGNAL(fileChanged(QString)),
+            this, SLOT(storeFileChanged()));
+    connect(_storeWatcher, SIGNAL(directoryChanged(QString)),
+            this, SLOT(storeDirectoryChanged()));
+
+    _storeReloadTimer = new QTimer(this);
+    _storeReloadTimer->setSingleShot(true);
+    _storeReloadTimer->setInterval(500);
+    connect(_storeReloadTimer, SIGNAL(timeout()),
+            this, SLOT(reloadStore()));
+
+    _alarmQueue->setBackend(settings.value("SchedulerBackend", "timerfd")
+                            .toString() == "timer"
+                            ? KAlarmQueue::TimerBackend
+                            : KAlarmQueue::TimerFdBackend);
+
+    connect(_alarmQueue, SIGNAL(alarmScheduled(quint32,QDateTime)),
+            this, SLOT(alarmScheduled(quint32,QDateTime)));
+    connect(_alarmQueue, SIGNAL(alarmDisabled(quint32)),
+            this, SLOT(alarmDisabled(quint32)));
+    connect(_alarmQueue, SIGNAL(alarmTriggered(KAlarmItem,QDateTime)),
+            &_notifier, SLOT(notify(KAlarmItem,QDateTime)));
+
+    // Sounds and alarm windows are prepared a bit ahead of alarm times
+    _alarmQueue->setWarmUpLeadTime(
+                settings.value("WarmUpLeadTime", 2000).toInt());
+
+    connect(_alarmQueue, SIGNAL(alarmWarmUp(KAlarmItem,QDateTime)),
+            &_notifier, SLOT(prepare(KAlarmItem,QDateTime)));
+
+    // Due alarms are dispatched in order of priority, and held back while
+    // a GUI thread is busy presenting other alarms
+    KAlarmDispatcher *dispatcher = _alarmQueue->dispatcher();
+
+    dispatcher->setWindow(
+                settings.value("DispatchWindow", 10000).toInt());
+    dispatcher->setMaxInFlight(
+                settings.value("DispatchMaxInFlight", 4).toInt());
+    dispatcher->setLatencyBound(
+                settings.value("DispatchLatencyBound", 1000).toInt());
+
+    connect(&_notifier, SIGNAL(presented(quint32)),
+            dispatcher, SLOT(presented(quint32)));
+
+    // Resources are validated when alarms are loaded or saved, and
+    // resolved paths are used when alarms are dispatched
+    dispatcher->setResourceRegistry(&_resources);
+    _notifier.setResourceRegistry(&_resources);
+
+    connect(&_resources, SIGNAL(warningChanged(quint32,QString)),
+            this, SLOT(resourceWarningChanged(quint32,QString)));
+
+    // Firings are logged, and the last ones of each alarm are indexed
+    _history.setMaxSize(settings.value("HistoryMaxSize",
+                                       1024 * 1024).toLongLong());
+    _history.setIndexDepth(settings.value("HistoryIndexDepth", 50).toInt());
+    _history.load();
+
+    dispatcher->setHistory(&_history);
+
+    // Days excluded from alarms are shared by all the profiles
+    loadCalendars();
+
+    // Alarms are scheduled by kalarmd if DaemonSocket is set and kalarmd is
+    // running there, and here otherwise
+    QString daemonSocket(settings.value("DaemonSocket").toString());
+
+    if (!daemonSocket.isEmpty())
+        connectDaemon(daemonSocket);
+
+    loadAlarmItems();
+
+    // Mutations are journaled, and written to a snapshot periodically
+    _snapshotTimer = new QTimer(this);
+    connect(_snapshotTimer, SIGNAL(timeout()),
+            this, SLOT(snapshotTimerTimeout()));
+    _snapshotTimer->start(settings.value("SnapshotInterval",
+                                         10 * 60 * 1000).toInt());
+
+    if (!_daemonClient)
+        startScheduler();
+
+    // Metrics are served on localhost only if a port is given
+    int metricsPort = settings.value("MetricsPort", 0).toInt();
+    if (metricsPort > 0)
+    {
+        _metricsServer = new KAlarmMetricsServer(this);
+
+        connect(_metricsServer, SIGNAL(collect(QTextStream*)),
+                this, SLOT(collectMetrics(QTextStream*)));
+
+        _metricsServer->listen(metricsPort);
+    }
+
+    // Watch event loops of a GUI thread and a scheduler thread
+    _watchdog = new KAlarmWatchdog;
+    _watchdog->setThreshold(settings.value("WatchdogThreshold", 1000).toInt());
+    _watchdog->watch("GUI", QThread::currentThread(), true);
+    if (_schedulerThread.isRunning())
+        _watchdog->watch("scheduler", &_schedulerThread);
+    _watchdog->moveToThread(&_watchdogThread);
+
+    connect(_alarmQueue, SIGNAL(alarmTriggered(KAlarmItem,QDateTime)),
+            _watchdog, SLOT(alarmTriggered(KAlarmItem,QDateTime)));
+
+    if (_daemonClient)
+        connect(_daemonClient, SIGNAL(alarmTriggered(KAlarmItem,QDateTime)),
+                _watchdog, SLOT(alarmTriggered(KAlarmItem,QDateTime)));
+
+    _watchdogThread.start();
+
+    // Start watching when an event loop of a GUI thread is entered
+    QTimer::singleShot(0, _watchdog, SLOT(start()));
+
+    KAlarmStartupProfile::mark("alarms loaded");
+
+    // A tray icon menu is populated when it is shown at first
+    _trayIconMenu = new QMenu;
+
+    connect(_trayIconMenu, SIGNAL(aboutToShow()),
+            this, SLOT(trayIconMenuAboutToShow()));
+
+    _trayIcon = new QSystemTrayIcon;
+    _trayIcon->setToolTip(title());
+    _trayIcon->setContextMenu(_trayIconMenu);
+    _trayIcon->setIcon(QIcon(":/icons/candy_clock_16.png"));
+
+    connect(_trayIcon, SIGNAL(activated(QSystemTrayIcon::ActivationReason)),
+            this, SLOT(trayIconActivated(QSystemTrayIcon::ActivationReason)));
+
+    _trayIcon->show();
+
+    // Countdowns are in minutes, and updated just after every minute
+    _trayAlarmCount = settings.value("TrayAlarmCount", 5).toInt();
+
+    _countdownTimer = new QTimer(this);
+    _countdownTimer->setSingleShot(true);
+#ifdef CONFIG_QT5
+    _countdownTimer->setTimerType(Qt::VeryCoarseTimer);
+#endif
+    connect(_countdownTimer, SIGNAL(timeout()),
+            this, SLOT(countdownTimerTimeout()));
+
+    countdownTimerTimeout();
+
+    // Rows scrolled into a viewport are updated at once
+    connect(_listWidget->verticalScrollBar(), SIGNAL(valueChanged(int)),
+            this, SLOT(updateCountdowns()));
+
+    KAlarmStartupProfile::mark("tray icon");
+
+    if (_showKAlarmAtStartup)
+        show();
+    else
+    {
+        // Prevent from qutting K Alarm when K Alarm is hidden and an alarm
+        // window is closed.
+        QApplication::setQuitOnLastWindowClosed(false);
+
+        if (QSystemTrayIcon::isSystemTrayAvailable())
+            hide();
+        else
+            showMinimized();
+    }
+}
+
+KAlarm::~KAlarm()
+{
+    // Next alarm times are saved together while a queue is still alive
+    saveAlarmItems();
+
+    QMetaObject::invokeMethod(_watchdog, "stop",
+                              Qt::BlockingQueuedConnection);
+    _watchdogThread.quit();
+    _watchdogThread.wait();
+
+    delete _watchdog;
+
+    delete _daemonClient;
+
+    // Stop a timer in a scheduler thread before quitting it
+    if (_schedulerThread.isRunning())
+    {
+        QMetaObject::invokeMethod(_alarmQueue, "stop",
+                                  Qt::BlockingQueuedConnection);
+        _schedulerThread.quit();
+        _schedulerThread.wait();
+    }
+
+    delete _alarmQueue;
+    _alarmQueue = 0;
+
+    delete _trayIcon;
+    delete _trayIconMenu;
+
+    delete ui;
+}
+
+void KAlarm::setVisible(bool visible)
 {
+    if (visible)
+        setupMainWindow();
+
+    QMainWindow::setVisible(visible);
+}
+
+void KAlarm::setupMainWindow()
+{
+    if (_mainWindowReady)
+        return;
+
+    _mainWindowReady = true;
+
     ui->setupUi(this);
 
+    updateWindowTitle();
+
     _fileMenu = menuBar()->addMenu(tr("&File"));
     _fileMenu->addAction(tr("&New alarm..."), this, SLOT(addItem()),
                          QKeySequence::New);
     _fileMenu->addSeparator();
+
+    // Profiles are listed when a menu is shown
+    _profileMenu = _fileMenu->addMenu(tr("&Profiles"));
+    connect(_profileMenu, SIGNAL(aboutToShow()),
+            this, SLOT(profileMenuAboutToShow()));
+    connect(_profileMenu, SIGNAL(triggered(QAction*)),
+            this, SLOT(profileTriggered(QAction*)));
+
+    _calendarMenu = _fileMenu->addMenu(tr("&Calendars"));
+    _calendarMenu->addAction(tr("&Import calendar..."),
+                             this, SLOT(importCalendar()));
+    _calendarMenu->addAction(tr("&Remove calendar..."),
+                             this, SLOT(removeCalendar()));
+    _calendarMenu->addSeparator();
+    _calendarMenu->addAction(tr("Calendar of a &group..."),
+                             this, SLOT(setGroupCalendar()));
+
+    _fileMenu->addSeparator();
     _fileMenu->addAction(tr("E&xit"), qApp, SLOT(quit()),
                          QKeySequence(tr("Ctrl+Q")));
 
+    // Actions on selected alarms, also shown in a context menu of a list
+    _editMenu = menuBar()->addMenu(tr("&Edit"));
+    _editMenu->addAction(tr("&Enable"), this, SLOT(enableSelected()));
+    _editMenu->addAction(tr("D&isable"), this, SLOT(disableSelected()));
+    _editMenu->addSeparator();
+    _editMenu->addAction(tr("&Shift start times..."),
+                         this, SLOT(retimeSelected()));
+    _editMenu->addAction(tr("Change s&ound..."),
+                         this, SLOT(changeSoundOfSelected()));
+    _editMenu->addAction(tr("Change &program..."),
+                         this, SLOT(changeProgramOfSelected()));
+    _editMenu->addAction(tr("Move to &group..."),
+                         this, SLOT(moveSelectedToGroup()));
+    _editMenu->addSeparator();
+    _editMenu->addAction(tr("&History..."), this, SLOT(showHistory()));
+    _editMenu->addSeparator();
+    _editMenu->addAction(tr("&Delete"), this, SLOT(deleteItem()));
+
+    _listWidget->setContextMenuPolicy(Qt::ActionsContextMenu);
+    _listWidget->addActions(_editMenu->actions());
+
     _viewMenu = menuBar()->addMenu(tr("&View"));
     _showKAlarmAction = _viewMenu->addAction(tr("&Show K Alarm at startup"),
                                              this,
                                              SLOT(showKAlarmTriggered(bool)));
     _showKAlarmAction->setCheckable(true);
+    _showKAlarmAction->setChecked(_showKAlarmAtStartup);
+
+    QMenu *sortMenu = _viewMenu->addMenu(tr("Sort &by"));
+    _sortOrderGroup = new QActionGroup(this);
+
+    const char *sortOrderNames[] = {
+        QT_TR_NOOP("&None"),
+        QT_TR_NOOP("N&ext alarm"),
+        QT_TR_NOOP("N&ame"),
+        QT_TR_NOOP("&Type")
+    };
+
+    for (int i = NoSort; i <= SortByType; ++i)
+    {
+        QAction *action = sortMenu->addAction(tr(sortOrderNames[i]));
+        action->setCheckable(true);
+        action->setChecked(i == _sortOrder);
+        action->setData(i);
+        _sortOrderGroup->addAction(action);
+    }
+
+    connect(_sortOrderGroup, SIGNAL(triggered(QAction*)),
+            this, SLOT(sortOrderTriggered(QAction*)));
 
-    _helpMenu = menuBar()->addMenu(tr("&Help"));
-    _helpMenu->addAction(tr("&About %1...").arg(title()), this, SLOT(about()));
-    _helpMenu->addAction(tr("About &Qt..."), this, SLOT(aboutQt()));
+    _viewMenu->addSeparator();
+    _viewMenu->addAction(tr("S&tatistics..."), this, SLOT(showStatistics()));
+
+    menuBar()->addMenu(helpMenu());
 
     QPushButton *addButton = new QPushButton(tr("&Add"));
     QPushButton *modifyButton = new  QPushButton(tr("&Modify"));
@@ -67,9 +396,12 @@ KAlarm::KAlarm(QWidget *parent) :
     buttonLayout->addWidget(modifyButton);
     buttonLayout->addWidget(deleteButton);
 
-    _listWidget = new QListWidget;
+    _filterLine = new QLineEdit;
+    _filterLine->setPlaceholderText(
+                tr("Filter: text type:weekly day:mon is:enabled"));
 
     QVBoxLayout *vlayout = new QVBoxLayout;
+    vlayout->addWidget(_filterLine);
     vlayout->addWidget(_listWidget);
     vlayout->addLayout(buttonLayout);
 
@@ -79,56 +411,40 @@ KAlarm::KAlarm(QWidget *parent) :
     ui->mainToolBar->hide();
     statusBar()->hide();
 
-    _trayIconMenu = new QMenu;
-    _trayIconMenu->addAction(tr("&Open %1...").arg(title()),
-                             this, SLOT(openKAlarm()));
-    _trayIconMenu->addMenu(_helpMenu);
-    _trayIconMenu->addSeparator();
-    _trayIconMenu->addAction(tr("E&xit"), qApp, SLOT(quit()));
-
-    _trayIcon = new QSystemTrayIcon;
-    _trayIcon->setToolTip(title());
-    _trayIcon->setContextMenu(_trayIconMenu);
-    _trayIcon->setIcon(QIcon(":/icons/candy_clock_16.png"));
-
     connect(addButton, SIGNAL(clicked()), this, SLOT(addItem()));
     connect(modifyButton, SIGNAL(clicked()), this, SLOT(modifyItem()));
     connect(deleteButton, SIGNAL(clicked()), this, SLOT(deleteItem()));
     connect(_listWidget, SIGNAL(doubleClicked(QModelIndex)),
             this, SLOT(modifyItem(QModelIndex)));
-    connect(_trayIcon, SIGNAL(activated(QSystemTrayIcon::ActivationReason)),
-            this, SLOT(trayIconActivated(QSystemTrayIcon::ActivationReason)));
-
-    _trayIcon->show();
-
-    loadAlarmItems();
+    connect(_filterLine, SIGNAL(textChanged(QString)),
+            this, SLOT(filterTextChanged(QString)));
 
-    if (_showKAlarmAction->isChecked())
-        show();
-    else
-    {
-        // Prevent from qutting K Alarm when K Alarm is hidden and an alarm
-        // window is closed.
-        QApplication::setQuitOnLastWindowClosed(false);
+    // Restore geometry after a layout is set up
+    QSettings settings;
 
-        if (QSystemTrayIcon::isSystemTrayAvailable())
-            hide();
-        else
-            showMinimized();
-    }
+    restoreGeometry(settings.value("MainWindowGeometry").toByteArray());
 }
 
-KAlarm::~KAlarm()
+QMenu *KAlarm::helpMenu()
 {
-    delete _trayIcon;
-
-    saveAlarmItems();
+    // A help menu is shared by a menu bar and a tray icon menu
+    if (!_helpMenu)
+    {
+        _helpMenu = new QMenu(tr("&Help"), this);
+        _helpMenu->addAction(tr("&About %1...").arg(title()),
+                             this, SLOT(about()));
+        _helpMenu->addAction(tr("About &Qt..."), this, SLOT(aboutQt()));
+    }
 
-    delete ui;
+    return _helpMenu;
 }
 
 bool KAlarm::event(QEvent *e)
 {
+    // Countdowns are not updated while a window is hidden
+    if (e->type() == QEvent::Show || e->type() == QEvent::WindowStateChange)
+        QTimer::singleShot(0, this, SLOT(updateCountdowns()));
+
     if (e->type() == QEvent::KeyPress)
     {
         QKeyEvent *key = reinterpret_cast<QKeyEvent *>(e);
@@ -182,35 +498,35 @@ static void configDialogToItemWidget(const KAlarmConfigDialog &configDialog,
     itemWidget->setIntervalTime(QTime(configDialog.intervalTime().hour(),
                                       configDialog.intervalTime().minute()));
 
-    itemWidget->setWeekDayEnabled(KAlarmItemWidget::Monday,
+    itemWidget->setWeekDayEnabled(KAlarmItem::Monday,
                                   configDialog.isMondayChecked());
 
-    itemWidget->setWeekDayEnabled(KAlarmItemWidget::Tuesday,
+    itemWidget->setWeekDayEnabled(KAlarmItem::Tuesday,
                                   configDialog.isTuesdayChecked());
 
-    itemWidget->setWeekDayEnabled(KAlarmItemWidget::Wednesday,
+    itemWidget->setWeekDayEnabled(KAlarmItem::Wednesday,
                                   configDialog.isWednesdayChecked());
 
-    itemWidget->setWeekDayEnabled(KAlarmItemWidget::Thursday,
+    itemWidget->setWeekDayEnabled(KAlarmItem::Thursday,
                                   configDialog.isThursdayChecked());
 
-    itemWidget->setWeekDayEnabled(KAlarmItemWidget::Friday,
+    itemWidget->setWeekDayEnabled(KAlarmItem::Friday,
                                   configDialog.isFridayChecked());
 
-    itemWidget->setWeekDayEnabled(KAlarmItemWidget::Saturday,
+    itemWidget->setWeekDayEnabled(KAlarmItem::Saturday,
                                   configDialog.isSaturdayChecked());
 
-    itemWidget->setWeekDayEnabled(KAlarmItemWidget::Sunday,
+    itemWidget->setWeekDayEnabled(KAlarmItem::Sunday,
                                   configDialog.isSundayChecked());
 
     KAlarmItemWidget::KAlarmType alarmType;
 
     if (configDialog.isUseIntervalChecked())
-        alarmType = KAlarmItemWidget::IntervalAlarm;
+        alarmType = KAlarmItem::IntervalAlarm;
     else if (itemWidget->weekDaysToString().isEmpty())
-        alarmType = KAlarmItemWidget::SingleShotAlarm;
+        alarmType = KAlarmItem::SingleShotAlarm;
     else
-        alarmType = KAlarmItemWidget::WeeklyAlarm;
+        alarmType = KAlarmItem::WeeklyAlarm;
 
     itemWidget->setAlarmType(alarmType);
 
@@ -221,11 +537,19 @@ static void configDialogToItemWidget(const KAlarmConfigDialog &configDialog,
     itemWidget->setExecProgram(configDialog.isExecProgramChecked());
     itemWidget->setExecProgramName(configDialog.execProgramName());
     itemWidget->setExecProgramParams(configDialog.execProgramParams());
+    itemWidget->setPriority(
+                static_cast<KAlarmItem::KPriority>(configDialog.priority()));
+    itemWidget->setGroup(configDialog.group());
+    itemWidget->setCalendar(configDialog.calendar());
 }
 
 void KAlarm::addItem()
 {
+    KAlarmActivityScope activity("KAlarm::addItem(), configuration dialog");
+
     KAlarmConfigDialog configDialog(this);
+    configDialog.setGroups(_groupItems.keys());
+    configDialog.setCalendars(calendarNames());
 
     if (configDialog.exec() == QDialog::Accepted)
     {
@@ -235,23 +559,38 @@ void KAlarm::addItem()
 
         itemWidget->setAlarmEnabled(true);
 
-        QListWidgetItem *item = new QListWidgetItem;
+        KAlarmListItem *item = new KAlarmListItem;
         item->setSizeHint(QSize(itemWidget->sizeHint()));
 
+        // Set a sort key before adding to insert at a sorted position
+        _itemMap.insert(itemWidget, item);
+        _widgetMap.insert(itemWidget->id(), itemWidget);
+        joinGroup(itemWidget);
+        _resources.add(itemWidget->item());
+        itemWidget->setWarning(_resources.warning(itemWidget->id()));
+        if (!_daemonClient)
+            _alarmQueue->add(itemWidget->item());
+        updateSortKey(itemWidget);
+
         _listWidget->addItem(item);
         _listWidget->setItemWidget(item, itemWidget);
 
-        _alarmQueue.add(itemWidget);
+        _searchIndex.add(itemWidget);
+        filterItem(itemWidget);
 
         connect(itemWidget, SIGNAL(alarmEnabledToggled(bool)),
                 this, SLOT(itemWidgetAlarmEnabledToggled(bool)));
 
-        saveAlarmItems();
+        _journal.put(itemWidget->item());
+        snapshotIfNeeded();
     }
 }
 
 void KAlarm::modifyItem(const QModelIndex &index)
 {
+    KAlarmActivityScope activity("KAlarm::modifyItem(), "
+                                 "configuration dialog");
+
     KAlarmConfigDialog configDialog(this);
 
     QListWidgetItem *item;
@@ -266,52 +605,128 @@ void KAlarm::modifyItem(const QModelIndex &index)
 
     KAlarmItemWidget *itemWidget =
             qobject_cast<KAlarmItemWidget *>(_listWidget->itemWidget(item));
+
+    // A group header
+    if (!itemWidget)
+        return;
+
     configDialog.setName(itemWidget->name());
     configDialog.setStartTime(itemWidget->startTime());
     configDialog.setUseIntervalChecked(itemWidget->alarmType()
-                                        ==  KAlarmItemWidget::IntervalAlarm);
+                                        ==  KAlarmItem::IntervalAlarm);
     configDialog.setIntervalTime(itemWidget->intervalTime());
     configDialog.setMondayChecked(
-                itemWidget->isWeekDayEnabled(KAlarmItemWidget::Monday));
+                itemWidget->isWeekDayEnabled(KAlarmItem::Monday));
     configDialog.setTuesdayChecked(
-                itemWidget->isWeekDayEnabled(KAlarmItemWidget::Tuesday));
+                itemWidget->isWeekDayEnabled(KAlarmItem::Tuesday));
     configDialog.setWednesdayChecked(
-                itemWidget->isWeekDayEnabled(KAlarmItemWidget::Wednesday));
+                itemWidget->isWeekDayEnabled(KAlarmItem::Wednesday));
     configDialog.setThursdayChecked(
-                itemWidget->isWeekDayEnabled(KAlarmItemWidget::Thursday));
+                itemWidget->isWeekDayEnabled(KAlarmItem::Thursday));
     configDialog.setFridayChecked(
-                itemWidget->isWeekDayEnabled(KAlarmItemWidget::Friday));
+                itemWidget->isWeekDayEnabled(KAlarmItem::Friday));
     configDialog.setSaturdayChecked(
-                itemWidget->isWeekDayEnabled(KAlarmItemWidget::Saturday));
+                itemWidget->isWeekDayEnabled(KAlarmItem::Saturday));
     configDialog.setSundayChecked(
-                itemWidget->isWeekDayEnabled(KAlarmItemWidget::Sunday));
+                itemWidget->isWeekDayEnabled(KAlarmItem::Sunday));
     configDialog.setShowAlarmWindowChecked(itemWidget->showAlarmWindow());
     configDialog.setPlaySoundChecked(itemWidget->playSound());
     configDialog.setSoundFile(itemWidget->soundFile());
     configDialog.setExecProgramChecked(itemWidget->execProgram());
     configDialog.setExecProgramName(itemWidget->execProgramName());
     configDialog.setExecProgramParams(itemWidget->execProgramParams());
+    configDialog.setPriority(itemWidget->priority());
+    configDialog.setGroups(_groupItems.keys());
+    configDialog.setGroup(itemWidget->group());
+    configDialog.setCalendars(calendarNames());
+    configDialog.setCalendar(itemWidget->calendar());
 
     if (configDialog.exec() == QDialog::Accepted)
     {
+        QString oldGroup(itemWidget->group());
+
         configDialogToItemWidget(configDialog, itemWidget);
 
-        _alarmQueue.modify(itemWidget);
+        if (itemWidget->group() != oldGroup)
+        {
+            leaveGroup(oldGroup);
+            joinGroup(itemWidget);
+        }
 
-        saveAlarmItems();
+        _resources.modify(itemWidget->item());
+        itemWidget->setWarning(_resources.warning(itemWidget->id()));
+        if (!_daemonClient)
+            _alarmQueue->modify(itemWidget->item());
+        updateSortKey(itemWidget);
+
+        _searchIndex.modify(itemWidget);
+        filterItem(itemWidget);
+
+        _journal.put(itemWidget->item());
+        snapshotIfNeeded();
     }
 }
 
 void KAlarm::deleteItem()
 {
-    QListWidgetItem *item = _listWidget->currentItem();
-    if (item)
+    QList<KAlarmItemWidget *> widgets(selectedItemWidgets());
+
+    if (widgets.isEmpty())
+        return;
+
+    if (widgets.size() > 1
+            && QMessageBox::question(this, title(),
+                                     tr("Delete %1 alarms?")
+                                        .arg(widgets.size()),
+                                     QMessageBox::Yes | QMessageBox::No)
+                != QMessageBox::Yes)
+        return;
+
+    KAlarmActivityScope activity("KAlarm::deleteItem()");
+
+    QList<quint32> ids;
+
+    foreach (KAlarmItemWidget *w, widgets)
+        ids.append(w->id());
+
+    // Remove item widgets from alarm queue at once
+    if (!_daemonClient)
+        _alarmQueue->remove(ids);
+
+    removeItemWidgets(widgets);
+
+    // A snapshot is cheaper than journaling many alarms
+    QSettings settings;
+
+    if (ids.size() >= settings.value("SnapshotRecordCount", 1000).toInt())
+        saveAlarmItems();
+    else
     {
-        KAlarmItemWidget *w = qobject_cast<KAlarmItemWidget *>
-                                (_listWidget->itemWidget(item));
+        if (ids.size() == 1)
+            _journal.remove(ids.first());
+        else
+            _journal.remove(ids);
+
+        snapshotIfNeeded();
+    }
+}
+
+void KAlarm::removeItemWidgets(const QList<KAlarmItemWidget *> &widgets)
+{
+    _listWidget->setUpdatesEnabled(false);
+
+    foreach (KAlarmItemWidget *w, widgets)
+    {
+        QListWidgetItem *item = _itemMap.value(w);
+
+        _resources.remove(w->id());
+        _history.remove(w->id());
+        leaveGroup(w->group());
 
-        // Remove a item widget from alarm queue
-        _alarmQueue.remove(w);
+        // Remove a item widget from search index
+        _searchIndex.remove(w);
+        _itemMap.remove(w);
+        _widgetMap.remove(w->id());
 
         // Dissociate a item widget from a list widget item
         _listWidget->removeItemWidget(item);
@@ -324,102 +739,1760 @@ void KAlarm::deleteItem()
 
         // Destroy a list widget item
         delete item;
-
-        saveAlarmItems();
     }
+
+    _listWidget->setUpdatesEnabled(true);
 }
 
-void KAlarm::itemWidgetAlarmEnabledToggled(bool enabled)
+void KAlarm::enableSelected()
 {
-    if (sender())
+    QList<KAlarmItemWidget *> widgets(selectedItemWidgets());
+
+    foreach (KAlarmItemWidget *w, widgets)
     {
-        // Update alarm if signalled and enabled
-        if (enabled)
-            _alarmQueue.modify(qobject_cast<KAlarmItemWidget *>(sender()));
+        // Do not update alarms one by one in itemWidgetAlarmEnabledToggled()
+        w->blockSignals(true);
+        w->setAlarmEnabled(true);
+        w->blockSignals(false);
+    }
 
-        saveAlarmItems();
+    commitItemWidgets(widgets);
+}
+
+void KAlarm::disableSelected()
+{
+    QList<KAlarmItemWidget *> widgets(selectedItemWidgets());
+
+    foreach (KAlarmItemWidget *w, widgets)
+    {
+        w->blockSignals(true);
+        w->setAlarmEnabled(false);
+        w->blockSignals(false);
     }
+
+    commitItemWidgets(widgets);
 }
 
-void KAlarm::showKAlarmTriggered(bool checked) const
+void KAlarm::retimeSelected()
 {
-    QSettings settings;
+    QList<KAlarmItemWidget *> widgets(selectedItemWidgets());
 
-    settings.setValue("ShowKAlarm", checked);
+    if (widgets.isEmpty())
+        return;
+
+    bool ok;
+    int minutes = QInputDialog::getInt(this, title(),
+                                       tr("Shift start times by minutes:"),
+                                       0, -(24 * 60 - 1), 24 * 60 - 1, 1,
+                                       &ok);
+
+    if (!ok || minutes == 0)
+        return;
+
+    foreach (KAlarmItemWidget *w, widgets)
+        w->setStartTime(w->startTime().addSecs(minutes * 60));
+
+    commitItemWidgets(widgets);
 }
 
-void KAlarm::saveAlarmItems() const
+void KAlarm::changeSoundOfSelected()
 {
+    QList<KAlarmItemWidget *> widgets(selectedItemWidgets());
+
+    if (widgets.isEmpty())
+        return;
+
+    KAlarmActivityScope activity("KAlarm::changeSoundOfSelected(), "
+                                 "file dialog");
+
+    QStringList filters;
+    filters << tr("WAV files (*.wav)");
+    filters << tr("All files (*)");
+
     QSettings settings;
 
-    settings.setValue("MainWindowGeometry", saveGeometry());
+    QFileDialog fileDlg(this);
+    fileDlg.setNameFilters(filters);
+    fileDlg.setDirectory(settings.value("LastSoundDirectory").toString());
+    if (fileDlg.exec() != QDialog::Accepted)
+        return;
 
-    int count = _listWidget->count();
-    settings.setValue("AlarmCount", count);
+    QString soundFile(QDir::toNativeSeparators(
+                          fileDlg.selectedFiles().first()));
 
-    for (int i = 0; i < count; ++i)
+    settings.setValue("LastSoundDirectory", fileDlg.directory().path());
+
+    foreach (KAlarmItemWidget *w, widgets)
     {
-        qobject_cast<KAlarmItemWidget *>
-                (_listWidget->itemWidget(_listWidget->item(i)))->saveAlarm(i);
+        // Sound is played with an alarm window only
+        w->setShowAlarmWindow(true);
+        w->setPlaySound(true);
+        w->setSoundFile(soundFile);
     }
+
+    commitItemWidgets(widgets);
 }
 
-void KAlarm::loadAlarmItems()
+void KAlarm::changeProgramOfSelected()
 {
-    QSettings settings;
+    QList<KAlarmItemWidget *> widgets(selectedItemWidgets());
 
-    restoreGeometry(settings.value("MainWindowGeometry").toByteArray());
+    if (widgets.isEmpty())
+        return;
 
-    _showKAlarmAction->setChecked(settings.value("ShowKAlarm", true).toBool());
+    KAlarmActivityScope activity("KAlarm::changeProgramOfSelected(), "
+                                 "file dialog");
 
-    int count = settings.value("AlarmCount").toInt();
-    for (int i = 0; i < count; ++i)
-    {
-        KAlarmItemWidget *itemWidget = new KAlarmItemWidget;
+    QStringList filters;
+    filters << tr("Executable files (*.exe; *.cmd; *.btm; *.com; *.bat)");
+    filters << tr("All files (*)");
 
-        itemWidget->loadAlarm(i);
+    QSettings settings;
 
-        QListWidgetItem *item = new QListWidgetItem;
-        item->setSizeHint(QSize(itemWidget->sizeHint()));
+    QFileDialog fileDlg(this);
+    fileDlg.setNameFilters(filters);
+    fileDlg.setDirectory(settings.value("LastExecuteProgramDirectory")
+                         .toString());
+    if (fileDlg.exec() != QDialog::Accepted)
+        return;
 
-        _listWidget->addItem(item);
-        _listWidget->setItemWidget(item, itemWidget);
+    QString program(QDir::toNativeSeparators(
+                        fileDlg.selectedFiles().first()));
 
-        _alarmQueue.add(itemWidget);
+    settings.setValue("LastExecuteProgramDirectory",
+                      fileDlg.directory().path());
 
-        connect(itemWidget, SIGNAL(alarmEnabledToggled(bool)),
-                this, SLOT(itemWidgetAlarmEnabledToggled(bool)));
+    foreach (KAlarmItemWidget *w, widgets)
+    {
+        w->setExecProgram(true);
+        w->setExecProgramName(program);
     }
-}
 
-void KAlarm::about()
-{
-    QMessageBox::about( this, tr("About %1").arg(title()), tr(
-"<h2>%1 %2</h2>"
-"<p>Copyright &copy; 2015 by %3 "
-"<a href=mailto:komh@chollian.net>&lt;komh@chollian.net&gt;</a>"
-"<p>%1 is a program to alarm one time, at regular intervals or weekly."
-"<p>If you want to promote to develop this program, then donate at the below "
-"web page, please."
-"<p align=center><a href=http://www.ecomstation.co.kr/komh/donate.html>"
-"http://www.ecomstation.co.kr/komh/donate.html</a>"
-"<p>This program comes with ABSOLUTELY NO WARRANTY. This is free software, "
-"and you are welcome to redistribute it under certain conditions. See "
-"<a href=http://www.gnu.org/licenses/gpl.html>the GPL v3 license</a> "
-"for details."
-                            ).arg(title()).arg(version()).arg(organization()));
+    commitItemWidgets(widgets);
 }
 
-void KAlarm::aboutQt()
+void KAlarm::showHistory()
 {
-    QMessageBox::aboutQt(this);
+    QList<KAlarmItemWidget *> widgets(selectedItemWidgets());
+
+    if (widgets.isEmpty())
+        return;
+
+    KAlarmItemWidget *w = widgets.first();
+
+    QSettings settings;
+
+    QList<KAlarmHistory::Event> events(
+                _history.events(w->id(),
+                                settings.value("HistoryShowCount",
+                                               20).toInt()));
+
+    QDialog dialog(this);
+    dialog.setWindowTitle(tr("History of %1").arg(w->name()));
+
+    QTreeWidget *tree = new QTreeWidget;
+    tree->setRootIsDecorated(false);
+    tree->setHeaderLabels(QStringList() << tr("Time") << tr("Event")
+                                        << tr("Alarm time") << tr("Late")
+                                        << tr("Exit code"));
+
+    foreach (const KAlarmHistory::Event &event, events)
+    {
+        QTreeWidgetItem *item = new QTreeWidgetItem(tree);
+
+        item->setText(0, event.at.toString("yyyy-MM-dd HH:mm:ss"));
+        item->setText(1, KAlarmHistory::kindName(event.kind));
+        item->setText(2, event.due.toString("yyyy-MM-dd HH:mm"));
+        item->setText(3, tr("%1 s").arg(event.lateness() / 1000.0, 0, 'f',
+                                        1));
+        if (event.kind == KAlarmHistory::ProgramExited)
+            item->setText(4, QString::number(event.status));
+    }
+
+    for (int i = 0; i < tree->columnCount(); ++i)
+        tree->resizeColumnToContents(i);
+
+    QDialogButtonBox *buttons = new QDialogButtonBox(QDialogButtonBox::Close);
+    connect(buttons, SIGNAL(rejected()), &dialog, SLOT(reject()));
+
+    QVBoxLayout *layout = new QVBoxLayout(&dialog);
+    layout->addWidget(tree);
+    layout->addWidget(buttons);
+
+    dialog.resize(600, 300);
+
+    KAlarmActivityScope activity("KAlarm::showHistory(), dialog");
+
+    dialog.exec();
 }
 
-void KAlarm::openKAlarm()
+void KAlarm::importCalendar()
 {
-    show();
-    activateWindow();
-    raise();
+    KAlarmActivityScope activity("KAlarm::importCalendar(), file dialog");
+
+    QStringList filters;
+    filters << tr("Calendar files (*.ics *.txt)");
+    filters << tr("All files (*)");
+
+    QSettings settings;
+
+    QFileDialog fileDlg(this);
+    fileDlg.setNameFilters(filters);
+    fileDlg.setDirectory(settings.value("LastCalendarDirectory").toString());
+    if (fileDlg.exec() != QDialog::Accepted)
+        return;
+
+    QString fileName(fileDlg.selectedFiles().first());
+
+    settings.setValue("LastCalendarDirectory", fileDlg.directory().path());
+
+    bool ok;
+    QString name(QInputDialog::getText(this, title(),
+                                       tr("Name of a calendar:"),
+                                       QLineEdit::Normal,
+                                       QFileInfo(fileName).completeBaseName(),
+                                       &ok).trimmed());
+    if (!ok || name.isEmpty())
+        return;
+
+    // A name is a key of settings
+    if (!QRegExp("[\\w -]+").exactMatch(name))
+    {
+        QMessageBox::warning(this, title(),
+                             tr("A name of a calendar can contain only "
+                                "letters, digits, spaces, '-' and '_'."));
+        return;
+    }
+
+    // Items in order of KAlarmCalendar::KMode
+    QStringList modes;
+    modes << tr("Skip alarms on excluded days");
+    modes << tr("Move alarms to the next day not excluded");
+
+    QString mode(QInputDialog::getItem(this, title(),
+                                       tr("Alarms on excluded days:"),
+                                       modes, 0, false, &ok));
+    if (!ok)
+        return;
+
+    KAlarmCalendar calendar(name, static_cast<KAlarmCalendar::KMode>(
+                                modes.indexOf(mode)));
+    QString error;
+
+    if (!calendar.importFile(fileName, &error))
+    {
+        QMessageBox::warning(this, title(),
+                             tr("Cannot import %1:\n%2")
+                                .arg(QDir::toNativeSeparators(fileName))
+                                .arg(error));
+        return;
+    }
+
+    // Importing again replaces a calendar
+    int index = calendarNames().indexOf(name);
+    if (index < 0)
+        _calendars.append(calendar);
+    else
+        _calendars[index] = calendar;
+
+    saveCalendars();
+    applyCalendars();
+
+    QMessageBox::information(this, title(),
+                             tr("%1 days are excluded by a calendar %2.")
+                                .arg(calendar.count()).arg(name));
+}
+
+void KAlarm::removeCalendar()
+{
+    if (_calendars.isEmpty())
+        return;
+
+    KAlarmActivityScope activity("KAlarm::removeCalendar(), input dialog");
+
+    bool ok;
+    QString name(QInputDialog::getItem(this, title(),
+                                       tr("Calendar to remove:"),
+                                       calendarNames(), 0, false, &ok));
+    if (!ok)
+        return;
+
+    // Alarms keep a name of a calendar, and exclude no day until a
+    // calendar of the name is imported again
+    _calendars.removeAt(calendarNames().indexOf(name));
+
+    saveCalendars();
+    applyCalendars();
+}
+
+void KAlarm::setGroupCalendar()
+{
+    QStringList groups(_groupItems.keys());
+
+    if (groups.isEmpty())
+        return;
+
+    groups.sort();
+
+    KAlarmActivityScope activity("KAlarm::setGroupCalendar(), "
+                                 "input dialog");
+
+    // A group of a selected alarm first
+    QList<KAlarmItemWidget *> widgets(selectedItemWidgets());
+    int current = widgets.isEmpty()
+                    ? 0 : qMax(groups.indexOf(widgets.first()->group()), 0);
+
+    bool ok;
+    QString group(QInputDialog::getItem(this, title(), tr("Group:"),
+                                        groups, current, false, &ok));
+    if (!ok)
+        return;
+
+    // Not a valid name of a calendar
+    QStringList calendars(calendarNames());
+    calendars.prepend(tr("(None)"));
+
+    QString calendar(QInputDialog::getItem(
+                         this, title(),
+                         tr("Calendar of a group %1:").arg(group),
+                         calendars,
+                         qMax(calendars.indexOf(_groupCalendars.value(group)),
+                              0),
+                         false, &ok));
+    if (!ok)
+        return;
+
+    if (calendars.indexOf(calendar) == 0)
+        _groupCalendars.remove(group);
+    else
+        _groupCalendars.insert(group, calendar);
+
+    saveGroupStates();
+    applyCalendars();
+}
+
+void KAlarm::moveSelectedToGroup()
+{
+    QList<KAlarmItemWidget *> widgets(selectedItemWidgets());
+
+    if (widgets.isEmpty())
+        return;
+
+    KAlarmActivityScope activity("KAlarm::moveSelectedToGroup(), "
+                                 "input dialog");
+
+    QStringList groups(_groupItems.keys());
+    groups.sort();
+    groups.prepend(QString());
+
+    bool ok;
+    QString group(QInputDialog::getItem(this, title(),
+                                        tr("Group, empty to ungroup:"),
+                                        groups,
+                                        qMax(groups.indexOf(
+                                            widgets.first()->group()), 0),
+                                        true, &ok).trimmed());
+    if (!ok)
+        return;
+
+    _listWidget->setUpdatesEnabled(false);
+
+    foreach (KAlarmItemWidget *w, widgets)
+    {
+        if (w->group() == group)
+            continue;
+
+        leaveGroup(w->group());
+        w->setGroup(group);
+        joinGroup(w);
+    }
+
+    _listWidget->setUpdatesEnabled(true);
+
+    commitItemWidgets(widgets);
+}
+
+void KAlarm::joinGroup(const KAlarmItemWidget *w)
+{
+    KAlarmListItem *item = static_cast<KAlarmListItem *>(_itemMap.value(w));
+    QString group(w->group());
+
+    if (item)
+        item->setGroup(group);
+
+    if (group.isEmpty())
+        return;
+
+    KAlarmGroupWidget *groupWidget = this->groupWidget(group);
+
+    if (!groupWidget)
+    {
+        groupWidget = new KAlarmGroupWidget(group);
+        groupWidget->setGroupEnabled(!_disabledGroups.contains(group));
+        groupWidget->setExpanded(!_collapsedGroups.contains(group));
+
+        KAlarmListItem *header = new KAlarmListItem;
+        header->setGroup(group);
+        header->setHeader(true);
+        header->setSizeHint(QSize(groupWidget->sizeHint()));
+
+        _listWidget->addItem(header);
+        _listWidget->setItemWidget(header, groupWidget);
+        _groupItems.insert(group, header);
+
+        connect(groupWidget, SIGNAL(groupEnabledToggled(bool)),
+                this, SLOT(groupEnabledToggled(bool)));
+        connect(groupWidget, SIGNAL(expandedToggled(bool)),
+                this, SLOT(groupExpandedToggled(bool)));
+    }
+
+    groupWidget->setCount(groupWidget->count() + 1);
+}
+
+void KAlarm::leaveGroup(const QString &group)
+{
+    KAlarmGroupWidget *groupWidget = this->groupWidget(group);
+
+    if (!groupWidget)
+        return;
+
+    if (groupWidget->count() > 1)
+    {
+        groupWidget->setCount(groupWidget->count() - 1);
+
+        return;
+    }
+
+    // Remove an empty group and its states
+    QListWidgetItem *header = _groupItems.take(group);
+
+    _listWidget->removeItemWidget(header);
+
+    delete groupWidget;
+    delete header;
+
+    if (_disabledGroups.remove(group))
+        _alarmQueue->setGroupEnabled(group, true);
+
+    _collapsedGroups.remove(group);
+
+    if (_groupCalendars.remove(group))
+        applyCalendars();
+}
+
+KAlarmGroupWidget *KAlarm::groupWidget(const QString &group) const
+{
+    QListWidgetItem *header = _groupItems.value(group);
+
+    return header ? qobject_cast<KAlarmGroupWidget *>
+                        (_listWidget->itemWidget(header))
+                  : 0;
+}
+
+void KAlarm::saveGroupStates()
+{
+    // Only states of groups are written, not alarms in groups
+    QScopedPointer<QSettings> store(createProfileStore(_profile));
+
+    store->setValue("DisabledGroups", QStringList(_disabledGroups.values()));
+    store->setValue("CollapsedGroups",
+                    QStringList(_collapsedGroups.values()));
+    store->setValue("GroupCalendars", groupCalendarPairs(_groupCalendars));
+    store->sync();
+
+    _storeDigest = storeDigest();
+}
+
+QStringList KAlarm::calendarNames() const
+{
+    QStringList names;
+
+    foreach (const KAlarmCalendar &calendar, _calendars)
+        names.append(calendar.name());
+
+    return names;
+}
+
+void KAlarm::loadCalendars()
+{
+    QSettings settings;
+
+    settings.beginGroup("Calendars");
+
+    foreach (const QString &name, settings.childGroups())
+    {
+        KAlarmCalendar calendar;
+
+        calendar.load(settings, name);
+        _calendars.append(calendar);
+    }
+
+    settings.endGroup();
+}
+
+void KAlarm::saveCalendars() const
+{
+    QSettings settings;
+
+    settings.remove("Calendars");
+
+    settings.beginGroup("Calendars");
+
+    foreach (const KAlarmCalendar &calendar, _calendars)
+        calendar.save(settings);
+
+    settings.endGroup();
+}
+
+void KAlarm::applyCalendars()
+{
+    // All the alarms are rescheduled
+    _alarmQueue->setCalendars(_calendars, _groupCalendars);
+}
+
+QStringList KAlarm::groupCalendarPairs(const QHash<QString, QString> &map)
+{
+    QStringList groups(map.keys());
+    groups.sort();
+
+    QStringList pairs;
+
+    foreach (const QString &group, groups)
+        pairs << group << map.value(group);
+
+    return pairs;
+}
+
+QHash<QString, QString> KAlarm::groupCalendarMap(const QStringList &pairs)
+{
+    QHash<QString, QString> map;
+
+    for (int i = 0; i + 1 < pairs.size(); i += 2)
+        map.insert(pairs.at(i), pairs.at(i + 1));
+
+    return map;
+}
+
+QSet<QString> KAlarm::groupSet(const QStringList &groups)
+{
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+    return QSet<QString>(groups.begin(), groups.end());
+#else
+    return groups.toSet();
+#endif
+}
+
+QList<KAlarmItemWidget *> KAlarm::selectedItemWidgets() const
+{
+    QList<KAlarmItemWidget *> widgets;
+
+    // Alarms hidden by a filter or in a collapsed group are not touched
+    foreach (QListWidgetItem *item, _listWidget->selectedItems())
+    {
+        KAlarmItemWidget *w = qobject_cast<KAlarmItemWidget *>
+                                (_listWidget->itemWidget(item));
+
+        // Group headers are skipped
+        if (w && !item->isHidden())
+            widgets.append(w);
+    }
+
+    return widgets;
+}
+
+/* Apply changes of widgets to a queue and a store as one transaction */
+void KAlarm::commitItemWidgets(const QList<KAlarmItemWidget *> &widgets)
+{
+    if (widgets.isEmpty())
+        return;
+
+    KAlarmActivityScope activity("KAlarm::commitItemWidgets()");
+
+    QList<KAlarmItem> items;
+
+    foreach (KAlarmItemWidget *w, widgets)
+    {
+        _resources.modify(w->item());
+        w->setWarning(_resources.warning(w->id()));
+
+        _searchIndex.modify(w);
+        filterItem(w);
+
+        items.append(w->item());
+    }
+
+    // Rebuild a queue once
+    if (!_daemonClient)
+        _alarmQueue->modify(items);
+
+    foreach (KAlarmItemWidget *w, widgets)
+        updateSortKey(w);
+
+    QSettings settings;
+
+    if (items.size() >= settings.value("SnapshotRecordCount", 1000).toInt())
+        saveAlarmItems();
+    else
+    {
+        _journal.put(items);
+
+        snapshotIfNeeded();
+    }
+}
+
+void KAlarm::itemWidgetAlarmEnabledToggled(bool enabled)
+{
+    Q_UNUSED(enabled);
+
+    KAlarmItemWidget *w = qobject_cast<KAlarmItemWidget *>(sender());
+
+    if (w)
+    {
+        // Update alarm if signalled. A scheduler has its own copy of
+        // alarm data, so it should know that alarm is disabled, too.
+        if (!_daemonClient)
+            _alarmQueue->modify(w->item());
+
+        // A disabled alarm is sorted after enabled alarms
+        updateSortKey(w);
+
+        _searchIndex.modify(w);
+        filterItem(w);
+
+        // Alarms disabled after alarming are journaled here, too
+        _journal.put(w->item());
+        snapshotIfNeeded();
+    }
+}
+
+void KAlarm::groupEnabledToggled(bool enabled)
+{
+    KAlarmGroupWidget *w = qobject_cast<KAlarmGroupWidget *>(sender());
+
+    if (!w)
+        return;
+
+    // Alarms of a group are not touched
+    if (enabled)
+        _disabledGroups.remove(w->group());
+    else
+        _disabledGroups.insert(w->group());
+
+    _alarmQueue->setGroupEnabled(w->group(), enabled);
+
+    saveGroupStates();
+    updateCountdowns();
+}
+
+void KAlarm::groupExpandedToggled(bool expanded)
+{
+    KAlarmGroupWidget *w = qobject_cast<KAlarmGroupWidget *>(sender());
+
+    if (!w)
+        return;
+
+    if (expanded)
+        _collapsedGroups.remove(w->group());
+    else
+        _collapsedGroups.insert(w->group());
+
+    _listWidget->setUpdatesEnabled(false);
+
+    foreach (const KAlarmItemWidget *itemWidget, _widgetMap)
+    {
+        if (itemWidget->group() == w->group())
+            filterItem(itemWidget);
+    }
+
+    _listWidget->setUpdatesEnabled(true);
+
+    saveGroupStates();
+    updateCountdowns();
+}
+
+void KAlarm::resourceWarningChanged(quint32 id, const QString &warning)
+{
+    KAlarmItemWidget *w = _widgetMap.value(id);
+
+    if (w)
+        w->setWarning(warning);
+}
+
+void KAlarm::filterItem(const KAlarmItemWidget *w)
+{
+    QListWidgetItem *item = _itemMap.value(w);
+    bool hidden = !_searchIndex.isMatched(w)
+                  || _collapsedGroups.contains(w->group());
+
+    if (item && item->isHidden() != hidden)
+        item->setHidden(hidden);
+}
+
+void KAlarm::filterTextChanged(const QString &text)
+{
+    // Only items whose match state changed are shown or hidden
+    foreach (const KAlarmItemWidget *w, _searchIndex.setFilter(text))
+        filterItem(w);
+
+    updateCountdowns();
+}
+
+void KAlarm::updateSortKey(const KAlarmItemWidget *w)
+{
+    KAlarmListItem *item = static_cast<KAlarmListItem *>(_itemMap.value(w));
+
+    if (!item)
+        return;
+
+    switch (_sortOrder)
+    {
+    case SortByNextAlarm:
+    {
+        QDateTime next(_daemonClient ? w->nextAlarm()
+                                     : _alarmQueue->nextAlarm(w->id()));
+
+        if (w->isAlarmEnabled() && next.isValid())
+            item->setSortKey(next.toMSecsSinceEpoch());
+        else
+            item->setSortKey(std::numeric_limits<qint64>::max());
+        break;
+    }
+
+    case SortByName:
+        item->setSortKey(w->name());
+        break;
+
+    case SortByType:
+        item->setSortKey(static_cast<qint64>(w->alarmType()));
+        break;
+
+    // Ids are given in order of adding alarms, and kept across restarts
+    case NoSort:
+    default:
+        item->setSortKey(static_cast<qint64>(w->id()));
+        break;
+    }
+}
+
+void KAlarm::setSortOrder(KSortOrder sortOrder)
+{
+    _sortOrder = sortOrder;
+
+    // Update all the keys at once, then sort only one time
+    _listWidget->setSortingEnabled(false);
+
+    // Items are always sorted to keep groups together. Without a sort
+    // order, alarms are in order of being added.
+    QHashIterator<const KAlarmItemWidget *, QListWidgetItem *> it(_itemMap);
+    while (it.hasNext())
+    {
+        it.next();
+
+        updateSortKey(it.key());
+    }
+
+    _listWidget->setSortingEnabled(true);
+    _listWidget->sortItems();
+
+    updateCountdowns();
+}
+
+void KAlarm::alarmScheduled(quint32 id, const QDateTime &dt)
+{
+    // An alarm may be deleted before a queued signal is delivered
+    KAlarmItemWidget *w = _widgetMap.value(id);
+
+    if (w)
+    {
+        w->setNextAlarm(dt);
+
+        // Only a label of a changed text is repainted
+        w->updateCountdown(_disabledGroups.contains(w->group())
+                           ? QDateTime() : QDateTime::currentDateTime());
+    }
+
+    // Only a rescheduled item is moved
+    if (w && _sortOrder == SortByNextAlarm)
+        updateSortKey(w);
+}
+
+void KAlarm::alarmDisabled(quint32 id)
+{
+    KAlarmItemWidget *w = _widgetMap.value(id);
+
+    if (w)
+        w->setAlarmEnabled(false);
+}
+
+bool KAlarm::connectDaemon(const QString &name)
+{
+    _daemonClient = new KAlarmDaemonClient;
+
+    if (!_daemonClient->connectToDaemon(name))
+    {
+        delete _daemonClient;
+        _daemonClient = 0;
+
+        return false;
+    }
+
+    // Next alarm times of kalarmd are shown, and not computed here
+    connect(_daemonClient, SIGNAL(alarmScheduled(quint32,QDateTime)),
+            this, SLOT(alarmScheduled(quint32,QDateTime)));
+    connect(_daemonClient, SIGNAL(alarmDisabled(quint32)),
+            this, SLOT(alarmDisabled(quint32)));
+    connect(_daemonClient, SIGNAL(alarmTriggered(KAlarmItem,QDateTime)),
+            &_notifier, SLOT(notify(KAlarmItem,QDateTime)));
+    connect(_daemonClient, SIGNAL(alarmWarmUp(KAlarmItem,QDateTime)),
+            &_notifier, SLOT(prepare(KAlarmItem,QDateTime)));
+    connect(&_notifier, SIGNAL(presented(quint32)),
+            _daemonClient, SLOT(presented(quint32)));
+    connect(_daemonClient, SIGNAL(disconnected()),
+            this, SLOT(daemonDisconnected()), Qt::QueuedConnection);
+
+    return true;
+}
+
+void KAlarm::startScheduler()
+{
+    _alarmQueue->moveToThread(&_schedulerThread);
+
+    _schedulerThread.start();
+    QMetaObject::invokeMethod(_alarmQueue, "start", Qt::QueuedConnection);
+}
+
+void KAlarm::daemonDisconnected()
+{
+    _daemonClient->deleteLater();
+    _daemonClient = 0;
+
+    _trayIcon->showMessage(title(), tr("Connection to kalarmd is lost. "
+                                       "Alarms are scheduled here."),
+                           QSystemTrayIcon::Warning);
+
+    // Catch up with the next alarm times of all the alarms
+    QList<KAlarmItem> items;
+
+    foreach (KAlarmItemWidget *w, _widgetMap)
+        items.append(w->item());
+
+    _alarmQueue->replace(items);
+
+    startScheduler();
+}
+
+void KAlarm::sortOrderTriggered(QAction *action)
+{
+    setSortOrder(static_cast<KSortOrder>(action->data().toInt()));
+
+    QSettings settings;
+
+    settings.setValue("SortOrder", _sortOrder);
+}
+
+void KAlarm::showKAlarmTriggered(bool checked)
+{
+    _showKAlarmAtStartup = checked;
+
+    QSettings settings;
+
+    settings.setValue("ShowKAlarm", checked);
+}
+
+void KAlarm::snapshotIfNeeded()
+{
+    QSettings settings;
+
+    // A snapshot is a full rewrite, so write it only after many mutations
+    if (_journal.recordCount()
+            >= settings.value("SnapshotRecordCount", 1000).toInt())
+        saveAlarmItems();
+}
+
+void KAlarm::snapshotTimerTimeout()
+{
+    if (_journal.recordCount() > 0)
+        saveAlarmItems();
+}
+
+void KAlarm::saveAlarmItems()
+{
+    KAlarmActivityScope activity("KAlarm::saveAlarmItems(), persistence");
+
+    QElapsedTimer timer;
+    timer.start();
+
+    QSettings settings;
+
+    // Geometry is not restored until a main window is set up
+    if (_mainWindowReady)
+        settings.setValue("MainWindowGeometry", saveGeometry());
+
+    QScopedPointer<QSettings> store(createProfileStore(_profile));
+    QHash<quint32, KAlarmItem> storeItems;
+    KAlarmStringTable strings;
+
+    int count = 0;
+
+    for (int i = 0; i < _listWidget->count(); ++i)
+    {
+        KAlarmItemWidget *w = qobject_cast<KAlarmItemWidget *>
+                                (_listWidget->itemWidget(_listWidget->item(i)));
+
+        // Group headers are not saved
+        if (w)
+        {
+            w->item().saveAlarm(*store, count++, &strings);
+            storeItems.insert(w->id(), w->item());
+        }
+    }
+
+    store->setValue("AlarmCount", count);
+    strings.save(*store);
+    store->setValue("DisabledGroups", QStringList(_disabledGroups.values()));
+    store->setValue("CollapsedGroups",
+                    QStringList(_collapsedGroups.values()));
+    store->setValue("GroupCalendars", groupCalendarPairs(_groupCalendars));
+
+    // A journal is reset only after a snapshot is written completely
+    store->sync();
+
+    if (store->status() == QSettings::NoError)
+    {
+        _journal.reset(timer.elapsed());
+
+        _storeItems = storeItems;
+        _storeDigest = storeDigest();
+
+        if (_alarmQueue && !_daemonClient)
+            _alarmQueue->saveNextAlarms(profileFile(_profile, "next"));
+    }
+}
+
+void KAlarm::loadAlarmItems()
+{
+    KAlarmActivityScope activity("KAlarm::loadAlarmItems(), persistence");
+
+    QSettings settings;
+
+    _showKAlarmAtStartup = settings.value("ShowKAlarm", true).toBool();
+
+    QList<KAlarmItem> items;
+
+    QScopedPointer<QSettings> store(createProfileStore(_profile));
+
+    QStringList disabledGroups(store->value("DisabledGroups")
+                               .toStringList());
+
+    _disabledGroups = groupSet(disabledGroups);
+    _collapsedGroups = groupSet(store->value("CollapsedGroups")
+                                .toStringList());
+    _groupCalendars = groupCalendarMap(store->value("GroupCalendars")
+                                       .toStringList());
+
+    _storeItems.clear();
+
+    KAlarmStringTable strings;
+    strings.load(*store);
+
+    int count = store->value("AlarmCount").toInt();
+    for (int i = 0; i < count; ++i)
+    {
+        KAlarmItem item;
+
+        item.loadAlarm(*store, i, &strings);
+        items.append(item);
+
+        _storeItems.insert(item.id(), item);
+    }
+
+    _storeDigest = storeDigest();
+    watchStore();
+
+    // Apply mutations after the last snapshot
+    int replayed = _journal.replay(&items);
+
+    foreach (const KAlarmItem &alarmItem, items)
+        createItemWidget(alarmItem);
+
+    // Alarms of a previous profile, if any, are replaced at once. Next
+    // alarm times saved last are reused if still valid
+    _alarmQueue->setDisabledGroups(disabledGroups);
+    _alarmQueue->setCalendars(_calendars, _groupCalendars);
+
+    // kalarmd reads alarms by itself, and sends their next alarm times
+    if (_daemonClient)
+        _daemonClient->refresh();
+    else
+        _alarmQueue->replace(items, profileFile(_profile, "next"));
+
+    // Sort all the items once after loading
+    setSortOrder(static_cast<KSortOrder>(
+                     settings.value("SortOrder", NoSort).toInt()));
+
+    // Start with an empty journal
+    if (replayed > 0)
+        saveAlarmItems();
+}
+
+KAlarmItemWidget *KAlarm::createItemWidget(const KAlarmItem &alarmItem)
+{
+    KAlarmItemWidget *itemWidget = new KAlarmItemWidget;
+
+    itemWidget->setItem(alarmItem);
+
+    KAlarmListItem *item = new KAlarmListItem;
+    item->setSizeHint(QSize(itemWidget->sizeHint()));
+
+    _listWidget->addItem(item);
+    _listWidget->setItemWidget(item, itemWidget);
+    _itemMap.insert(itemWidget, item);
+    _widgetMap.insert(itemWidget->id(), itemWidget);
+    joinGroup(itemWidget);
+
+    _resources.add(itemWidget->item());
+    itemWidget->setWarning(_resources.warning(itemWidget->id()));
+
+    _searchIndex.add(itemWidget);
+    filterItem(itemWidget);
+
+    connect(itemWidget, SIGNAL(alarmEnabledToggled(bool)),
+            this, SLOT(itemWidgetAlarmEnabledToggled(bool)));
+
+    return itemWidget;
+}
+
+QSettings *KAlarm::createProfileStore(const QString &profile)
+{
+    // A default profile is kept in settings as before
+    if (profile.isEmpty())
+        return new QSettings;
+
+    return new QSettings(profileFile(profile, "ini"), QSettings::IniFormat);
+}
+
+QString KAlarm::profileFile(const QString &profile, const QString &ext)
+{
+    if (profile.isEmpty())
+        return KAlarmPaths::dataFile(QString("alarms.%1").arg(ext));
+
+    return KAlarmPaths::dataFile(QString("profile-%1.%2").arg(profile)
+                                                        .arg(ext));
+}
+
+void KAlarm::switchProfile(const QString &profile)
+{
+    if (profile == _profile)
+        return;
+
+    KAlarmActivityScope activity("KAlarm::switchProfile(), persistence");
+
+    // Write alarms of a current profile, and empty its journal
+    saveAlarmItems();
+
+    clearItemWidgets();
+
+    // Alarms of a current profile are neither presented nor logged any
+    // more. Ids of other profiles may be the same.
+    if (!_daemonClient)
+        _alarmQueue->replace(QList<KAlarmItem>());
+
+    QMetaObject::invokeMethod(_alarmQueue->dispatcher(), "clear",
+                              _schedulerThread.isRunning()
+                              ? Qt::BlockingQueuedConnection
+                              : Qt::DirectConnection);
+    _notifier.clear();
+
+    _profile = profile;
+    _journal.setFileName(profileFile(_profile, "journal"));
+    _history.setFileName(profileFile(_profile, "history"));
+    _history.load();
+
+    QSettings settings;
+    settings.setValue("Profile", _profile);
+
+    loadAlarmItems();
+
+    updateWindowTitle();
+}
+
+QString KAlarm::storeFileName() const
+{
+    QScopedPointer<QSettings> store(createProfileStore(_profile));
+
+    // Not a file if settings are in a registry
+    return QFileInfo(store->fileName()).isFile() ? store->fileName()
+                                                 : QString();
+}
+
+QByteArray KAlarm::storeDigest() const
+{
+    QFile file(storeFileName());
+
+    if (file.fileName().isEmpty() || !file.open(QIODevice::ReadOnly))
+        return QByteArray();
+
+    return QCryptographicHash::hash(file.readAll(), QCryptographicHash::Md5);
+}
+
+void KAlarm::watchStore()
+{
+    QString fileName(storeFileName());
+
+    // A store replaced by renaming is not watched any more
+    QStringList paths(_storeWatcher->files() + _storeWatcher->directories());
+    QStringList wanted;
+
+    if (!fileName.isEmpty())
+        wanted << fileName << QFileInfo(fileName).absolutePath();
+
+    foreach (const QString &path, paths)
+    {
+        if (!wanted.contains(path))
+            _storeWatcher->removePath(path);
+    }
+
+    foreach (const QString &path, wanted)
+    {
+        if (!paths.contains(path))
+            _storeWatcher->addPath(path);
+    }
+}
+
+QByteArray KAlarm::itemData(const KAlarmItem &item)
+{
+    QByteArray data;
+    QDataStream out(&data, QIODevice::WriteOnly);
+
+    out << item;
+
+    return data;
+}
+
+void KAlarm::storeFileChanged()
+{
+    _storeReloadTimer->start();
+}
+
+void KAlarm::storeDirectoryChanged()
+{
+    // A store may be replaced by renaming
+    QString fileName(storeFileName());
+
+    if (!fileName.isEmpty() && !_storeWatcher->files().contains(fileName))
+        _storeReloadTimer->start();
+}
+
+void KAlarm::reloadStore()
+{
+    // Changes during a dialog below are reloaded later
+    if (_storeReloading)
+    {
+        _storeReloadTimer->start();
+
+        return;
+    }
+
+    watchStore();
+
+    QByteArray digest(storeDigest());
+
+    // Written by K Alarm, or not a file
+    if (digest.isEmpty() || digest == _storeDigest)
+        return;
+
+    KAlarmActivityScope activity("KAlarm::reloadStore(), persistence");
+
+    _storeReloading = true;
+
+    QScopedPointer<QSettings> store(createProfileStore(_profile));
+
+    // Read a file again
+    store->sync();
+
+    QList<KAlarmItem> externalItems;
+    QHash<quint32, KAlarmItem> externalMap;
+
+    KAlarmStringTable strings;
+    strings.load(*store);
+
+    int count = store->value("AlarmCount").toInt();
+    for (int i = 0; i < count; ++i)
+    {
+        KAlarmItem item;
+
+        item.loadAlarm(*store, i, &strings);
+
+        externalItems.append(item);
+        externalMap.insert(item.id(), item);
+    }
+
+    // Compare with a store read or written last, and then with alarms
+    // here, record by record
+    QList<KAlarmItem> addedItems;
+    QList<KAlarmItem> modifiedItems;
+    QList<KAlarmItemWidget *> removedWidgets;
+    QList<KAlarmItem> conflictItems;             // changed outside
+    QList<KAlarmItemWidget *> conflictRemovals;  // removed outside
+    QStringList conflictNames;
+
+    foreach (const KAlarmItem &external, externalItems)
+    {
+        KAlarmItemWidget *w = _widgetMap.value(external.id());
+        QByteArray externalData(itemData(external));
+
+        bool inStore = _storeItems.contains(external.id());
+
+        if (inStore
+                && itemData(_storeItems.value(external.id())) == externalData)
+            continue;
+
+        if (!w)
+        {
+            // Added outside, or modified outside but removed here
+            if (!inStore)
+                addedItems.append(external);
+            else
+            {
+                conflictItems.append(external);
+                conflictNames.append(external.name());
+            }
+        }
+        else if (itemData(w->item()) == externalData)
+            continue;
+        else if (inStore && itemData(w->item())
+                    == itemData(_storeItems.value(external.id())))
+            modifiedItems.append(external);
+        else
+        {
+            conflictItems.append(external);
+            conflictNames.append(w->name());
+        }
+    }
+
+    QHash<quint32, KAlarmItem>::const_iterator it;
+    for (it = _storeItems.constBegin(); it != _storeItems.constEnd(); ++it)
+    {
+        KAlarmItemWidget *w = _widgetMap.value(it.key());
+
+        if (!w || externalMap.contains(it.key()))
+            continue;
+
+        // Removed outside
+        if (itemData(w->item()) == itemData(it.value()))
+            removedWidgets.append(w);
+        else
+        {
+            conflictRemovals.append(w);
+            conflictNames.append(w->name());
+        }
+    }
+
+    // Ask instead of overwriting either side
+    if (!conflictNames.isEmpty())
+    {
+        KAlarmActivityScope activity("KAlarm::reloadStore(), message box");
+
+        if (QMessageBox::question(this, title(),
+                                  tr("These alarms were changed both in %1 "
+                                     "and outside:\n\n%2\n\n"
+                                     "Keep the changes made in %1?")
+                                    .arg(title())
+                                    .arg(conflictNames.join("\n")),
+                                  QMessageBox::Yes | QMessageBox::No,
+                                  QMessageBox::Yes)
+                == QMessageBox::No)
+        {
+            foreach (const KAlarmItem &item, conflictItems)
+            {
+                if (_widgetMap.contains(item.id()))
+                    modifiedItems.append(item);
+                else
+                    addedItems.append(item);
+            }
+
+            removedWidgets += conflictRemovals;
+        }
+    }
+
+    QList<quint32> removedIds;
+    foreach (KAlarmItemWidget *w, removedWidgets)
+        removedIds.append(w->id());
+
+    if (!_daemonClient)
+        _alarmQueue->remove(removedIds);
+    removeItemWidgets(removedWidgets);
+
+    QList<KAlarmItemWidget *> changedWidgets;
+
+    foreach (const KAlarmItem &item, modifiedItems)
+    {
+        KAlarmItemWidget *w = _widgetMap.value(item.id());
+        QString oldGroup(w->group());
+
+        w->setItem(item);
+
+        if (w->group() != oldGroup)
+        {
+            leaveGroup(oldGroup);
+            joinGroup(w);
+        }
+
+        changedWidgets.append(w);
+    }
+
+    foreach (const KAlarmItem &item, addedItems)
+        changedWidgets.append(createItemWidget(item));
+
+    // States of groups are written at once, so never changed only here
+    QSet<QString> disabledGroups(groupSet(store->value("DisabledGroups")
+                                          .toStringList()));
+
+    foreach (const QString &group, disabledGroups + _disabledGroups)
+    {
+        bool enabled = !disabledGroups.contains(group);
+
+        if (enabled == !_disabledGroups.contains(group))
+            continue;
+
+        _alarmQueue->setGroupEnabled(group, enabled);
+
+        KAlarmGroupWidget *w = groupWidget(group);
+        if (w)
+            w->setGroupEnabled(enabled);
+    }
+
+    _disabledGroups = disabledGroups;
+
+    QHash<QString, QString> groupCalendars(
+                groupCalendarMap(store->value("GroupCalendars")
+                                 .toStringList()));
+
+    if (groupCalendars != _groupCalendars)
+    {
+        _groupCalendars = groupCalendars;
+        applyCalendars();
+    }
+
+    store.reset();
+
+    // Apply to a queue at once
+    commitItemWidgets(changedWidgets);
+
+    bool reloaded = !addedItems.isEmpty() || !modifiedItems.isEmpty()
+                        || !removedWidgets.isEmpty();
+
+    // Write a merged state back to a store, also to catch up with
+    // identifiers given to alarms added outside
+    if (reloaded || !conflictNames.isEmpty())
+        saveAlarmItems();
+    else
+    {
+        _storeItems = externalMap;
+        _storeDigest = digest;
+    }
+
+    if (reloaded)
+        _trayIcon->showMessage(title(),
+                               tr("Alarms changed outside were reloaded: "
+                                  "%1 added, %2 modified, %3 removed")
+                                 .arg(addedItems.size())
+                                 .arg(modifiedItems.size())
+                                 .arg(removedWidgets.size()));
+
+    _storeReloading = false;
+}
+
+void KAlarm::clearItemWidgets()
+{
+    _listWidget->setUpdatesEnabled(false);
+
+    foreach (KAlarmItemWidget *w, _widgetMap)
+    {
+        QListWidgetItem *item = _itemMap.value(w);
+
+        _resources.remove(w->id());
+        _searchIndex.remove(w);
+
+        _listWidget->removeItemWidget(item);
+
+        w->disconnect();
+
+        delete w;
+        delete item;
+    }
+
+    _itemMap.clear();
+    _widgetMap.clear();
+
+    foreach (QListWidgetItem *item, _groupItems)
+    {
+        QWidget *w = _listWidget->itemWidget(item);
+
+        _listWidget->removeItemWidget(item);
+
+        delete w;
+        delete item;
+    }
+
+    _groupItems.clear();
+    _disabledGroups.clear();
+    _collapsedGroups.clear();
+
+    _listWidget->setUpdatesEnabled(true);
+}
+
+void KAlarm::updateWindowTitle()
+{
+    if (_profile.isEmpty())
+        setWindowTitle(title());
+    else
+        setWindowTitle(tr("%1 - %2").arg(title()).arg(_profile));
+}
+
+void KAlarm::profileMenuAboutToShow()
+{
+    qDeleteAll(_profileMenu->findChildren<QActionGroup *>());
+    _profileMenu->clear();
+
+    QSettings settings;
+    QStringList profiles(settings.value("Profiles").toStringList());
+
+    QActionGroup *group = new QActionGroup(_profileMenu);
+
+    QAction *action = _profileMenu->addAction(tr("&Default"));
+    action->setCheckable(true);
+    action->setChecked(_profile.isEmpty());
+    action->setData(QString());
+    group->addAction(action);
+
+    foreach (const QString &profile, profiles)
+    {
+        action = _profileMenu->addAction(profile);
+        action->setCheckable(true);
+        action->setChecked(profile == _profile);
+        action->setData(profile);
+        group->addAction(action);
+    }
+
+    _profileMenu->addSeparator();
+    _profileMenu->addAction(tr("&New profile..."), this, SLOT(newProfile()));
+    _profileMenu->addAction(tr("De&lete profile..."),
+                            this, SLOT(deleteProfile()))
+            ->setEnabled(!_profile.isEmpty());
+}
+
+void KAlarm::profileTriggered(QAction *action)
+{
+    // Actions other than profiles have no data
+    if (!action->isCheckable())
+        return;
+
+    switchProfile(action->data().toString());
+}
+
+void KAlarm::newProfile()
+{
+    KAlarmActivityScope activity("KAlarm::newProfile(), input dialog");
+
+    QString profile(QInputDialog::getText(this, title(),
+                                          tr("Name of a new profile:"))
+                    .trimmed());
+
+    if (profile.isEmpty())
+        return;
+
+    // A name is a part of a file name
+    if (!QRegExp("[\\w -]+").exactMatch(profile))
+    {
+        QMessageBox::warning(this, title(),
+                             tr("A name of a profile can contain only "
+                                "letters, digits, spaces, '-' and '_'."));
+        return;
+    }
+
+    QSettings settings;
+    QStringList profiles(settings.value("Profiles").toStringList());
+
+    if (!profiles.contains(profile))
+    {
+        profiles.append(profile);
+        settings.setValue("Profiles", profiles);
+    }
+
+    switchProfile(profile);
+}
+
+void KAlarm::deleteProfile()
+{
+    if (_profile.isEmpty())
+        return;
+
+    if (QMessageBox::question(this, title(),
+                              tr("Delete a profile %1 and its alarms?")
+                                .arg(_profile),
+                              QMessageBox::Yes | QMessageBox::No)
+            != QMessageBox::Yes)
+        return;
+
+    QString profile(_profile);
+
+    switchProfile(QString());
+
+    QSettings settings;
+    QStringList profiles(settings.value("Profiles").toStringList());
+
+    profiles.removeAll(profile);
+    settings.setValue("Profiles", profiles);
+
+    QFile::remove(profileFile(profile, "ini"));
+    QFile::remove(profileFile(profile, "journal"));
+    QFile::remove(profileFile(profile, "next"));
+    QFile::remove(profileFile(profile, "history"));
+    QFile::remove(profileFile(profile, "history") + ".1");
+}
+
+void KAlarm::showStatistics()
+{
+    if (!_statsDialog)
+    {
+        _statsDialog = new KAlarmStatsDialog(this);
+
+        connect(_statsDialog, SIGNAL(refreshRequested()),
+                this, SLOT(refreshStatistics()));
+    }
+
+    refreshStatistics();
+
+    _statsDialog->show();
+    _statsDialog->activateWindow();
+    _statsDialog->raise();
+}
+
+void KAlarm::refreshStatistics()
+{
+    if (!_statsDialog)
+        return;
+
+    QString text;
+
+    text.append(tr("[Scheduler]")).append("\n");
+    text.append(_alarmQueue->summary());
+    text.append("\n");
+    text.append(tr("[Event loop watchdog]")).append("\n");
+    text.append(_watchdog->summary());
+    text.append("\n");
+    text.append(tr("[Alarm dispatch]")).append("\n");
+    text.append(_alarmQueue->dispatcher()->summary());
+    text.append("\n");
+    text.append(tr("[Presentation]")).append("\n");
+    text.append(_notifier.summary());
+    text.append("\n");
+    text.append(tr("[Persistence]")).append("\n");
+    text.append(_journal.summary());
+    text.append(_history.summary());
+
+    _statsDialog->setText(text);
+}
+
+void KAlarm::collectMetrics(QTextStream *out)
+{
+    static const char *const typeLabels[] = {
+        "interval", "weekly", "single_shot"
+    };
+
+    enum { TypeCount = KAlarmItem::SingleShotAlarm + 1 };
+
+    int counts[TypeCount][2] = {{0, 0}, {0, 0}, {0, 0}};
+
+    foreach (const KAlarmItemWidget *w, _widgetMap)
+    {
+        int type = qBound(0, static_cast<int>(w->item().alarmType()),
+                          TypeCount - 1);
+
+        ++counts[type][w->isAlarmEnabled() ? 1 : 0];
+    }
+
+    KAlarmMetricsServer::writeHeader(*out, "kalarm_alarms", "gauge",
+                                     "Alarms by type and state.");
+    for (int type = 0; type < TypeCount; ++type)
+    {
+        *out << "kalarm_alarms{type=\"" << typeLabels[type]
+             << "\",state=\"enabled\"} " << counts[type][1] << "\n";
+        *out << "kalarm_alarms{type=\"" << typeLabels[type]
+             << "\",state=\"disabled\"} " << counts[type][0] << "\n";
+    }
+
+    _alarmQueue->writeMetrics(*out);
+    _alarmQueue->dispatcher()->writeMetrics(*out);
+    _journal.writeMetrics(*out);
+    _history.writeMetrics(*out);
+}
+
+void KAlarm::about()
+{
+    QMessageBox::about( this, tr("About %1").arg(title()), tr(
+"<h2>%1 %2</h2>"
+"<p>Copyright &copy; 2015 by %3 "
+"<a href=mailto:komh@chollian.net>&lt;komh@chollian.net&gt;</a>"
+"<p>%1 is a program to alarm one time, at regular intervals or weekly."
+"<p>If you want to promote to develop this program, then donate at the below "
+"web page, please."
+"<p align=center><a href=http://www.ecomstation.co.kr/komh/donate.html>"
+"http://www.ecomstation.co.kr/komh/donate.html</a>"
+"<p>This program comes with ABSOLUTELY NO WARRANTY. This is free software, "
+"and you are welcome to redistribute it under certain conditions. See "
+"<a href=http://www.gnu.org/licenses/gpl.html>the GPL v3 license</a> "
+"for details."
+                            ).arg(title()).arg(version()).arg(organization()));
+}
+
+void KAlarm::aboutQt()
+{
+    QMessageBox::aboutQt(this);
+}
+
+void KAlarm::openKAlarm()
+{
+    show();
+    activateWindow();
+    raise();
+}
+
+void KAlarm::trayIconMenuAboutToShow()
+{
+    if (_trayIconMenu->actions().isEmpty())
+    {
+        _trayIconMenu->addAction(tr("&Open %1...").arg(title()),
+                                 this, SLOT(openKAlarm()));
+        _trayIconMenu->addMenu(helpMenu());
+        _trayIconMenu->addSeparator();
+        _trayIconMenu->addAction(tr("E&xit"), qApp, SLOT(quit()));
+    }
+
+    // Next alarms are listed whenever a menu is shown
+    qDeleteAll(_trayAlarmActions);
+    _trayAlarmActions.clear();
+
+    QDateTime now(QDateTime::currentDateTime());
+    QAction *before = _trayIconMenu->actions().first();
+
+    typedef QPair<KAlarmItem, QDateTime> Alarm;
+    foreach (const Alarm &alarm, upcomingAlarms(_trayAlarmCount))
+    {
+        QString name(alarm.first.name());
+        QString time(alarm.second.toString(alarm.second.date() == now.date()
+                                           ? "HH:mm" : "ddd HH:mm"));
+
+        QAction *action = new QAction(tr("%1 %2 (%3)")
+                                        .arg(time)
+                                        .arg(name.replace('&', "&&"))
+                                        .arg(KAlarmItemWidget::countdownText(
+                                                 now, alarm.second)),
+                                      _trayIconMenu);
+        action->setEnabled(false);
+
+        _trayIconMenu->insertAction(before, action);
+        _trayAlarmActions.append(action);
+    }
+
+    if (!_trayAlarmActions.isEmpty())
+    {
+        QAction *separator = new QAction(_trayIconMenu);
+        separator->setSeparator(true);
+
+        _trayIconMenu->insertAction(before, separator);
+        _trayAlarmActions.append(separator);
+    }
+}
+
+static bool nextAlarmLessThan(const QPair<KAlarmItem, QDateTime> &a,
+                              const QPair<KAlarmItem, QDateTime> &b)
+{
+    return a.second < b.second;
+}
+
+QList<QPair<KAlarmItem, QDateTime> > KAlarm::upcomingAlarms(int count) const
+{
+    if (!_daemonClient)
+        return _alarmQueue->upcomingAlarms(count);
+
+    // Next alarm times sent by kalarmd are kept only by item widgets
+    QList<QPair<KAlarmItem, QDateTime> > list;
+
+    foreach (const KAlarmItemWidget *w, _widgetMap)
+    {
+        if (w->isAlarmEnabled() && w->nextAlarm().isValid()
+                && !_disabledGroups.contains(w->group()))
+            list.append(qMakePair(w->item(), w->nextAlarm()));
+    }
+
+    std::sort(list.begin(), list.end(), nextAlarmLessThan);
+
+    return list.mid(0, count);
+}
+
+void KAlarm::countdownTimerTimeout()
+{
+    QDateTime now(QDateTime::currentDateTime());
+
+    updateCountdowns();
+
+    // A tool tip of a tray icon shows the next alarm
+    QString toolTip(title());
+
+    QList<QPair<KAlarmItem, QDateTime> > alarms(upcomingAlarms(1));
+
+    if (!alarms.isEmpty())
+        toolTip.append("\n").append(
+                    tr("%1 %2").arg(alarms.first().first.name())
+                               .arg(KAlarmItemWidget::countdownText(
+                                        now, alarms.first().second)));
+
+    if (toolTip != _trayToolTip)
+    {
+        _trayToolTip = toolTip;
+        _trayIcon->setToolTip(toolTip);
+    }
+
+    _countdownTimer->start(60000 - now.time().second() * 1000
+                           - now.time().msec() + 100);
+}
+
+void KAlarm::updateCountdowns()
+{
+    // Only rows in a viewport of a shown window are updated
+    if (!isVisible() || isMinimized())
+        return;
+
+    QDateTime now(QDateTime::currentDateTime());
+    QModelIndex top(_listWidget->indexAt(QPoint(0, 0)));
+    int height = _listWidget->viewport()->height();
+
+    for (int row = top.isValid() ? top.row() : 0;
+         row < _listWidget->count(); ++row)
+    {
+        QListWidgetItem *item = _listWidget->item(row);
+
+        if (item->isHidden())
+            continue;
+
+        QRect rect(_listWidget->visualItemRect(item));
+
+        if (rect.bottom() < 0)
+            continue;
+
+        if (rect.top() >= height)
+            break;
+
+        // Group headers have no countdown
+        KAlarmItemWidget *w = qobject_cast<KAlarmItemWidget *>
+                                (_listWidget->itemWidget(item));
+
+        if (w)
+            w->updateCountdown(_disabledGroups.contains(w->group())
+                               ? QDateTime() : now);
+    }
 }
 
 void KAlarm::trayIconActivated(QSystemTrayIcon::ActivationReason reason)
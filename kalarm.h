@@ -34,6 +34,17 @@
 #endif
 
 #include "kalarmqueue.h"
+#include "kalarmnotifier.h"
+#include "kalarmsearchindex.h"
+#include "kalarmwatchdog.h"
+#include "kalarmstatsdialog.h"
+#include "kalarmresourceregistry.h"
+#include "kalarmjournal.h"
+#include "kalarmhistory.h"
+#include "kalarmmetricsserver.h"
+#include "kalarmgroupwidget.h"
+#include "kalarmcalendar.h"
+#include "kalarmdaemonclient.h"
 
 namespace Ui {
 class KAlarm;
@@ -51,6 +62,8 @@ public:
     static QString title() { return tr("K Alarm"); }
     static QString version() { return tr("1.0.0"); }
 
+    void setVisible(bool visible);
+
 protected:
     bool event(QEvent *e);
     void closeEvent(QCloseEvent *e);
@@ -58,33 +71,195 @@ protected:
 private:
     Ui::KAlarm *ui;
 
+    QLineEdit *_filterLine;
     QListWidget *_listWidget;
-    KAlarmQueue _alarmQueue;
+    QHash<const KAlarmItemWidget *, QListWidgetItem *> _itemMap;
+    QHash<quint32, KAlarmItemWidget *> _widgetMap;
+
+    // Headers of groups, and states of groups saved with alarms
+    QHash<QString, QListWidgetItem *> _groupItems;
+    QSet<QString> _disabledGroups;
+    QSet<QString> _collapsedGroups;
+
+    // Calendars of excluded days are shared by profiles, and calendars of
+    // groups are saved with alarms
+    QList<KAlarmCalendar> _calendars;
+    QHash<QString, QString> _groupCalendars;
+
+    QThread _schedulerThread;
+    KAlarmQueue *_alarmQueue;
+    KAlarmNotifier _notifier;
+
+    // Set if alarms are scheduled by kalarmd. Then a queue only keeps next
+    // alarm times for a list and a tray icon, and is not started.
+    KAlarmDaemonClient *_daemonClient;
+
+    QThread _watchdogThread;
+    KAlarmWatchdog *_watchdog;
+
+    KAlarmStatsDialog *_statsDialog;
+    KAlarmSearchIndex _searchIndex;
+    KAlarmResourceRegistry _resources;
+
+    QString _profile;   // empty for the default profile
+
+    // Alarms in a store when it was read or written last, to tell changes
+    // made outside from ones made here
+    QHash<quint32, KAlarmItem> _storeItems;
+    QByteArray _storeDigest;
+    QFileSystemWatcher *_storeWatcher;
+    QTimer *_storeReloadTimer;
+    bool _storeReloading;
+
+    KAlarmJournal _journal;
+    QTimer *_snapshotTimer;
+
+    KAlarmHistory _history;
+
+    KAlarmMetricsServer *_metricsServer;
+
+    bool _mainWindowReady;
+    bool _showKAlarmAtStartup;
+
+    enum KSortOrder
+    {
+        NoSort = 0,
+        SortByNextAlarm,
+        SortByName,
+        SortByType
+    };
+
+    KSortOrder _sortOrder;
 
     QMenu *_fileMenu;
+    QMenu *_profileMenu;
+    QMenu *_calendarMenu;
+    QMenu *_editMenu;
     QMenu *_viewMenu;
     QAction *_showKAlarmAction;
+    QActionGroup *_sortOrderGroup;
     QMenu *_helpMenu;
 
     QMenu *_trayIconMenu;
     QSystemTrayIcon *_trayIcon;
+    QString _trayToolTip;
+    QList<QAction *> _trayAlarmActions;
+    int _trayAlarmCount;
+
+    // Countdowns, a tool tip of a tray icon included, are updated together
+    QTimer *_countdownTimer;
+
+    void setupMainWindow();
+    QMenu *helpMenu();
+
+    void filterItem(const KAlarmItemWidget *w);
+
+    void updateSortKey(const KAlarmItemWidget *w);
+
+    /*
+     * Return at most count alarms to be alarmed next, in order, with their
+     * next alarm times, of a queue or of kalarmd
+     */
+    QList<QPair<KAlarmItem, QDateTime> > upcomingAlarms(int count) const;
+    void setSortOrder(KSortOrder sortOrder);
+
+    void snapshotIfNeeded();
+
+    /* Alarms of profile are stored in a separate file */
+    static QSettings *createProfileStore(const QString &profile);
+    static QString profileFile(const QString &profile, const QString &ext);
+
+    void switchProfile(const QString &profile);
+    void clearItemWidgets();
+
+    QString storeFileName() const;
+    QByteArray storeDigest() const;
+    void watchStore();
+    static QByteArray itemData(const KAlarmItem &item);
+
+    /* Not queued nor journaled */
+    KAlarmItemWidget *createItemWidget(const KAlarmItem &alarmItem);
+    void removeItemWidgets(const QList<KAlarmItemWidget *> &widgets);
+
+    /* Should be called after a list item of w is mapped */
+    void joinGroup(const KAlarmItemWidget *w);
+    void leaveGroup(const QString &group);
+    KAlarmGroupWidget *groupWidget(const QString &group) const;
+    void saveGroupStates();
+
+    QStringList calendarNames() const;
+    void loadCalendars();
+    void saveCalendars() const;
+    void applyCalendars();
+
+    /* Calendars of groups are stored as pairs of a group and a calendar */
+    static QStringList groupCalendarPairs(const QHash<QString, QString> &map);
+    static QHash<QString, QString> groupCalendarMap(const QStringList &pairs);
+    static QSet<QString> groupSet(const QStringList &groups);
+    void updateWindowTitle();
+
+    QList<KAlarmItemWidget *> selectedItemWidgets() const;
+    void commitItemWidgets(const QList<KAlarmItemWidget *> &widgets);
+
+    bool connectDaemon(const QString &name);
+    void startScheduler();
 
 private slots:
     void addItem();
     void modifyItem(const QModelIndex &index = QModelIndex());
     void deleteItem();
 
+    void enableSelected();
+    void disableSelected();
+    void retimeSelected();
+    void changeSoundOfSelected();
+    void changeProgramOfSelected();
+    void moveSelectedToGroup();
+    void showHistory();
+
+    void importCalendar();
+    void removeCalendar();
+    void setGroupCalendar();
+
     void itemWidgetAlarmEnabledToggled(bool enabled);
+    void groupEnabledToggled(bool enabled);
+    void groupExpandedToggled(bool expanded);
+
+    void resourceWarningChanged(quint32 id, const QString &warning);
+
+    void filterTextChanged(const QString &text);
 
-    void showKAlarmTriggered(bool checked) const;
+    void alarmScheduled(quint32 id, const QDateTime &dt);
+    void alarmDisabled(quint32 id);
+    void daemonDisconnected();
+    void sortOrderTriggered(QAction *action);
 
-    void saveAlarmItems() const;
+    void profileMenuAboutToShow();
+    void profileTriggered(QAction *action);
+    void newProfile();
+    void deleteProfile();
+
+    void showStatistics();
+    void refreshStatistics();
+    void collectMetrics(QTextStream *out);
+
+    void showKAlarmTriggered(bool checked);
+
+    void saveAlarmItems();
     void loadAlarmItems();
+    void snapshotTimerTimeout();
+    void storeFileChanged();
+    void storeDirectoryChanged();
+    void reloadStore();
 
     void about();
     void aboutQt();
 
     void openKAlarm();
+    void trayIconMenuAboutToShow();
+
+    void countdownTimerTimeout();
+    void updateCountdowns();
     void trayIconActivated(QSystemTrayIcon::ActivationReason reason);
 };
 
@@ -0,0 +1,459 @@
+/****************************************************************************
+**
+** KAlarmAudioEngine, mixes alarm sounds into one output stream
+**
+** Copyright (C) 2015 by KO Myung-Hun
+** All rights reserved.
+** Contact: KO Myung-Hun (komh@chollian.net)
+**
+** This file is part of K Alarm.
+**
+** $BEGIN_LICENSE$
+**
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** $END_LICENSE$
+**
+****************************************************************************/
+
+#include "kalarmaudioengine.h"
+
+#include <QAudioDeviceInfo>
+#include <QFile>
+#include <QtEndian>
+
+#include <cstring>
+
+// WAVE format tags
+enum
+{
+    WaveFormatPcm = 0x0001,
+    WaveFormatFloat = 0x0003,
+    WaveFormatExtensible = 0xFFFE
+};
+
+// Gain of ducked voices in 1/256
+static const int duckGain = 96;
+
+/* Decode a PCM or floating point WAV file to floats in [-1, 1] */
+static bool decodeWave(const QByteArray &data, QVector<float> *samples,
+                       int *channels, int *sampleRate)
+{
+    const uchar *p = reinterpret_cast<const uchar *>(data.constData());
+    int size = data.size();
+
+    if (size < 12 || memcmp(p, "RIFF", 4) || memcmp(p + 8, "WAVE", 4))
+        return false;
+
+    int formatTag = 0;
+    int bits = 0;
+    const uchar *wave = 0;
+    int waveSize = 0;
+
+    *channels = 0;
+    *sampleRate = 0;
+
+    for (int pos = 12; pos + 8 <= size;)
+    {
+        const uchar *chunk = p + pos;
+        int chunkSize = qMin<qint64>(qFromLittleEndian<quint32>(chunk + 4),
+                                     size - pos - 8);
+
+        if (!memcmp(chunk, "fmt ", 4) && chunkSize >= 16)
+        {
+            formatTag = qFromLittleEndian<quint16>(chunk + 8);
+            *channels = qFromLittleEndian<quint16>(chunk + 10);
+            *sampleRate = qFromLittleEndian<quint32>(chunk + 12);
+            bits = qFromLittleEndian<quint16>(chunk + 22);
+
+            // A sub-format follows a cbSize, valid bits and a channel mask
+            if (formatTag == WaveFormatExtensible && chunkSize >= 26)
+                formatTag = qFromLittleEndian<quint16>(chunk + 32);
+        }
+        else if (!memcmp(chunk, "data", 4))
+        {
+            wave = chunk + 8;
+            waveSize = chunkSize;
+        }
+
+        // Chunks are aligned on a word boundary
+        pos += 8 + chunkSize + (chunkSize & 1);
+    }
+
+    if (!wave || *channels <= 0 || *sampleRate <= 0)
+        return false;
+
+    if (!(formatTag == WaveFormatPcm
+          && (bits == 8 || bits == 16 || bits == 24 || bits == 32))
+            && !(formatTag == WaveFormatFloat && bits == 32))
+        return false;
+
+    int bytes = bits / 8;
+    int count = waveSize / bytes / *channels * *channels;
+
+    samples->resize(count);
+
+    for (int i = 0; i < count; ++i)
+    {
+        const uchar *s = wave + i * bytes;
+        float value;
+
+        if (formatTag == WaveFormatFloat)
+        {
+            quint32 u = qFromLittleEndian<quint32>(s);
+
+            memcpy(&value, &u, sizeof(value));
+        }
+        else if (bits == 8)
+            value = (s[0] - 128) / 128.0f;
+        else if (bits == 16)
+            value = qFromLittleEndian<qint16>(s) / 32768.0f;
+        else if (bits == 24)
+            value = static_cast<qint32>((quint32(s[0]) << 8)
+                                        | (quint32(s[1]) << 16)
+                                        | (quint32(s[2]) << 24))
+                    / 2147483648.0f;
+        else
+            value = qFromLittleEndian<qint32>(s) / 2147483648.0f;
+
+        (*samples)[i] = qBound(-1.0f, value, 1.0f);
+    }
+
+    return count > 0;
+}
+
+KAlarmAudioEngine::KAlarmAudioEngine(QObject *parent)
+    : QIODevice(parent)
+    , _output(0)
+    , _maxVoices(4)
+    , _lastHandle(0)
+    , _lastOrder(0)
+{
+    QAudioFormat format;
+    format.setSampleRate(44100);
+    format.setChannelCount(2);
+    format.setSampleSize(16);
+    format.setCodec("audio/pcm");
+    format.setByteOrder(QAudioFormat::LittleEndian);
+    format.setSampleType(QAudioFormat::SignedInt);
+
+    QAudioDeviceInfo info(QAudioDeviceInfo::defaultOutputDevice());
+
+    if (!info.isFormatSupported(format))
+        format = info.nearestFormat(format);
+
+    // Only a sample rate and a channel count may differ
+    if (format.sampleSize() == 16
+            && format.sampleType() == QAudioFormat::SignedInt
+            && format.byteOrder() == QAudioFormat::LittleEndian
+            && format.channelCount() > 0)
+    {
+        _format = format;
+        _output = new QAudioOutput(info, _format, this);
+    }
+    else
+        qWarning("KAlarmAudioEngine: No supported audio output format");
+
+    open(QIODevice::ReadOnly);
+}
+
+KAlarmAudioEngine::~KAlarmAudioEngine()
+{
+    if (_output)
+        _output->stop();
+
+    close();
+}
+
+void KAlarmAudioEngine::setMaxVoices(int count)
+{
+    _maxVoices = qMax(count, 1);
+
+    updateVoices();
+}
+
+int KAlarmAudioEngine::play(const QString &file, int priority)
+{
+    if (!_output || !loadSample(file))
+        return 0;
+
+    int handle = ++_lastHandle;
+
+    _handleFiles.insert(handle, file);
+
+    // Merge into a voice of the same file
+    for (int i = 0; i < _voices.size(); ++i)
+    {
+        Voice &voice = _voices[i];
+
+        if (voice.file == file)
+        {
+            // A sample is referenced once per a voice
+            releaseSample(file);
+
+            voice.priorities.insert(handle, priority);
+            voice.priority = qMax(voice.priority, priority);
+            voice.order = ++_lastOrder;
+
+            updateVoices();
+
+            return handle;
+        }
+    }
+
+    Voice voice;
+    voice.file = file;
+    voice.priorities.insert(handle, priority);
+    voice.priority = priority;
+    voice.order = ++_lastOrder;
+    voice.position = 0;
+    voice.audible = false;
+
+    _voices.append(voice);
+
+    updateVoices();
+
+    return handle;
+}
+
+void KAlarmAudioEngine::stop(int handle)
+{
+    QString file(_handleFiles.take(handle));
+
+    if (file.isEmpty())
+        return;
+
+    for (int i = 0; i < _voices.size(); ++i)
+    {
+        Voice &voice = _voices[i];
+
+        if (voice.file != file)
+            continue;
+
+        voice.priorities.remove(handle);
+
+        if (voice.priorities.isEmpty())
+        {
+            _voices.removeAt(i);
+
+            releaseSample(file);
+        }
+        else
+        {
+            voice.priority = 0;
+            foreach (int priority, voice.priorities)
+                voice.priority = qMax(voice.priority, priority);
+        }
+
+        break;
+    }
+
+    updateVoices();
+}
+
+bool KAlarmAudioEngine::preload(const QString &file)
+{
+    return _output && loadSample(file);
+}
+
+void KAlarmAudioEngine::unload(const QString &file)
+{
+    releaseSample(file);
+}
+
+bool KAlarmAudioEngine::isSequential() const
+{
+    return true;
+}
+
+qint64 KAlarmAudioEngine::readData(char *data, qint64 maxSize)
+{
+    int channels = _format.channelCount();
+    int count = static_cast<int>(maxSize / sizeof(qint16))
+                / channels * channels;
+
+    if (_mixBuffer.size() < count)
+        _mixBuffer.resize(count);
+
+    qint32 *mix = _mixBuffer.data();
+
+    memset(mix, 0, count * sizeof(qint32));
+
+    bool first = true;
+
+    // Audible voices are sorted in order of priority
+    for (int i = 0; i < _voices.size(); ++i)
+    {
+        Voice &voice = _voices[i];
+
+        if (!voice.audible)
+            continue;
+
+        const QVector<qint16> &frames = _samples.value(voice.file).frames;
+        const qint16 *src = frames.constData();
+        int length = frames.size();
+        int gain = first ? 256 : duckGain;
+        int pos = voice.position;
+
+        for (int j = 0; j < count; ++j)
+        {
+            mix[j] += src[pos] * gain;
+
+            if (++pos == length)
+                pos = 0;
+        }
+
+        voice.position = pos;
+        first = false;
+    }
+
+    qint16 *out = reinterpret_cast<qint16 *>(data);
+
+    for (int j = 0; j < count; ++j)
+        out[j] = static_cast<qint16>(qBound(-32768, mix[j] >> 8, 32767));
+
+    return count * sizeof(qint16);
+}
+
+qint64 KAlarmAudioEngine::writeData(const char *data, qint64 maxSize)
+{
+    Q_UNUSED(data);
+    Q_UNUSED(maxSize);
+
+    return 0;
+}
+
+bool KAlarmAudioEngine::loadSample(const QString &file)
+{
+    QHash<QString, Sample>::iterator it = _samples.find(file);
+
+    if (it != _samples.end())
+    {
+        ++it.value().refCount;
+
+        return true;
+    }
+
+    QFile wav(file);
+
+    if (!wav.open(QIODevice::ReadOnly))
+        return false;
+
+    QVector<float> samples;
+    int channels;
+    int sampleRate;
+
+    if (!decodeWave(wav.readAll(), &samples, &channels, &sampleRate))
+    {
+        qWarning("KAlarmAudioEngine: %s is not a playable WAV file",
+                 qPrintable(file));
+
+        return false;
+    }
+
+    // Convert to the output format with linear interpolation, so that
+    // sample is mixed without conversion
+    int outChannels = _format.channelCount();
+    int outRate = _format.sampleRate();
+    qint64 inFrames = samples.size() / channels;
+    int outFrames = qMax<qint64>(inFrames * outRate / sampleRate, 1);
+
+    Sample sample;
+    sample.refCount = 1;
+    sample.frames.resize(outFrames * outChannels);
+
+    for (int i = 0; i < outFrames; ++i)
+    {
+        double t = static_cast<double>(i) * sampleRate / outRate;
+        qint64 f0 = qMin<qint64>(static_cast<qint64>(t), inFrames - 1);
+        qint64 f1 = qMin<qint64>(f0 + 1, inFrames - 1);
+        float frac = static_cast<float>(t - f0);
+
+        for (int c = 0; c < outChannels; ++c)
+        {
+            float v0, v1;
+
+            if (outChannels == 1 && channels > 1)
+            {
+                // Down-mix to mono
+                v0 = v1 = 0;
+                for (int k = 0; k < channels; ++k)
+                {
+                    v0 += samples.at(f0 * channels + k);
+                    v1 += samples.at(f1 * channels + k);
+                }
+                v0 /= channels;
+                v1 /= channels;
+            }
+            else
+            {
+                int k = qMin(c, channels - 1);
+
+                v0 = samples.at(f0 * channels + k);
+                v1 = samples.at(f1 * channels + k);
+            }
+
+            float v = v0 + (v1 - v0) * frac;
+
+            sample.frames[i * outChannels + c] =
+                    static_cast<qint16>(qBound(-32768.0f, v * 32768.0f,
+                                               32767.0f));
+        }
+    }
+
+    _samples.insert(file, sample);
+
+    return true;
+}
+
+void KAlarmAudioEngine::releaseSample(const QString &file)
+{
+    QHash<QString, Sample>::iterator it = _samples.find(file);
+
+    if (it != _samples.end() && --it.value().refCount == 0)
+        _samples.erase(it);
+}
+
+/* Make voices of the highest priorities audible */
+void KAlarmAudioEngine::updateVoices()
+{
+    // Higher priorities first, and later ones first among the same ones
+    for (int i = 1; i < _voices.size(); ++i)
+    {
+        for (int j = i; j > 0; --j)
+        {
+            const Voice &a = _voices.at(j - 1);
+            const Voice &b = _voices.at(j);
+
+            if (a.priority > b.priority
+                    || (a.priority == b.priority && a.order > b.order))
+                break;
+
+            _voices.swap(j - 1, j);
+        }
+    }
+
+    for (int i = 0; i < _voices.size(); ++i)
+        _voices[i].audible = i < _maxVoices;
+
+    if (!_output)
+        return;
+
+    if (_voices.isEmpty())
+    {
+        // Do not pull silence
+        if (_output->state() != QAudio::SuspendedState
+                && _output->state() != QAudio::StoppedState)
+            _output->suspend();
+    }
+    else if (_output->state() == QAudio::SuspendedState)
+        _output->resume();
+    else if (_output->state() == QAudio::StoppedState)
+        _output->start(this);
+}
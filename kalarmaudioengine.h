@@ -0,0 +1,108 @@
+/****************************************************************************
+**
+** KAlarmAudioEngine, mixes alarm sounds into one output stream
+**
+** Copyright (C) 2015 by KO Myung-Hun
+** All rights reserved.
+** Contact: KO Myung-Hun (komh@chollian.net)
+**
+** This file is part of K Alarm.
+**
+** $BEGIN_LICENSE$
+**
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** $END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef KALARMAUDIOENGINE_H
+#define KALARMAUDIOENGINE_H
+
+#include <QIODevice>
+#include <QAudioFormat>
+#include <QAudioOutput>
+#include <QHash>
+#include <QList>
+#include <QVector>
+
+/*
+ * KAlarmAudioEngine mixes looping alarm sounds into one audio output
+ * stream pulled by QAudioOutput. Each sound file is decoded once, and
+ * alarms playing the same file are merged into one voice. At most
+ * maxVoices voices are audible. Voices of lower priorities are suspended,
+ * and resumed when audible voices are stopped. Voices other than the
+ * highest priority one are ducked.
+ *
+ * Sound files should be PCM or floating point WAV files.
+ */
+class KAlarmAudioEngine : public QIODevice
+{
+    Q_OBJECT
+public:
+    explicit KAlarmAudioEngine(QObject *parent = 0);
+    ~KAlarmAudioEngine();
+
+    void setMaxVoices(int count);
+
+    /*
+     * Loop file until stop() is called with a returned handle. Returns 0
+     * if file is not playable.
+     */
+    int play(const QString &file, int priority);
+    void stop(int handle);
+
+    /*
+     * Decode file ahead of play(), until unload() is called. Returns false
+     * if file is not playable.
+     */
+    bool preload(const QString &file);
+    void unload(const QString &file);
+
+    bool isSequential() const;
+
+protected:
+    qint64 readData(char *data, qint64 maxSize);
+    qint64 writeData(const char *data, qint64 maxSize);
+
+private:
+    /* Frames of the output format, interleaved */
+    struct Sample
+    {
+        QVector<qint16> frames;
+        int refCount;
+    };
+
+    struct Voice
+    {
+        QString file;
+        QHash<int, int> priorities; // priority of each handle
+        int priority;               // the highest one of handles
+        qint64 order;
+        int position;               // in samples of frames
+        bool audible;
+    };
+
+    QAudioFormat _format;
+    QAudioOutput *_output;
+    int _maxVoices;
+    int _lastHandle;
+    qint64 _lastOrder;
+
+    QHash<QString, Sample> _samples;
+    QList<Voice> _voices;
+    QHash<int, QString> _handleFiles;
+    QVector<qint32> _mixBuffer;
+
+    bool loadSample(const QString &file);
+    void releaseSample(const QString &file);
+    void updateVoices();
+};
+
+#endif // KALARMAUDIOENGINE_H
@@ -0,0 +1,532 @@
+/****************************************************************************
+**
+** KAlarmCalendar, a calendar of days excluded from alarms
+**
+** Copyright (C) 2015 by KO Myung-Hun
+** All rights reserved.
+** Contact: KO Myung-Hun (komh@chollian.net)
+**
+** This file is part of K Alarm.
+**
+** $BEGIN_LICENSE$
+**
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** $END_LICENSE$
+**
+****************************************************************************/
+
+#include "kalarmcalendar.h"
+
+#include <QFile>
+#include <QSettings>
+#include <QStringList>
+#include <QTextStream>
+#include <QDataStream>
+#include <QRegExp>
+
+#include <cstring>
+
+static int lowestBit(quint64 word)
+{
+#if defined(Q_CC_GNU)
+    return __builtin_ctzll(word);
+#else
+    int n = 0;
+
+    while (!(word & 1))
+    {
+        word >>= 1;
+        ++n;
+    }
+
+    return n;
+#endif
+}
+
+KAlarmCalendar::KAlarmCalendar()
+    : _mode(SkipMode)
+{
+}
+
+KAlarmCalendar::KAlarmCalendar(const QString &name, KMode mode)
+    : _name(name)
+    , _mode(mode)
+{
+}
+
+QString KAlarmCalendar::name() const
+{
+    return _name;
+}
+
+void KAlarmCalendar::setName(const QString &name)
+{
+    _name = name;
+}
+
+KAlarmCalendar::KMode KAlarmCalendar::mode() const
+{
+    return _mode;
+}
+
+void KAlarmCalendar::setMode(KMode mode)
+{
+    _mode = mode;
+}
+
+int KAlarmCalendar::count() const
+{
+    int n = 0;
+
+    foreach (const YearSet &set, _years)
+    {
+        for (int i = 0; i < WordCount; ++i)
+        {
+            for (quint64 word = set.words[i]; word; word &= word - 1)
+                ++n;
+        }
+    }
+
+    return n;
+}
+
+quint64 KAlarmCalendar::hash() const
+{
+    // FNV-1a over 64-bit values
+    quint64 h = Q_UINT64_C(14695981039346656037);
+
+    h = (h ^ static_cast<quint64>(_mode)) * Q_UINT64_C(1099511628211);
+
+    QMap<int, YearSet>::const_iterator it;
+    for (it = _years.constBegin(); it != _years.constEnd(); ++it)
+    {
+        h = (h ^ static_cast<quint64>(it.key())) * Q_UINT64_C(1099511628211);
+
+        for (int i = 0; i < WordCount; ++i)
+            h = (h ^ it.value().words[i]) * Q_UINT64_C(1099511628211);
+    }
+
+    return h;
+}
+
+bool KAlarmCalendar::isExcluded(const QDate &date) const
+{
+    QMap<int, YearSet>::const_iterator it = _years.constFind(date.year());
+
+    if (!date.isValid() || it == _years.constEnd())
+        return false;
+
+    int day = date.dayOfYear() - 1;
+
+    return (it.value().words[day / 64] >> (day % 64)) & 1;
+}
+
+void KAlarmCalendar::setExcluded(const QDate &date, bool excluded)
+{
+    if (!date.isValid())
+        return;
+
+    int day = date.dayOfYear() - 1;
+    quint64 bit = Q_UINT64_C(1) << (day % 64);
+
+    QMap<int, YearSet>::iterator it = _years.find(date.year());
+
+    if (excluded)
+    {
+        if (it == _years.end())
+        {
+            YearSet set;
+            memset(set.words, 0, sizeof(set.words));
+
+            it = _years.insert(date.year(), set);
+        }
+
+        it.value().words[day / 64] |= bit;
+    }
+    else if (it != _years.end())
+    {
+        it.value().words[day / 64] &= ~bit;
+
+        // Keep years with any excluded day only
+        bool empty = true;
+        for (int i = 0; i < WordCount; ++i)
+            empty = empty && !it.value().words[i];
+
+        if (empty)
+            _years.erase(it);
+    }
+}
+
+void KAlarmCalendar::setExcluded(const QDate &from, const QDate &to)
+{
+    if (!from.isValid() || !to.isValid())
+        return;
+
+    for (QDate date(from); date <= to; date = date.addDays(1))
+        setExcluded(date);
+}
+
+QDate KAlarmCalendar::nextIncluded(const QDate &date) const
+{
+    if (!date.isValid())
+        return QDate();
+
+    int last = qMax(date.year(),
+                    _years.isEmpty() ? date.year() : _years.lastKey()) + 1;
+    int from = date.dayOfYear() - 1;
+
+    for (int year = date.year(); year <= last; ++year, from = 0)
+    {
+        quint64 valid[WordCount];
+        quint64 words[WordCount];
+
+        validWords(year, valid);
+        yearWords(year, words);
+
+        for (int i = 0; i < WordCount; ++i)
+            words[i] = valid[i] & ~words[i];
+
+        QDate day(findFirst(year, words, from));
+        if (day.isValid())
+            return day;
+    }
+
+    return QDate();
+}
+
+QDate KAlarmCalendar::nextOccurrence(const QDate &date, int weekDays) const
+{
+    weekDays &= 0x7f;
+
+    if (!date.isValid() || !weekDays)
+        return QDate();
+
+    quint64 words[WordCount];
+    bool carry = false;
+
+    // Occurrences may be shifted across a new year
+    if (_mode == ShiftMode)
+        occurrenceWords(date.year() - 1, weekDays, &carry, words);
+
+    // Every week day falls in a year without excluded days
+    int last = qMax(date.year(),
+                    _years.isEmpty() ? date.year() : _years.lastKey()) + 1;
+    int from = date.dayOfYear() - 1;
+
+    for (int year = date.year(); year <= last; ++year, from = 0)
+    {
+        occurrenceWords(year, weekDays, &carry, words);
+
+        QDate day(findFirst(year, words, from));
+        if (day.isValid())
+            return day;
+    }
+
+    return QDate();
+}
+
+void KAlarmCalendar::yearWords(int year, quint64 *words) const
+{
+    QMap<int, YearSet>::const_iterator it = _years.constFind(year);
+
+    if (it == _years.constEnd())
+        memset(words, 0, WordCount * sizeof(quint64));
+    else
+        memcpy(words, it.value().words, WordCount * sizeof(quint64));
+}
+
+/*
+ * Set bits of days of year on which occurrences fall. carry is whether an
+ * occurrence is shifted from the previous year, and is set to whether one
+ * is shifted to the next year.
+ */
+void KAlarmCalendar::occurrenceWords(int year, int weekDays, bool *carry,
+                                     quint64 *words) const
+{
+    quint64 valid[WordCount];
+    quint64 allowed[WordCount];
+    quint64 excluded[WordCount];
+
+    validWords(year, valid);
+    weekDayWords(year, weekDays, allowed);
+    yearWords(year, excluded);
+
+    if (_mode == SkipMode)
+    {
+        for (int i = 0; i < WordCount; ++i)
+            words[i] = allowed[i] & ~excluded[i];
+
+        *carry = false;
+
+        return;
+    }
+
+    // Adding occurrences on excluded days to excluded days carries them
+    // through each run of excluded days to the day after it
+    int days = QDate(year, 1, 1).daysInYear();
+    quint64 c = *carry ? 1 : 0;
+
+    for (int i = 0; i < WordCount; ++i)
+    {
+        quint64 sum = excluded[i] + (allowed[i] & excluded[i]);
+        quint64 overflow = sum < excluded[i];
+
+        sum += c;
+        c = overflow | (sum < c);
+
+        quint64 shifted = sum & ~excluded[i];
+
+        // A carry out of the last day goes to the first day of next year
+        if (i == days / 64)
+            *carry = (shifted >> (days % 64)) & 1;
+
+        words[i] = (allowed[i] | shifted) & ~excluded[i] & valid[i];
+    }
+}
+
+void KAlarmCalendar::validWords(int year, quint64 *words)
+{
+    int days = QDate(year, 1, 1).daysInYear();
+
+    for (int i = 0; i < WordCount; ++i)
+    {
+        int bits = qBound(0, days - 64 * i, 64);
+
+        words[i] = bits == 64 ? ~Q_UINT64_C(0)
+                              : (Q_UINT64_C(1) << bits) - 1;
+    }
+}
+
+/* Set bits of days of year falling on weekDays, without a loop over days */
+void KAlarmCalendar::weekDayWords(int year, int weekDays, quint64 *words)
+{
+    quint64 valid[WordCount];
+
+    validWords(year, valid);
+
+    // Monday is 0
+    int firstDay = QDate(year, 1, 1).dayOfWeek() - 1;
+
+    for (int i = 0; i < WordCount; ++i)
+    {
+        // Rotate week days to a week day of the first bit of a word, and
+        // repeat a week over a word
+        int phase = (firstDay + 64 * i) % 7;
+        quint64 word = ((weekDays >> phase) | (weekDays << (7 - phase)))
+                            & 0x7f;
+
+        word |= word << 7;
+        word |= word << 14;
+        word |= word << 28;
+        word |= word << 56;
+
+        words[i] = word & valid[i];
+    }
+}
+
+/* Return the first day of set bits of words not before a day index */
+QDate KAlarmCalendar::findFirst(int year, const quint64 *words, int from)
+{
+    for (int i = from / 64; i < WordCount; ++i)
+    {
+        quint64 word = words[i];
+
+        if (i == from / 64)
+            word &= ~Q_UINT64_C(0) << (from % 64);
+
+        if (word)
+            return QDate(year, 1, 1).addDays(64 * i + lowestBit(word));
+    }
+
+    return QDate();
+}
+
+bool KAlarmCalendar::importFile(const QString &fileName, QString *error)
+{
+    QFile file(fileName);
+
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        *error = file.errorString();
+
+        return false;
+    }
+
+    QTextStream in(&file);
+
+    QString firstLine(in.readLine().trimmed());
+    in.seek(0);
+
+    if (firstLine.compare("BEGIN:VCALENDAR", Qt::CaseInsensitive) == 0)
+        return importICalendar(in, error);
+
+    return importDateList(in, error);
+}
+
+bool KAlarmCalendar::importICalendar(QTextStream &in, QString *error)
+{
+    // Unfold lines continued with a space or a tab
+    QStringList lines;
+
+    while (!in.atEnd())
+    {
+        QString line(in.readLine());
+
+        if ((line.startsWith(' ') || line.startsWith('\t'))
+                && !lines.isEmpty())
+            lines.last() += line.mid(1);
+        else
+            lines.append(line.trimmed());
+    }
+
+    bool inEvent = false;
+    QDate start;
+    QDate end;
+    int count = 0;
+
+    foreach (const QString &line, lines)
+    {
+        if (line.compare("BEGIN:VEVENT", Qt::CaseInsensitive) == 0)
+        {
+            inEvent = true;
+            start = end = QDate();
+        }
+        else if (line.compare("END:VEVENT", Qt::CaseInsensitive) == 0)
+        {
+            if (inEvent && start.isValid())
+            {
+                // An end date of an all-day event is exclusive
+                if (!end.isValid() || end <= start)
+                    end = start.addDays(1);
+
+                setExcluded(start, end.addDays(-1));
+                ++count;
+            }
+
+            inEvent = false;
+        }
+        else if (inEvent)
+        {
+            int colon = line.indexOf(':');
+            if (colon < 0)
+                continue;
+
+            // DTSTART;VALUE=DATE:20150101 or DTSTART:20150101T090000Z
+            QString property(line.left(colon).section(';', 0, 0).toUpper());
+            QDate date(QDate::fromString(line.mid(colon + 1).left(8),
+                                         "yyyyMMdd"));
+
+            if (property == "DTSTART")
+                start = date;
+            else if (property == "DTEND")
+                end = date;
+        }
+    }
+
+    if (count == 0)
+    {
+        *error = tr("No event found");
+
+        return false;
+    }
+
+    return true;
+}
+
+bool KAlarmCalendar::importDateList(QTextStream &in, QString *error)
+{
+    int lineNumber = 0;
+    int count = 0;
+
+    while (!in.atEnd())
+    {
+        QString line(in.readLine().trimmed());
+        ++lineNumber;
+
+        if (line.isEmpty() || line.startsWith('#'))
+            continue;
+
+        QStringList dates(line.split(QRegExp("\\s+")));
+        QDate from(QDate::fromString(dates.first(), Qt::ISODate));
+        QDate to(dates.size() > 1 ? QDate::fromString(dates.at(1),
+                                                      Qt::ISODate)
+                                  : from);
+
+        if (dates.size() > 2 || !from.isValid() || !to.isValid()
+                || to < from)
+        {
+            *error = tr("Invalid date at line %1").arg(lineNumber);
+
+            return false;
+        }
+
+        setExcluded(from, to);
+        ++count;
+    }
+
+    if (count == 0)
+    {
+        *error = tr("No date found");
+
+        return false;
+    }
+
+    return true;
+}
+
+void KAlarmCalendar::save(QSettings &settings) const
+{
+    QByteArray days;
+    QDataStream out(&days, QIODevice::WriteOnly);
+
+    QMap<int, YearSet>::const_iterator it;
+    for (it = _years.constBegin(); it != _years.constEnd(); ++it)
+    {
+        out << static_cast<qint32>(it.key());
+
+        for (int i = 0; i < WordCount; ++i)
+            out << it.value().words[i];
+    }
+
+    settings.beginGroup(_name);
+    settings.setValue("Mode", _mode);
+    settings.setValue("Days", days);
+    settings.endGroup();
+}
+
+void KAlarmCalendar::load(QSettings &settings, const QString &name)
+{
+    _name = name;
+    _years.clear();
+
+    settings.beginGroup(name);
+    _mode = static_cast<KMode>(settings.value("Mode", SkipMode).toInt());
+
+    QByteArray days(settings.value("Days").toByteArray());
+    settings.endGroup();
+
+    QDataStream in(days);
+
+    while (!in.atEnd())
+    {
+        qint32 year;
+        YearSet set;
+
+        in >> year;
+
+        for (int i = 0; i < WordCount; ++i)
+            in >> set.words[i];
+
+        if (in.status() != QDataStream::Ok)
+            break;
+
+        _years.insert(year, set);
+    }
+}
@@ -0,0 +1,119 @@
+/****************************************************************************
+**
+** KAlarmCalendar, a calendar of days excluded from alarms
+**
+** Copyright (C) 2015 by KO Myung-Hun
+** All rights reserved.
+** Contact: KO Myung-Hun (komh@chollian.net)
+**
+** This file is part of K Alarm.
+**
+** $BEGIN_LICENSE$
+**
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** $END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef KALARMCALENDAR_H
+#define KALARMCALENDAR_H
+
+#include <QCoreApplication>
+#include <QMap>
+#include <QString>
+#include <QDate>
+
+class QSettings;
+class QTextStream;
+
+/*
+ * KAlarmCalendar is a named set of days excluded from alarms, such as
+ * public holidays. Days of a year are kept in a 366-bit set, so that
+ * checking a day is a bit test, and the next day is found 64 days at a
+ * time.
+ */
+class KAlarmCalendar
+{
+    Q_DECLARE_TR_FUNCTIONS(KAlarmCalendar)
+
+public:
+    /* What happens to an occurrence on an excluded day */
+    enum KMode
+    {
+        SkipMode = 0,   // dropped
+        ShiftMode       // moved to the next day not excluded
+    };
+
+    KAlarmCalendar();
+    explicit KAlarmCalendar(const QString &name, KMode mode = SkipMode);
+
+    QString name() const;
+    void setName(const QString &name);
+
+    KMode mode() const;
+    void setMode(KMode mode);
+
+    /* The number of excluded days */
+    int count() const;
+
+    /* A hash of a mode and excluded days, which does not depend on a name */
+    quint64 hash() const;
+
+    bool isExcluded(const QDate &date) const;
+    void setExcluded(const QDate &date, bool excluded = true);
+
+    /* Exclude days from from to to, inclusive */
+    void setExcluded(const QDate &from, const QDate &to);
+
+    /* Return the first day not excluded, not before date */
+    QDate nextIncluded(const QDate &date) const;
+
+    /*
+     * Return the first day not before date on which an occurrence falls.
+     * Occurrences are on weekDays, a bit mask of KAlarmItem::KWeekDay, and
+     * are skipped or shifted on excluded days by a mode. Returns an invalid
+     * date if weekDays is empty.
+     */
+    QDate nextOccurrence(const QDate &date, int weekDays) const;
+
+    /*
+     * Add days of all-day events of an iCalendar file, or of a text file
+     * with a date or two dates of a range in yyyy-MM-dd per line
+     */
+    bool importFile(const QString &fileName, QString *error);
+
+    void save(QSettings &settings) const;
+    void load(QSettings &settings, const QString &name);
+
+private:
+    enum { WordCount = 6 };     // 384 bits for 366 days
+
+    struct YearSet
+    {
+        quint64 words[WordCount];
+    };
+
+    QString _name;
+    KMode _mode;
+    QMap<int, YearSet> _years;  // years with any excluded day
+
+    void yearWords(int year, quint64 *words) const;
+    void occurrenceWords(int year, int weekDays, bool *carry,
+                         quint64 *words) const;
+
+    static void validWords(int year, quint64 *words);
+    static void weekDayWords(int year, int weekDays, quint64 *words);
+    static QDate findFirst(int year, const quint64 *words, int from);
+
+    bool importICalendar(QTextStream &in, QString *error);
+    bool importDateList(QTextStream &in, QString *error);
+};
+
+#endif // KALARMCALENDAR_H
@@ -25,6 +25,8 @@
 #include "kalarmconfigdialog.h"
 
 #include "kalarm.h"
+#include "kalarmitem.h"
+#include "kalarmwatchdog.h"
 
 #ifdef CONFIG_QT5
 #include <QtWidgets>
@@ -112,6 +114,23 @@ KAlarmConfigDialog::KAlarmConfigDialog(QWidget *parent, Qt::WindowFlags f)
     _onAlarmGroup = new QGroupBox(tr("On alarm"));
     _onAlarmGroup->setLayout(onAlarmLayout);
 
+    // Items in order of KAlarmItem::KPriority
+    _priorityLabel = new QLabel(tr("Priority:"));
+    _priorityCombo = new QComboBox;
+    _priorityCombo->addItem(tr("Low"));
+    _priorityCombo->addItem(tr("Normal"));
+    _priorityCombo->addItem(tr("High"));
+    _priorityCombo->addItem(tr("Critical"));
+
+    _groupLabel = new QLabel(tr("Group:"));
+    _groupCombo = new QComboBox;
+    _groupCombo->setEditable(true);
+    _groupCombo->setInsertPolicy(QComboBox::NoInsert);
+
+    _calendarLabel = new QLabel(tr("Excluded days:"));
+    _calendarCombo = new QComboBox;
+    setCalendars(QStringList());
+
     QFormLayout *formLayout = new QFormLayout;
     formLayout->addRow(_nameLabel, _nameLine);
     formLayout->addRow(_startTimeLabel, _startTimeEdit);
@@ -119,6 +138,9 @@ KAlarmConfigDialog::KAlarmConfigDialog(QWidget *parent, Qt::WindowFlags f)
     formLayout->addRow(_intervalTimeLabel, _intervalTimeEdit);
     formLayout->addRow(_repeatTimeGroup);
     formLayout->addRow(_onAlarmGroup);
+    formLayout->addRow(_priorityLabel, _priorityCombo);
+    formLayout->addRow(_groupLabel, _groupCombo);
+    formLayout->addRow(_calendarLabel, _calendarCombo);
     formLayout->addRow(buttonLayout);
 
     // Disable resizing of a dialog
@@ -141,6 +163,7 @@ KAlarmConfigDialog::KAlarmConfigDialog(QWidget *parent, Qt::WindowFlags f)
     _execProgramNameBrowsePush->setEnabled(false);
     _execProgramParamsLabel->setEnabled(false);
     _execProgramParamsLabel->setEnabled(false);
+    _priorityCombo->setCurrentIndex(KAlarmItem::NormalPriority);
 
     // Connect signals
     connect(_useIntervalCheck, SIGNAL(stateChanged(int)),
@@ -361,6 +384,70 @@ void KAlarmConfigDialog::setExecProgramParams(const QString &params)
     _execProgramParamsLine->setText(params);
 }
 
+int KAlarmConfigDialog::priority() const
+{
+    return _priorityCombo->currentIndex();
+}
+
+void KAlarmConfigDialog::setPriority(int priority)
+{
+    _priorityCombo->setCurrentIndex(priority);
+}
+
+void KAlarmConfigDialog::setGroups(const QStringList &groups)
+{
+    QString current(group());
+
+    _groupCombo->clear();
+    _groupCombo->addItem(QString());
+    _groupCombo->addItems(groups);
+
+    setGroup(current);
+}
+
+QString KAlarmConfigDialog::group() const
+{
+    return _groupCombo->currentText().trimmed();
+}
+
+void KAlarmConfigDialog::setGroup(const QString &group)
+{
+    _groupCombo->setEditText(group);
+}
+
+void KAlarmConfigDialog::setCalendars(const QStringList &calendars)
+{
+    QString current(calendar());
+
+    _calendarCombo->clear();
+    _calendarCombo->addItem(tr("Calendar of a group"), QString());
+
+    foreach (const QString &name, calendars)
+        _calendarCombo->addItem(name, name);
+
+    setCalendar(current);
+}
+
+QString KAlarmConfigDialog::calendar() const
+{
+    return _calendarCombo->itemData(_calendarCombo->currentIndex())
+                .toString();
+}
+
+void KAlarmConfigDialog::setCalendar(const QString &calendar)
+{
+    int index = _calendarCombo->findData(calendar);
+
+    // Keep a calendar removed after being chosen
+    if (index < 0)
+    {
+        _calendarCombo->addItem(calendar, calendar);
+        index = _calendarCombo->count() - 1;
+    }
+
+    _calendarCombo->setCurrentIndex(index);
+}
+
 void KAlarmConfigDialog::useIntervalStateChanged(int state)
 {
     if (state == Qt::Checked)
@@ -410,6 +497,8 @@ public:
 
 void KAlarmConfigDialog::playClicked()
 {
+    KAlarmActivityScope activity("KAlarmConfigDialog::playClicked()");
+
     static QString playingMsg(tr("Playing sound..."));
 
 #ifdef CONFIG_QT5
@@ -465,6 +554,9 @@ void KAlarmConfigDialog::playClicked()
 
 void KAlarmConfigDialog::browseClicked()
 {
+    KAlarmActivityScope activity("KAlarmConfigDialog::browseClicked(), "
+                                 "file dialog");
+
     QStringList filters;
     filters << tr("WAV files (*.wav)");
     filters << tr("All files (*)");
@@ -497,6 +589,10 @@ void KAlarmConfigDialog::execProgramStateChanged(int state)
 
 void KAlarmConfigDialog::execProgramNameBrowseClicked()
 {
+    KAlarmActivityScope activity(
+                "KAlarmConfigDialog::execProgramNameBrowseClicked(), "
+                "file dialog");
+
     QStringList filters;
     filters << tr("Executable files (*.exe; *.cmd; *.btm; *.com; *.bat)");
     filters << tr("All files (*)");
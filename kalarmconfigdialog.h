@@ -94,6 +94,20 @@ public:
     QString execProgramParams() const;
     void setExecProgramParams(const QString &params);
 
+    /* KAlarmItem::KPriority */
+    int priority() const;
+    void setPriority(int priority);
+
+    /* groups are offered in a list, and a new group can be entered */
+    void setGroups(const QStringList &groups);
+    QString group() const;
+    void setGroup(const QString &group);
+
+    /* An empty calendar uses a calendar of a group */
+    void setCalendars(const QStringList &calendars);
+    QString calendar() const;
+    void setCalendar(const QString &calendar);
+
 private:
     QLabel      *_nameLabel;
     QLineEdit   *_nameLine;
@@ -121,6 +135,12 @@ private:
     QLabel      *_execProgramParamsLabel;
     QLineEdit   *_execProgramParamsLine;
     QGroupBox   *_onAlarmGroup;
+    QLabel      *_priorityLabel;
+    QComboBox   *_priorityCombo;
+    QLabel      *_groupLabel;
+    QComboBox   *_groupCombo;
+    QLabel      *_calendarLabel;
+    QComboBox   *_calendarCombo;
 
 private slots:
     void useIntervalStateChanged(int state);
@@ -0,0 +1,203 @@
+/****************************************************************************
+**
+** KAlarmDaemonClient, receives alarms from kalarmd
+**
+** Copyright (C) 2015 by KO Myung-Hun
+** All rights reserved.
+** Contact: KO Myung-Hun (komh@chollian.net)
+**
+** This file is part of K Alarm.
+**
+** $BEGIN_LICENSE$
+**
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** $END_LICENSE$
+**
+****************************************************************************/
+
+
+#include "kalarmdaemonclient.h"
+#include "kalarmdaemonprotocol.h"
+
+#include <QDataStream>
+#include <QProcessEnvironment>
+
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#endif
+
+KAlarmDaemonClient::KAlarmDaemonClient(QObject *parent)
+    : QObject(parent)
+{
+    connect(&_socket, SIGNAL(readyRead()), this, SLOT(socketReadyRead()));
+    connect(&_socket, SIGNAL(disconnected()), this, SIGNAL(disconnected()));
+}
+
+KAlarmDaemonClient::~KAlarmDaemonClient()
+{
+    // Do not report a connection closed on exit as lost
+    disconnect(&_socket, SIGNAL(disconnected()), this, SIGNAL(disconnected()));
+}
+
+bool KAlarmDaemonClient::connectToDaemon(const QString &name, int msecs)
+{
+    _socket.connectToServer(name);
+
+    if (!_socket.waitForConnected(msecs))
+    {
+        qWarning("KAlarmDaemonClient: Cannot connect to %s: %s",
+                 qPrintable(name), qPrintable(_socket.errorString()));
+
+        return false;
+    }
+
+    // Only kalarmd of root or of this user is trusted with a session and
+    // alarms, not a socket of another user
+    bool trusted = false;
+
+#ifdef Q_OS_UNIX
+    uint uid;
+
+    if (KAlarmDaemonProtocol::peerUid(&_socket, &uid))
+        trusted = uid == 0 || uid == ::getuid();
+#endif
+
+    if (!trusted)
+    {
+        qWarning("KAlarmDaemonClient: %s is not served by root or this user",
+                 qPrintable(name));
+
+        _socket.abort();
+
+        return false;
+    }
+
+    // Programs executed by kalarmd can reach this session
+    sendEnvironment();
+
+    return true;
+}
+
+void KAlarmDaemonClient::refresh()
+{
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_4_6);
+
+    out << static_cast<quint8>(KAlarmDaemonProtocol::RefreshMessage);
+
+    send(payload);
+}
+
+void KAlarmDaemonClient::presented(quint32 id)
+{
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_4_6);
+
+    out << static_cast<quint8>(KAlarmDaemonProtocol::PresentedMessage) << id;
+
+    send(payload);
+}
+
+void KAlarmDaemonClient::sendEnvironment()
+{
+    QProcessEnvironment system(QProcessEnvironment::systemEnvironment());
+    QStringList environment;
+
+    foreach (const QString &name, KAlarmDaemonProtocol::sessionVariables())
+    {
+        if (system.contains(name))
+            environment.append(name + "=" + system.value(name));
+    }
+
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_4_6);
+
+    out << static_cast<quint8>(KAlarmDaemonProtocol::EnvironmentMessage)
+        << environment;
+
+    send(payload);
+}
+
+void KAlarmDaemonClient::send(const QByteArray &payload)
+{
+    if (_socket.state() != QLocalSocket::ConnectedState)
+        return;
+
+    _socket.write(KAlarmDaemonProtocol::frame(payload));
+}
+
+void KAlarmDaemonClient::receive(const QByteArray &payload)
+{
+    QDataStream in(payload);
+    in.setVersion(QDataStream::Qt_4_6);
+
+    quint8 message;
+    in >> message;
+
+    KAlarmItem item;
+    quint32 id;
+    QDateTime dt;
+
+    switch (message)
+    {
+    case KAlarmDaemonProtocol::WarmUpMessage:
+    case KAlarmDaemonProtocol::TriggeredMessage:
+        in >> item >> dt;
+
+        if (in.status() != QDataStream::Ok)
+            break;
+
+        if (message == KAlarmDaemonProtocol::WarmUpMessage)
+            emit alarmWarmUp(item, dt);
+        else
+            emit alarmTriggered(item, dt);
+        break;
+
+    case KAlarmDaemonProtocol::ScheduledMessage:
+        in >> id >> dt;
+
+        if (in.status() == QDataStream::Ok)
+            emit alarmScheduled(id, dt);
+        break;
+
+    case KAlarmDaemonProtocol::DisabledMessage:
+        in >> id;
+
+        if (in.status() == QDataStream::Ok)
+            emit alarmDisabled(id);
+        break;
+
+    default:
+        // Newer messages are ignored
+        break;
+    }
+}
+
+void KAlarmDaemonClient::socketReadyRead()
+{
+    _buffer.append(_socket.readAll());
+
+    QByteArray payload;
+    bool invalid;
+
+    while (KAlarmDaemonProtocol::takeFrame(&_buffer, &payload, &invalid))
+        receive(payload);
+
+    if (invalid)
+    {
+        qWarning("KAlarmDaemonClient: Invalid frame from kalarmd");
+
+        _buffer.clear();
+        _socket.abort();
+    }
+}
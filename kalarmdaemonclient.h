@@ -0,0 +1,81 @@
+/****************************************************************************
+**
+** KAlarmDaemonClient, receives alarms from kalarmd
+**
+** Copyright (C) 2015 by KO Myung-Hun
+** All rights reserved.
+** Contact: KO Myung-Hun (komh@chollian.net)
+**
+** This file is part of K Alarm.
+**
+** $BEGIN_LICENSE$
+**
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** $END_LICENSE$
+**
+****************************************************************************/
+
+
+#ifndef KALARMDAEMONCLIENT_H
+#define KALARMDAEMONCLIENT_H
+
+#include <QObject>
+#include <QLocalSocket>
+#include <QByteArray>
+#include <QDateTime>
+
+#include "kalarmitem.h"
+
+/*
+ * KAlarmDaemonClient lives in a GUI thread of K Alarm when alarms of a
+ * user are scheduled by kalarmd. Signals are the same as ones of
+ * KAlarmQueue, so that alarms are presented in the same way. kalarmd reads
+ * alarms from settings and a journal by itself, so changes are not sent.
+ * Next alarm times are the ones of kalarmd, and not computed by K Alarm.
+ */
+class KAlarmDaemonClient : public QObject
+{
+    Q_OBJECT
+public:
+    explicit KAlarmDaemonClient(QObject *parent = 0);
+    ~KAlarmDaemonClient();
+
+    /* Connect to kalarmd listening on name, waiting at most msecs */
+    bool connectToDaemon(const QString &name, int msecs = 1000);
+
+    /* Ask for next alarm times of all the alarms, after loading alarms */
+    void refresh();
+
+public slots:
+    /* Should be called when an alarm of id has been presented */
+    void presented(quint32 id);
+
+signals:
+    void alarmScheduled(quint32 id, const QDateTime &dt);
+    void alarmTriggered(const KAlarmItem &item, const QDateTime &dt);
+    void alarmWarmUp(const KAlarmItem &item, const QDateTime &dt);
+    void alarmDisabled(quint32 id);
+
+    /* Emitted when a connection to kalarmd is lost */
+    void disconnected();
+
+private:
+    QLocalSocket _socket;
+    QByteArray _buffer;
+
+    void send(const QByteArray &payload);
+    void sendEnvironment();
+    void receive(const QByteArray &payload);
+
+private slots:
+    void socketReadyRead();
+};
+
+#endif // KALARMDAEMONCLIENT_H
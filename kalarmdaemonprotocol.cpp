@@ -0,0 +1,116 @@
+/****************************************************************************
+**
+** KAlarmDaemonProtocol, messages between kalarmd and K Alarm
+**
+** Copyright (C) 2015 by KO Myung-Hun
+** All rights reserved.
+** Contact: KO Myung-Hun (komh@chollian.net)
+**
+** This file is part of K Alarm.
+**
+** $BEGIN_LICENSE$
+**
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** $END_LICENSE$
+**
+****************************************************************************/
+
+
+#include "kalarmdaemonprotocol.h"
+
+#include <QtEndian>
+#include <QLocalSocket>
+
+#ifdef Q_OS_UNIX
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+QString KAlarmDaemonProtocol::defaultSocketName()
+{
+    return "/var/run/kalarmd/kalarmd";
+}
+
+QStringList KAlarmDaemonProtocol::sessionVariables()
+{
+    return QStringList() << "DISPLAY" << "WAYLAND_DISPLAY" << "XAUTHORITY"
+                         << "XDG_RUNTIME_DIR" << "XDG_SESSION_TYPE"
+                         << "DBUS_SESSION_BUS_ADDRESS";
+}
+
+QByteArray KAlarmDaemonProtocol::frame(const QByteArray &payload)
+{
+    QByteArray data(4, '\0');
+
+    qToBigEndian<quint32>(payload.size(),
+                          reinterpret_cast<uchar *>(data.data()));
+
+    return data + payload;
+}
+
+bool KAlarmDaemonProtocol::takeFrame(QByteArray *buffer, QByteArray *payload,
+                                     bool *invalid)
+{
+    *invalid = false;
+
+    if (buffer->size() < 4)
+        return false;
+
+    quint32 size = qFromBigEndian<quint32>(
+                reinterpret_cast<const uchar *>(buffer->constData()));
+
+    if (size > MaxFrameSize)
+    {
+        *invalid = true;
+
+        return false;
+    }
+
+    if (static_cast<quint32>(buffer->size() - 4) < size)
+        return false;
+
+    *payload = buffer->mid(4, size);
+    buffer->remove(0, 4 + size);
+
+    return true;
+}
+
+bool KAlarmDaemonProtocol::peerUid(QLocalSocket *socket, uint *uid)
+{
+#ifdef Q_OS_UNIX
+    int fd = static_cast<int>(socket->socketDescriptor());
+
+#ifdef Q_OS_LINUX
+    struct ucred credentials;
+    socklen_t length = sizeof(credentials);
+
+    if (::getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &length) != 0)
+        return false;
+
+    *uid = credentials.uid;
+#else
+    uid_t euid;
+    gid_t egid;
+
+    if (::getpeereid(fd, &euid, &egid) != 0)
+        return false;
+
+    *uid = euid;
+#endif
+
+    return true;
+#else
+    Q_UNUSED(socket);
+    Q_UNUSED(uid);
+
+    return false;
+#endif
+}
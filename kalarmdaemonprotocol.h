@@ -0,0 +1,84 @@
+/****************************************************************************
+**
+** KAlarmDaemonProtocol, messages between kalarmd and K Alarm
+**
+** Copyright (C) 2015 by KO Myung-Hun
+** All rights reserved.
+** Contact: KO Myung-Hun (komh@chollian.net)
+**
+** This file is part of K Alarm.
+**
+** $BEGIN_LICENSE$
+**
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** $END_LICENSE$
+**
+****************************************************************************/
+
+
+#ifndef KALARMDAEMONPROTOCOL_H
+#define KALARMDAEMONPROTOCOL_H
+
+#include <QByteArray>
+#include <QStringList>
+
+class QLocalSocket;
+
+/*
+ * KAlarmDaemonProtocol frames messages exchanged by kalarmd and K Alarm
+ * over a local socket. A frame is a 32-bit size followed by a QDataStream
+ * payload, which begins with a KMessage as quint8. Ids in messages are ids
+ * of a user, not of kalarmd.
+ */
+class KAlarmDaemonProtocol
+{
+public:
+    enum KMessage
+    {
+        // kalarmd to K Alarm
+        WarmUpMessage = 1,      // KAlarmItem, QDateTime
+        TriggeredMessage,       // KAlarmItem, QDateTime
+        ScheduledMessage,       // quint32 id, QDateTime
+        DisabledMessage,        // quint32 id
+
+        // K Alarm to kalarmd
+        PresentedMessage = 64,  // quint32 id
+        RefreshMessage,         // none, to be sent all ScheduledMessage
+        EnvironmentMessage      // QStringList of NAME=value of a session
+    };
+
+    enum { MaxFrameSize = 1024 * 1024 };
+
+    /*
+     * A socket of kalarmd by default, in a directory only root can write,
+     * so that no other user can listen there
+     */
+    static QString defaultSocketName();
+
+    /* Variables of a session sent for programs executed by kalarmd */
+    static QStringList sessionVariables();
+
+    /*
+     * A uid of a process at the other end of socket. Returns false if not
+     * known, as on platforms without credentials of a peer.
+     */
+    static bool peerUid(QLocalSocket *socket, uint *uid);
+
+    static QByteArray frame(const QByteArray &payload);
+
+    /*
+     * Take a payload of the first frame of buffer. Returns false if a frame
+     * is not complete yet, or sets invalid to true if it is too large.
+     */
+    static bool takeFrame(QByteArray *buffer, QByteArray *payload,
+                          bool *invalid);
+};
+
+#endif // KALARMDAEMONPROTOCOL_H
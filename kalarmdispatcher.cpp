@@ -0,0 +1,610 @@
+/****************************************************************************
+**
+** KAlarmDispatcher, dispatches due alarms in order of priority
+**
+** Copyright (C) 2015 by KO Myung-Hun
+** All rights reserved.
+** Contact: KO Myung-Hun (komh@chollian.net)
+**
+** This file is part of K Alarm.
+**
+** $BEGIN_LICENSE$
+**
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** $END_LICENSE$
+**
+****************************************************************************/
+
+#include "kalarmdispatcher.h"
+#include "kalarmwatchdog.h"
+#include "kalarmresourceregistry.h"
+#include "kalarmhistory.h"
+#include "kalarmmetricsserver.h"
+
+#include <QProcess>
+#include <QTextStream>
+
+// Upper bounds of latency buckets in milli-seconds. The last bucket has
+// no upper bound.
+static const qint64 latencyBucketBounds[] = {10, 100, 1000, 10000};
+
+static const char *const priorityNames[] = {
+    QT_TRANSLATE_NOOP("KAlarmDispatcher", "Low"),
+    QT_TRANSLATE_NOOP("KAlarmDispatcher", "Normal"),
+    QT_TRANSLATE_NOOP("KAlarmDispatcher", "High"),
+    QT_TRANSLATE_NOOP("KAlarmDispatcher", "Critical")
+};
+
+KAlarmDispatcher::KAlarmDispatcher(QObject *parent)
+    : QObject(parent)
+    , _timer(0)
+    , _window(10000)
+    , _maxInFlight(4)
+    , _latencyBound(1000)
+    , _resources(0)
+    , _history(0)
+    , _processFactory(0)
+    , _batchCount(0)
+    , _largestBatch(0)
+    , _backlog(0)
+    , _peakBacklog(0)
+    , _spreadCount(0)
+    , _heldBackCount(0)
+    , _execFailureCount(0)
+{
+    for (int p = 0; p < PriorityCount; ++p)
+    {
+        _latencyCount[p] = 0;
+        _latencyTotal[p] = 0;
+        _latencyMax[p] = 0;
+        _overBoundCount[p] = 0;
+    }
+
+    for (int i = 0; i < LatencyBucketCount; ++i)
+        _latencyBuckets[i] = 0;
+
+    _clock.start();
+}
+
+KAlarmDispatcher::~KAlarmDispatcher()
+{
+    // Let programs run after K Alarm exits, as if detached
+    foreach (QProcess *process, _processes.keys())
+    {
+        process->disconnect(this);
+        process->setParent(0);
+    }
+}
+
+void KAlarmDispatcher::setWindow(int msecs)
+{
+    _window = qMax(msecs, 0);
+}
+
+void KAlarmDispatcher::setMaxInFlight(int count)
+{
+    _maxInFlight = qMax(count, 1);
+}
+
+void KAlarmDispatcher::setLatencyBound(int msecs)
+{
+    _latencyBound = qMax(msecs, 0);
+}
+
+void KAlarmDispatcher::setResourceRegistry(
+        const KAlarmResourceRegistry *registry)
+{
+    _resources = registry;
+}
+
+void KAlarmDispatcher::setHistory(KAlarmHistory *history)
+{
+    _history = history;
+}
+
+void KAlarmDispatcher::setProcessFactory(KAlarmProcessFactory *factory)
+{
+    _processFactory = factory;
+}
+
+void KAlarmDispatcher::dispatch(const QList<KAlarmItem> &items,
+                                const QDateTime &dt)
+{
+    if (items.isEmpty())
+        return;
+
+    // A timer is created in a scheduler thread
+    if (!_timer)
+    {
+        _timer = new QTimer(this);
+        _timer->setSingleShot(true);
+        connect(_timer, SIGNAL(timeout()), this, SLOT(timerTimeout()));
+    }
+
+    qint64 now = _clock.elapsed();
+
+    QList<Job> jobs[PriorityCount];
+
+    foreach (const KAlarmItem &item, items)
+    {
+        int p = qBound(0, static_cast<int>(item.priority()),
+                       PriorityCount - 1);
+
+        Job job;
+        job.item = item;
+        job.dt = dt;
+        job.queued = now;
+        job.release = now;
+        job.heldBack = false;
+        job.programStarted = false;
+
+        jobs[p].append(job);
+    }
+
+    // Spread low and normal priority alarms only if they cannot be
+    // presented at once. Normal priority alarms are released earlier.
+    int spreadTotal = jobs[KAlarmItem::NormalPriority].size()
+                      + jobs[KAlarmItem::LowPriority].size();
+    bool crowded = items.size() > _maxInFlight;
+    int spreadIndex = 0;
+    qint64 spreadCount = 0;
+
+    for (int p = PriorityCount - 1; p >= 0; --p)
+    {
+        QList<Job> &pending = _pending[p];
+
+        for (int i = 0; i < jobs[p].size(); ++i)
+        {
+            Job &job = jobs[p][i];
+
+            if (p <= KAlarmItem::NormalPriority)
+            {
+                if (crowded)
+                    job.release = now + static_cast<qint64>(_window)
+                                        * spreadIndex / spreadTotal;
+
+                ++spreadIndex;
+            }
+
+            // Keep release times of a priority in order
+            if (!pending.isEmpty() && pending.last().release > job.release)
+                job.release = pending.last().release;
+
+            if (job.release > now)
+                ++spreadCount;
+
+            pending.append(job);
+        }
+    }
+
+    {
+        QMutexLocker locker(&_mutex);
+
+        ++_batchCount;
+        _largestBatch = qMax(_largestBatch, items.size());
+        _spreadCount += spreadCount;
+    }
+
+    dispatchPending();
+}
+
+void KAlarmDispatcher::presented(quint32 id)
+{
+    QMultiHash<quint32, Job>::iterator it = _inFlight.find(id);
+
+    if (it == _inFlight.end())
+        return;
+
+    Job job(it.value());
+
+    _inFlight.erase(it);
+
+    record(job);
+
+    // A GUI thread is ready for the next alarm
+    dispatchPending();
+}
+
+void KAlarmDispatcher::clear()
+{
+    for (int p = 0; p < PriorityCount; ++p)
+        _pending[p].clear();
+
+    _inFlight.clear();
+
+    foreach (QProcess *process, _processes.keys())
+    {
+        process->disconnect(this);
+        connect(process, SIGNAL(finished(int,QProcess::ExitStatus)),
+                process, SLOT(deleteLater()));
+    }
+
+    _processes.clear();
+
+    if (_timer)
+        _timer->stop();
+
+    updateBacklog();
+}
+
+QString KAlarmDispatcher::summary() const
+{
+    QMutexLocker locker(&_mutex);
+
+    QString s;
+    QTextStream out(&s);
+
+    out << tr("Batches: %1, largest: %2 alarms").arg(_batchCount)
+                                                .arg(_largestBatch) << "\n";
+    out << tr("Backlog: %1, peak: %2").arg(_backlog).arg(_peakBacklog)
+        << "\n";
+    out << tr("Spread over %1 ms: %2").arg(_window).arg(_spreadCount)
+        << "\n";
+    out << tr("Held back by %1 alarms in flight: %2").arg(_maxInFlight)
+                                                      .arg(_heldBackCount)
+        << "\n";
+    out << tr("Program failures: %1").arg(_execFailureCount) << "\n";
+
+    out << "\n" << tr("Dispatch latency (bound %1 ms):").arg(_latencyBound)
+        << "\n";
+
+    for (int p = PriorityCount - 1; p >= 0; --p)
+    {
+        if (!_latencyCount[p])
+            continue;
+
+        out << "  "
+            << tr("%1: %2 alarms, average %3 ms, max %4 ms, over bound %5")
+               .arg(tr(priorityNames[p]))
+               .arg(_latencyCount[p])
+               .arg(_latencyTotal[p] / _latencyCount[p])
+               .arg(_latencyMax[p])
+               .arg(_overBoundCount[p])
+            << "\n";
+    }
+
+    for (int i = 0; i < LatencyBucketCount; ++i)
+    {
+        if (i < LatencyBucketCount - 1)
+            out << "  " << tr("< %1 ms: %2").arg(latencyBucketBounds[i])
+                                            .arg(_latencyBuckets[i]);
+        else
+            out << "  " << tr(">= %1 ms: %2")
+                           .arg(latencyBucketBounds[i - 1])
+                           .arg(_latencyBuckets[i]);
+        out << "\n";
+    }
+
+    return s;
+}
+
+void KAlarmDispatcher::writeMetrics(QTextStream &out) const
+{
+    static const char *const priorityLabels[] = {
+        "low", "normal", "high", "critical"
+    };
+
+    QMutexLocker locker(&_mutex);
+
+    KAlarmMetricsServer::writeHeader(out, "kalarm_firings_total", "counter",
+                                     "Alarms fired.");
+    for (int p = 0; p < PriorityCount; ++p)
+        out << "kalarm_firings_total{priority=\"" << priorityLabels[p]
+            << "\"} " << _latencyCount[p] << "\n";
+
+    KAlarmMetricsServer::writeHeader(out, "kalarm_dispatch_latency_seconds",
+                                     "histogram",
+                                     "Time from an alarm time to "
+                                     "presentation.");
+
+    qint64 count = 0;
+    qint64 total = 0;
+    for (int p = 0; p < PriorityCount; ++p)
+    {
+        count += _latencyCount[p];
+        total += _latencyTotal[p];
+    }
+
+    qint64 cumulative = 0;
+    for (int i = 0; i < LatencyBucketCount - 1; ++i)
+    {
+        cumulative += _latencyBuckets[i];
+
+        out << "kalarm_dispatch_latency_seconds_bucket{le=\""
+            << latencyBucketBounds[i] / 1000.0 << "\"} " << cumulative
+            << "\n";
+    }
+    out << "kalarm_dispatch_latency_seconds_bucket{le=\"+Inf\"} " << count
+        << "\n";
+    out << "kalarm_dispatch_latency_seconds_sum " << total / 1000.0 << "\n";
+    out << "kalarm_dispatch_latency_seconds_count " << count << "\n";
+
+    KAlarmMetricsServer::writeHeader(out, "kalarm_dispatch_over_bound_total",
+                                     "counter",
+                                     "Alarms presented later than a latency "
+                                     "bound.");
+    for (int p = 0; p < PriorityCount; ++p)
+        out << "kalarm_dispatch_over_bound_total{priority=\""
+            << priorityLabels[p] << "\"} " << _overBoundCount[p] << "\n";
+
+    KAlarmMetricsServer::writeHeader(out, "kalarm_dispatch_backlog", "gauge",
+                                     "Alarms pending or being presented.");
+    out << "kalarm_dispatch_backlog " << _backlog << "\n";
+
+    KAlarmMetricsServer::writeHeader(out, "kalarm_dispatch_held_back_total",
+                                     "counter",
+                                     "Alarms held back by alarms in "
+                                     "flight.");
+    out << "kalarm_dispatch_held_back_total " << _heldBackCount << "\n";
+
+    KAlarmMetricsServer::writeHeader(out, "kalarm_exec_failures_total",
+                                     "counter",
+                                     "Programs which could not be "
+                                     "executed.");
+    out << "kalarm_exec_failures_total " << _execFailureCount << "\n";
+}
+
+bool KAlarmDispatcher::needsPresentation(const Job &job) const
+{
+    return job.item.playSound() || job.item.showAlarmWindow();
+}
+
+void KAlarmDispatcher::run(const Job &job)
+{
+    // A program is executed in a scheduler thread, so that it is not
+    // delayed by a GUI thread
+    if (job.item.execProgram() && !job.programStarted)
+        startProgram(job);
+
+    // Sound and an alarm window are presented in a GUI thread
+    if (needsPresentation(job))
+    {
+        _inFlight.insert(job.item.id(), job);
+
+        emit alarmTriggered(job.item, job.dt);
+    }
+    else
+        record(job);
+}
+
+void KAlarmDispatcher::startProgram(const Job &job)
+{
+    QString program(job.item.execProgramName());
+
+    QProcess *process = 0;
+
+    // A resolved path is used without touching a file system
+    if (!_resources
+            || _resources->resolveProgram(job.item.execProgramNameId(),
+                                          &program))
+        process = _processFactory
+                ? _processFactory->createProcess(job.item, this)
+                : new QProcess(this);
+
+    if (process)
+    {
+        // Not detached, so that an exit status is known. Failures to
+        // start are reported by processError() without blocking.
+        process->setProcessChannelMode(QProcess::ForwardedChannels);
+
+        connect(process, SIGNAL(finished(int,QProcess::ExitStatus)),
+                this, SLOT(processFinished(int,QProcess::ExitStatus)));
+        connect(process, SIGNAL(error(QProcess::ProcessError)),
+                this, SLOT(processError(QProcess::ProcessError)));
+
+        _processes.insert(process, job);
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 15, 0)
+        // Parameters are split as a command line, but not a program
+        process->start(program, QProcess::splitCommand(
+                                    job.item.execProgramParams()));
+#else
+        if (program.contains(' '))
+            program = "\"" + program + "\"";
+
+        process->start(program + " " + job.item.execProgramParams());
+#endif
+        process->closeWriteChannel();
+    }
+    else
+    {
+        qWarning("KAlarmDispatcher: Cannot execute %s",
+                 qPrintable(job.item.execProgramName()));
+
+        if (_history)
+            _history->append(job.item.id(), KAlarmHistory::ProgramFailed,
+                             job.dt);
+
+        QMutexLocker locker(&_mutex);
+
+        ++_execFailureCount;
+    }
+}
+
+void KAlarmDispatcher::processFinished(int exitCode,
+                                       QProcess::ExitStatus exitStatus)
+{
+    QProcess *process = qobject_cast<QProcess *>(sender());
+
+    if (!_processes.contains(process))
+        return;
+
+    Job job(_processes.take(process));
+
+    if (_history)
+        _history->append(job.item.id(),
+                         exitStatus == QProcess::NormalExit
+                            ? KAlarmHistory::ProgramExited
+                            : KAlarmHistory::ProgramCrashed,
+                         job.dt, exitCode);
+
+    process->deleteLater();
+}
+
+void KAlarmDispatcher::processError(QProcess::ProcessError error)
+{
+    // Other errors are followed by finished()
+    if (error != QProcess::FailedToStart)
+        return;
+
+    QProcess *process = qobject_cast<QProcess *>(sender());
+
+    if (!_processes.contains(process))
+        return;
+
+    Job job(_processes.take(process));
+
+    qWarning("KAlarmDispatcher: Cannot execute %s",
+             qPrintable(job.item.execProgramName()));
+
+    if (_history)
+        _history->append(job.item.id(), KAlarmHistory::ProgramFailed,
+                         job.dt);
+
+    {
+        QMutexLocker locker(&_mutex);
+
+        ++_execFailureCount;
+    }
+
+    process->deleteLater();
+}
+
+void KAlarmDispatcher::record(const Job &job)
+{
+    qint64 latency = _clock.elapsed() - job.queued;
+    int p = qBound(0, static_cast<int>(job.item.priority()),
+                   PriorityCount - 1);
+
+    int bucket = 0;
+    while (bucket < LatencyBucketCount - 1
+           && latency >= latencyBucketBounds[bucket])
+        ++bucket;
+
+    QMutexLocker locker(&_mutex);
+
+    ++_latencyCount[p];
+    _latencyTotal[p] += latency;
+    _latencyMax[p] = qMax(_latencyMax[p], latency);
+    if (latency > _latencyBound)
+        ++_overBoundCount[p];
+
+    ++_latencyBuckets[bucket];
+
+    locker.unlock();
+
+    if (_history)
+        _history->append(job.item.id(), KAlarmHistory::AlarmFired, job.dt);
+}
+
+void KAlarmDispatcher::dispatchPending()
+{
+    KAlarmActivityScope activity("KAlarmDispatcher::dispatchPending()");
+
+    qint64 now = _clock.elapsed();
+    qint64 wakeUp = -1;
+    bool presentationBlocked = false;
+
+    // Dispatch in order of priority. If an alarm is held back by a GUI
+    // thread, alarms of lower priorities to be presented are held back,
+    // too. Programs do not wait for a GUI thread, so they are executed as
+    // soon as released, even of alarms held back.
+    for (int p = PriorityCount - 1; p >= 0; --p)
+    {
+        QList<Job> &pending = _pending[p];
+        int i = 0;
+
+        while (i < pending.size())
+        {
+            Job &job = pending[i];
+
+            if (job.release > now)
+            {
+                if (wakeUp == -1 || job.release < wakeUp)
+                    wakeUp = job.release;
+
+                break;
+            }
+
+            // Back-pressure from a GUI thread
+            if (needsPresentation(job)
+                    && (presentationBlocked
+                        || (p != KAlarmItem::CriticalPriority
+                            && _inFlight.size() >= _maxInFlight
+                            && !(p == KAlarmItem::HighPriority
+                                 && now - job.queued >= _latencyBound))))
+            {
+                if (!job.heldBack)
+                {
+                    job.heldBack = true;
+
+                    QMutexLocker locker(&_mutex);
+
+                    ++_heldBackCount;
+                }
+
+                // A high priority alarm is not held back beyond a bound
+                if (p == KAlarmItem::HighPriority)
+                {
+                    qint64 bound = job.queued + _latencyBound;
+
+                    if (wakeUp == -1 || bound < wakeUp)
+                        wakeUp = bound;
+                }
+
+                if (job.item.execProgram() && !job.programStarted)
+                {
+                    job.programStarted = true;
+
+                    startProgram(job);
+                }
+
+                presentationBlocked = true;
+                ++i;
+
+                continue;
+            }
+
+            Job ready(job);
+
+            pending.removeAt(i);
+
+            run(ready);
+        }
+    }
+
+    updateBacklog();
+
+    if (!_timer)
+        return;
+
+    if (wakeUp == -1)
+        _timer->stop();
+    else
+        _timer->start(static_cast<int>(qMax(wakeUp - now, Q_INT64_C(0))));
+}
+
+void KAlarmDispatcher::updateBacklog()
+{
+    int backlog = _inFlight.size();
+
+    for (int p = 0; p < PriorityCount; ++p)
+        backlog += _pending[p].size();
+
+    QMutexLocker locker(&_mutex);
+
+    _backlog = backlog;
+    _peakBacklog = qMax(_peakBacklog, backlog);
+}
+
+void KAlarmDispatcher::timerTimeout()
+{
+    dispatchPending();
+}
@@ -0,0 +1,170 @@
+/****************************************************************************
+**
+** KAlarmDispatcher, dispatches due alarms in order of priority
+**
+** Copyright (C) 2015 by KO Myung-Hun
+** All rights reserved.
+** Contact: KO Myung-Hun (komh@chollian.net)
+**
+** This file is part of K Alarm.
+**
+** $BEGIN_LICENSE$
+**
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** $END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef KALARMDISPATCHER_H
+#define KALARMDISPATCHER_H
+
+#include <QObject>
+#include <QTimer>
+#include <QMutex>
+#include <QElapsedTimer>
+#include <QDateTime>
+#include <QMultiHash>
+#include <QList>
+#include <QHash>
+#include <QProcess>
+
+#include "kalarmitem.h"
+
+class KAlarmResourceRegistry;
+class KAlarmHistory;
+class QTextStream;
+
+/*
+ * KAlarmProcessFactory creates a process to execute a program of an alarm,
+ * for example, with privileges of a user who owns an alarm
+ */
+class KAlarmProcessFactory
+{
+public:
+    virtual ~KAlarmProcessFactory() {}
+
+    /* Returns 0 if a program of item must not be executed */
+    virtual QProcess *createProcess(const KAlarmItem &item,
+                                    QObject *parent) = 0;
+};
+
+/*
+ * KAlarmDispatcher runs in a scheduler thread with KAlarmQueue. Alarms due
+ * together are dispatched in order of priority. When more alarms are due
+ * than can be presented at once, actions of low and normal priority alarms
+ * are spread over a dispatch window, and at most maxInFlight alarms are
+ * presented by a GUI thread at the same time. Programs are not held back
+ * by a GUI thread. Critical alarms are neither spread nor held back, and
+ * high priority alarms are held back at most for a latency bound.
+ */
+class KAlarmDispatcher : public QObject
+{
+    Q_OBJECT
+public:
+    explicit KAlarmDispatcher(QObject *parent = 0);
+    ~KAlarmDispatcher();
+
+    /* Should be called before alarms are dispatched */
+    void setWindow(int msecs);
+    void setMaxInFlight(int count);
+    void setLatencyBound(int msecs);
+
+    /* Programs are executed with paths resolved by registry */
+    void setResourceRegistry(const KAlarmResourceRegistry *registry);
+
+    /* Firings and exit statuses of programs are logged to history */
+    void setHistory(KAlarmHistory *history);
+
+    /* Programs are executed in processes created by factory if set */
+    void setProcessFactory(KAlarmProcessFactory *factory);
+
+    /* Dispatch enabled alarms due at dt */
+    void dispatch(const QList<KAlarmItem> &items, const QDateTime &dt);
+
+    /* Dispatch statistics. Thread-safe */
+    QString summary() const;
+
+    /* Write metrics in Prometheus text format. Thread-safe */
+    void writeMetrics(QTextStream &out) const;
+
+public slots:
+    /* Should be called when an alarm of id has been presented */
+    void presented(quint32 id);
+
+    /*
+     * Forget pending alarms and alarms in flight, for example, of another
+     * profile. Running programs are left running, but not logged.
+     */
+    void clear();
+
+signals:
+    /* Emitted to show an alarm window or to play a sound of item */
+    void alarmTriggered(const KAlarmItem &item, const QDateTime &dt);
+
+private:
+    enum { PriorityCount = KAlarmItem::CriticalPriority + 1 };
+    enum { LatencyBucketCount = 5 };
+
+    struct Job
+    {
+        KAlarmItem item;
+        QDateTime dt;
+        qint64 queued;      // msecs of _clock
+        qint64 release;     // msecs of _clock
+        bool heldBack;
+        bool programStarted;    // before it is presented
+    };
+
+    QTimer *_timer;
+    QElapsedTimer _clock;
+
+    int _window;
+    int _maxInFlight;
+    int _latencyBound;
+
+    const KAlarmResourceRegistry *_resources;
+    KAlarmHistory *_history;
+    KAlarmProcessFactory *_processFactory;
+
+    // Running programs, and alarms which executed them
+    QHash<QProcess *, Job> _processes;
+
+    QList<Job> _pending[PriorityCount];
+    QMultiHash<quint32, Job> _inFlight;
+
+    // Statistics, guarded by _mutex
+    mutable QMutex _mutex;
+    qint64 _batchCount;
+    int _largestBatch;
+    int _backlog;
+    int _peakBacklog;
+    qint64 _spreadCount;
+    qint64 _heldBackCount;
+    qint64 _execFailureCount;
+    qint64 _latencyCount[PriorityCount];
+    qint64 _latencyTotal[PriorityCount];
+    qint64 _latencyMax[PriorityCount];
+    qint64 _overBoundCount[PriorityCount];
+    qint64 _latencyBuckets[LatencyBucketCount];
+
+    bool needsPresentation(const Job &job) const;
+    void run(const Job &job);
+    void startProgram(const Job &job);
+    void record(const Job &job);
+    void dispatchPending();
+    void updateBacklog();
+
+private slots:
+    void timerTimeout();
+    void processFinished(int exitCode, QProcess::ExitStatus exitStatus);
+    void processError(QProcess::ProcessError error);
+};
+
+#endif // KALARMDISPATCHER_H
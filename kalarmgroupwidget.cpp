@@ -0,0 +1,115 @@
+/****************************************************************************
+**
+** KAlarmGroupWidget, a header of an alarm group in a list
+**
+** Copyright (C) 2015 by KO Myung-Hun
+** All rights reserved.
+** Contact: KO Myung-Hun (komh@chollian.net)
+**
+** This file is part of K Alarm.
+**
+** $BEGIN_LICENSE$
+**
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** $END_LICENSE$
+**
+****************************************************************************/
+
+#include "kalarmgroupwidget.h"
+
+KAlarmGroupWidget::KAlarmGroupWidget(const QString &group, QWidget *parent)
+    : QWidget(parent)
+    , _group(group)
+    , _count(0)
+{
+    _expandButton = new QToolButton;
+    _expandButton->setAutoRaise(true);
+    _expandButton->setArrowType(Qt::DownArrow);
+    _expandButton->setCheckable(true);
+    _expandButton->setChecked(true);
+
+    _groupEnabledCheck = new QCheckBox;
+    _groupEnabledCheck->setChecked(true);
+
+    QFont boldFont(_groupEnabledCheck->font());
+    boldFont.setBold(true);
+    _groupEnabledCheck->setFont(boldFont);
+
+    QHBoxLayout *mainLayout = new QHBoxLayout;
+    mainLayout->addWidget(_expandButton);
+    mainLayout->addWidget(_groupEnabledCheck, 1);
+
+    setLayout(mainLayout);
+
+    updateText();
+
+    connect(_expandButton, SIGNAL(clicked()),
+            this, SLOT(expandButtonClicked()));
+    connect(_groupEnabledCheck, SIGNAL(toggled(bool)),
+            this, SIGNAL(groupEnabledToggled(bool)));
+}
+
+KAlarmGroupWidget::~KAlarmGroupWidget()
+{
+
+}
+
+QString KAlarmGroupWidget::group() const
+{
+    return _group;
+}
+
+int KAlarmGroupWidget::count() const
+{
+    return _count;
+}
+
+void KAlarmGroupWidget::setCount(int count)
+{
+    _count = count;
+
+    updateText();
+}
+
+bool KAlarmGroupWidget::isGroupEnabled() const
+{
+    return _groupEnabledCheck->isChecked();
+}
+
+void KAlarmGroupWidget::setGroupEnabled(bool enabled)
+{
+    // Not emitted when set by a program
+    _groupEnabledCheck->blockSignals(true);
+    _groupEnabledCheck->setChecked(enabled);
+    _groupEnabledCheck->blockSignals(false);
+}
+
+bool KAlarmGroupWidget::isExpanded() const
+{
+    return _expandButton->isChecked();
+}
+
+void KAlarmGroupWidget::setExpanded(bool expanded)
+{
+    _expandButton->setChecked(expanded);
+    _expandButton->setArrowType(expanded ? Qt::DownArrow : Qt::RightArrow);
+}
+
+void KAlarmGroupWidget::updateText()
+{
+    _groupEnabledCheck->setText(tr("%1 (%2)").arg(_group).arg(_count));
+}
+
+void KAlarmGroupWidget::expandButtonClicked()
+{
+    setExpanded(_expandButton->isChecked());
+
+    emit expandedToggled(isExpanded());
+}
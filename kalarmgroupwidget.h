@@ -0,0 +1,72 @@
+/****************************************************************************
+**
+** KAlarmGroupWidget, a header of an alarm group in a list
+**
+** Copyright (C) 2015 by KO Myung-Hun
+** All rights reserved.
+** Contact: KO Myung-Hun (komh@chollian.net)
+**
+** This file is part of K Alarm.
+**
+** $BEGIN_LICENSE$
+**
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** $END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef KALARMGROUPWIDGET_H
+#define KALARMGROUPWIDGET_H
+
+#include <QWidget>
+
+#ifdef CONFIG_QT5
+#include <QtWidgets>
+#else
+#include <QtGui>
+#endif
+
+class KAlarmGroupWidget : public QWidget
+{
+    Q_OBJECT
+public:
+    explicit KAlarmGroupWidget(const QString &group, QWidget *parent = 0);
+    ~KAlarmGroupWidget();
+
+    QString group() const;
+
+    /* Number of alarms in a group */
+    int count() const;
+    void setCount(int count);
+
+    bool isGroupEnabled() const;
+    void setGroupEnabled(bool enabled);
+
+    bool isExpanded() const;
+    void setExpanded(bool expanded);
+
+signals:
+    void groupEnabledToggled(bool checked);
+    void expandedToggled(bool expanded);
+
+private:
+    QString _group;
+    int _count;
+
+    QToolButton *_expandButton;
+    QCheckBox *_groupEnabledCheck;
+
+    void updateText();
+
+private slots:
+    void expandButtonClicked();
+};
+
+#endif // KALARMGROUPWIDGET_H
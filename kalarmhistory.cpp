@@ -0,0 +1,301 @@
+/****************************************************************************
+**
+** KAlarmHistory, append-only log of alarm firings
+**
+** Copyright (C) 2015 by KO Myung-Hun
+** All rights reserved.
+** Contact: KO Myung-Hun (komh@chollian.net)
+**
+** This file is part of K Alarm.
+**
+** $BEGIN_LICENSE$
+**
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** $END_LICENSE$
+**
+****************************************************************************/
+
+#include "kalarmhistory.h"
+#include "kalarmmetricsserver.h"
+
+#include <QFileInfo>
+#include <QElapsedTimer>
+#include <QTextStream>
+#include <QtEndian>
+
+#include <cstring>
+
+// Written at the beginning of a log
+static const char historyMagic[] = "KAH1";
+static const int historyMagicSize = 4;
+
+// id, kind, due, at and status in big endian
+static const int eventSize = 4 + 1 + 8 + 8 + 4;
+
+KAlarmHistory::KAlarmHistory(const QString &fileName)
+    : _fileName(fileName)
+    , _file(fileName)
+    , _maxSize(1024 * 1024)
+    , _indexDepth(50)
+    , _appendCount(0)
+    , _appendNSecs(0)
+    , _rotationCount(0)
+{
+}
+
+KAlarmHistory::~KAlarmHistory()
+{
+    _file.close();
+}
+
+void KAlarmHistory::setFileName(const QString &fileName)
+{
+    QMutexLocker locker(&_mutex);
+
+    _file.close();
+
+    _fileName = fileName;
+    _file.setFileName(fileName);
+    _index.clear();
+}
+
+void KAlarmHistory::setMaxSize(qint64 bytes)
+{
+    _maxSize = qMax(bytes, static_cast<qint64>(historyMagicSize + eventSize));
+}
+
+void KAlarmHistory::setIndexDepth(int count)
+{
+    _indexDepth = qMax(count, 1);
+}
+
+int KAlarmHistory::load()
+{
+    QMutexLocker locker(&_mutex);
+
+    int count = 0;
+
+    // Older events first
+    loadFile(rotatedFileName(), &count);
+    loadFile(_fileName, &count);
+
+    return count;
+}
+
+void KAlarmHistory::append(quint32 id, KEventKind kind, const QDateTime &due,
+                           qint32 status)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    Event event;
+    event.id = id;
+    event.kind = kind;
+    event.due = due;
+    event.at = QDateTime::currentDateTime();
+    event.status = status;
+
+    uchar data[eventSize];
+    qToBigEndian<quint32>(event.id, data);
+    data[4] = static_cast<uchar>(event.kind);
+    qToBigEndian<qint64>(event.due.toMSecsSinceEpoch(), data + 5);
+    qToBigEndian<qint64>(event.at.toMSecsSinceEpoch(), data + 13);
+    qToBigEndian<qint32>(event.status, data + 21);
+
+    QMutexLocker locker(&_mutex);
+
+    index(event);
+
+    if (open())
+    {
+        if (_file.size() + eventSize > _maxSize)
+            rotate();
+
+        if (_file.isOpen())
+        {
+            _file.write(reinterpret_cast<const char *>(data), eventSize);
+            _file.flush();
+        }
+    }
+
+    ++_appendCount;
+    _appendNSecs += timer.nsecsElapsed();
+}
+
+QList<KAlarmHistory::Event> KAlarmHistory::events(quint32 id,
+                                                  int count) const
+{
+    QMutexLocker locker(&_mutex);
+
+    const QList<Event> indexed(_index.value(id));
+    QList<Event> list;
+
+    for (int i = indexed.size() - 1; i >= 0 && list.size() < count; --i)
+        list.append(indexed.at(i));
+
+    return list;
+}
+
+void KAlarmHistory::remove(quint32 id)
+{
+    QMutexLocker locker(&_mutex);
+
+    _index.remove(id);
+}
+
+QString KAlarmHistory::kindName(KEventKind kind)
+{
+    switch (kind)
+    {
+    case AlarmFired:
+        return tr("Fired");
+
+    case ProgramExited:
+        return tr("Program exited");
+
+    case ProgramCrashed:
+        return tr("Program crashed");
+
+    case ProgramFailed:
+        return tr("Program failed to start");
+    }
+
+    return QString();
+}
+
+QString KAlarmHistory::summary() const
+{
+    QMutexLocker locker(&_mutex);
+
+    QString s;
+    QTextStream out(&s);
+
+    out << tr("History: %1, %2 bytes")
+           .arg(_fileName).arg(_file.isOpen() ? _file.size()
+                                              : QFileInfo(_fileName).size())
+        << "\n";
+    out << tr("Appended events: %1").arg(_appendCount);
+    if (_appendCount > 0)
+        out << tr(", average %1 us").arg(_appendNSecs / _appendCount / 1000.0,
+                                         0, 'f', 1);
+    out << "\n";
+    out << tr("Rotations: %1").arg(_rotationCount) << "\n";
+    out << tr("Indexed alarms: %1").arg(_index.size()) << "\n";
+
+    return s;
+}
+
+void KAlarmHistory::writeMetrics(QTextStream &out) const
+{
+    QMutexLocker locker(&_mutex);
+
+    KAlarmMetricsServer::writeHeader(out, "kalarm_history_events_total",
+                                     "counter",
+                                     "Events appended to a history.");
+    out << "kalarm_history_events_total " << _appendCount << "\n";
+
+    KAlarmMetricsServer::writeHeader(out,
+                                     "kalarm_history_append_seconds_total",
+                                     "counter",
+                                     "Time spent appending to a history.");
+    out << "kalarm_history_append_seconds_total " << _appendNSecs / 1e9
+        << "\n";
+
+    KAlarmMetricsServer::writeHeader(out, "kalarm_history_rotations_total",
+                                     "counter", "Rotations of a history.");
+    out << "kalarm_history_rotations_total " << _rotationCount << "\n";
+}
+
+QString KAlarmHistory::rotatedFileName() const
+{
+    return _fileName + ".1";
+}
+
+void KAlarmHistory::loadFile(const QString &fileName, int *count)
+{
+    QFile file(fileName);
+
+    if (!file.open(QIODevice::ReadOnly))
+        return;
+
+    QByteArray data(file.readAll());
+
+    file.close();
+
+    if (data.size() < historyMagicSize
+            || memcmp(data.constData(), historyMagic, historyMagicSize))
+        return;
+
+    const uchar *p = reinterpret_cast<const uchar *>(data.constData());
+    int pos = historyMagicSize;
+
+    for (; pos + eventSize <= data.size(); pos += eventSize)
+    {
+        Event event;
+        event.id = qFromBigEndian<quint32>(p + pos);
+        event.kind = static_cast<KEventKind>(p[pos + 4]);
+        event.due = QDateTime::fromMSecsSinceEpoch(
+                        qFromBigEndian<qint64>(p + pos + 5));
+        event.at = QDateTime::fromMSecsSinceEpoch(
+                        qFromBigEndian<qint64>(p + pos + 13));
+        event.status = qFromBigEndian<qint32>(p + pos + 21);
+
+        index(event);
+
+        ++*count;
+    }
+
+    // Discard a torn event, so that events are appended after valid ones
+    if (pos < data.size() && fileName == _fileName)
+        QFile::resize(fileName, pos);
+}
+
+void KAlarmHistory::index(const Event &event)
+{
+    QList<Event> &events = _index[event.id];
+
+    events.append(event);
+
+    if (events.size() > _indexDepth)
+        events.removeFirst();
+}
+
+bool KAlarmHistory::open()
+{
+    if (_file.isOpen())
+        return true;
+
+    if (!_file.open(QIODevice::WriteOnly | QIODevice::Append))
+    {
+        qWarning("KAlarmHistory: Cannot open %s", qPrintable(_fileName));
+
+        return false;
+    }
+
+    if (_file.size() == 0)
+    {
+        _file.write(historyMagic, historyMagicSize);
+        _file.flush();
+    }
+
+    return true;
+}
+
+void KAlarmHistory::rotate()
+{
+    _file.close();
+
+    QFile::remove(rotatedFileName());
+    QFile::rename(_fileName, rotatedFileName());
+
+    ++_rotationCount;
+
+    open();
+}
@@ -0,0 +1,119 @@
+/****************************************************************************
+**
+** KAlarmHistory, append-only log of alarm firings
+**
+** Copyright (C) 2015 by KO Myung-Hun
+** All rights reserved.
+** Contact: KO Myung-Hun (komh@chollian.net)
+**
+** This file is part of K Alarm.
+**
+** $BEGIN_LICENSE$
+**
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** $END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef KALARMHISTORY_H
+#define KALARMHISTORY_H
+
+#include <QCoreApplication>
+#include <QFile>
+#include <QMutex>
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QDateTime>
+
+class QTextStream;
+
+/*
+ * KAlarmHistory appends an event of fixed size to a binary log whenever
+ * an alarm fires or its program exits. A log is rotated when it exceeds a
+ * maximum size, so that at most two logs are kept. The last events of each
+ * alarm are indexed in memory. Events are flushed to an operating system,
+ * but not synced to a disk. Thread-safe.
+ */
+class KAlarmHistory
+{
+    Q_DECLARE_TR_FUNCTIONS(KAlarmHistory)
+
+public:
+    enum KEventKind
+    {
+        AlarmFired = 1,         // presented, or no presentation needed
+        ProgramExited,          // status is an exit code
+        ProgramCrashed,
+        ProgramFailed           // could not be started
+    };
+
+    struct Event
+    {
+        quint32 id;
+        KEventKind kind;
+        QDateTime due;
+        QDateTime at;
+        qint32 status;
+
+        qint64 lateness() const { return due.msecsTo(at); }
+    };
+
+    explicit KAlarmHistory(const QString &fileName);
+    ~KAlarmHistory();
+
+    /* Switch to another log. An index is emptied until load() */
+    void setFileName(const QString &fileName);
+
+    /* Should be called before load() */
+    void setMaxSize(qint64 bytes);
+    void setIndexDepth(int count);
+
+    /* Index events in logs. Returns the number of events loaded */
+    int load();
+
+    void append(quint32 id, KEventKind kind, const QDateTime &due,
+                qint32 status = 0);
+
+    /* The last count events of id, the latest first */
+    QList<Event> events(quint32 id, int count) const;
+
+    /* Forget events of a removed alarm in an index */
+    void remove(quint32 id);
+
+    static QString kindName(KEventKind kind);
+
+    /* History statistics */
+    QString summary() const;
+
+    /* Write metrics in Prometheus text format */
+    void writeMetrics(QTextStream &out) const;
+
+private:
+    QString _fileName;
+    QFile _file;
+    qint64 _maxSize;
+    int _indexDepth;
+
+    mutable QMutex _mutex;
+    QHash<quint32, QList<Event> > _index;   // the latest last
+
+    qint64 _appendCount;
+    qint64 _appendNSecs;
+    qint64 _rotationCount;
+
+    QString rotatedFileName() const;
+    void loadFile(const QString &fileName, int *count);
+    void index(const Event &event);
+    bool open();
+    void rotate();
+};
+
+#endif // KALARMHISTORY_H
@@ -0,0 +1,435 @@
+/****************************************************************************
+**
+** KAlarmItem, alarm data shared by KAlarm and KAlarmQueue
+**
+** Copyright (C) 2015 by KO Myung-Hun
+** All rights reserved.
+** Contact: KO Myung-Hun (komh@chollian.net)
+**
+** This file is part of K Alarm
+**
+** $BEGIN_LICENSE$
+**
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** $END_LICENSE$
+**
+****************************************************************************/
+
+#include "kalarmitem.h"
+
+quint32 KAlarmItem::_lastId = 0;
+
+KAlarmItem::KAlarmItem()
+    : _id(0)
+    , _alarmEnabled(false)
+    , _alarmType(SingleShotAlarm)
+    , _weekDays(0)
+    , _showAlarmWindow(true)
+    , _playSound(false)
+    , _soundFileId(0)
+    , _execProgram(false)
+    , _execProgramNameId(0)
+    , _execProgramParamsId(0)
+    , _priority(NormalPriority)
+{
+}
+
+quint32 KAlarmItem::id() const
+{
+    return _id;
+}
+
+void KAlarmItem::setId(quint32 id)
+{
+    _id = id;
+
+    // Do not give an id in use to a new alarm
+    if (_lastId < id)
+        _lastId = id;
+}
+
+quint32 KAlarmItem::newId()
+{
+    return ++_lastId;
+}
+
+bool KAlarmItem::isAlarmEnabled() const
+{
+    return _alarmEnabled;
+}
+
+void KAlarmItem::setAlarmEnabled(bool enabled)
+{
+    _alarmEnabled = enabled;
+}
+
+QString KAlarmItem::name() const
+{
+    return _name;
+}
+
+void KAlarmItem::setName(const QString &name)
+{
+    _name = name;
+}
+
+QTime KAlarmItem::startTime() const
+{
+    return _startTime;
+}
+
+void KAlarmItem::setStartTime(const QTime &startTime)
+{
+    _startTime = startTime;
+}
+
+KAlarmItem::KAlarmType KAlarmItem::alarmType() const
+{
+    return _alarmType;
+}
+
+void KAlarmItem::setAlarmType(const KAlarmItem::KAlarmType &alarmType)
+{
+    _alarmType = alarmType;
+}
+
+QTime KAlarmItem::intervalTime() const
+{
+    return _intervalTime;
+}
+
+void KAlarmItem::setIntervalTime(const QTime &intervalTime)
+{
+    _intervalTime = intervalTime;
+}
+
+bool KAlarmItem::isWeekDayEnabled(KAlarmItem::KWeekDay weekDay) const
+{
+    return _weekDays & (1 << weekDay);
+}
+
+void KAlarmItem::setWeekDayEnabled(KAlarmItem::KWeekDay weekDay, bool enabled)
+{
+    if (enabled)
+        _weekDays |= 1 << weekDay;
+    else
+        _weekDays &= ~(1 << weekDay);
+}
+
+KAlarmItem::KWeekDay KAlarmItem::numToWeekDay(int n)
+{
+    // 1 to Monday
+    // ...
+    // 7 to Sunday
+    return static_cast<KWeekDay>(n - 1);
+}
+
+bool KAlarmItem::showAlarmWindow() const
+{
+    return _showAlarmWindow;
+}
+
+void KAlarmItem::setShowAlarmWindow(bool show)
+{
+    _showAlarmWindow = show;
+}
+
+bool KAlarmItem::playSound() const
+{
+    return _playSound;
+}
+
+void KAlarmItem::setPlaySound(bool play)
+{
+    _playSound = play;
+}
+
+QString KAlarmItem::soundFile() const
+{
+    return KAlarmStringPool::string(_soundFileId);
+}
+
+void KAlarmItem::setSoundFile(const QString &file)
+{
+    _soundFileId = KAlarmStringPool::intern(file);
+}
+
+quint32 KAlarmItem::soundFileId() const
+{
+    return _soundFileId;
+}
+
+bool KAlarmItem::execProgram() const
+{
+    return _execProgram;
+}
+
+void KAlarmItem::setExecProgram(bool execProgram)
+{
+    _execProgram = execProgram;
+}
+
+QString KAlarmItem::execProgramName() const
+{
+    return KAlarmStringPool::string(_execProgramNameId);
+}
+
+void KAlarmItem::setExecProgramName(const QString &execProgramName)
+{
+    _execProgramNameId = KAlarmStringPool::intern(execProgramName);
+}
+
+quint32 KAlarmItem::execProgramNameId() const
+{
+    return _execProgramNameId;
+}
+
+QString KAlarmItem::execProgramParams() const
+{
+    return KAlarmStringPool::string(_execProgramParamsId);
+}
+
+void KAlarmItem::setExecProgramParams(const QString &execProgramParams)
+{
+    _execProgramParamsId = KAlarmStringPool::intern(execProgramParams);
+}
+
+quint32 KAlarmItem::execProgramParamsId() const
+{
+    return _execProgramParamsId;
+}
+
+KAlarmItem::KPriority KAlarmItem::priority() const
+{
+    return _priority;
+}
+
+void KAlarmItem::setPriority(KAlarmItem::KPriority priority)
+{
+    _priority = priority;
+}
+
+QString KAlarmItem::group() const
+{
+    return _group;
+}
+
+void KAlarmItem::setGroup(const QString &group)
+{
+    _group = group;
+}
+
+QString KAlarmItem::calendar() const
+{
+    return _calendar;
+}
+
+void KAlarmItem::setCalendar(const QString &calendar)
+{
+    _calendar = calendar;
+}
+
+void KAlarmItem::saveAlarm(int index) const
+{
+    QSettings settings;
+
+    saveAlarm(settings, index);
+}
+
+void KAlarmItem::loadAlarm(int index)
+{
+    QSettings settings;
+
+    loadAlarm(settings, index);
+}
+
+// Save a pooled string to key, or an index of it to key + "Ref"
+static void saveString(QSettings &settings, const QString &key, quint32 id,
+                       KAlarmStringTable *strings)
+{
+    if (!strings)
+    {
+        settings.setValue(key, KAlarmStringPool::string(id));
+        settings.remove(key + "Ref");
+
+        return;
+    }
+
+    settings.setValue(key + "Ref", strings->insert(id));
+    settings.remove(key);
+}
+
+// Old versions save a string itself, and some of them misspell a key
+static quint32 loadString(QSettings &settings, const QString &key,
+                          const KAlarmStringTable *strings,
+                          const QString &oldKey = QString())
+{
+    if (strings && settings.contains(key + "Ref"))
+        return strings->id(settings.value(key + "Ref").toInt());
+
+    if (!oldKey.isEmpty() && !settings.contains(key))
+        return KAlarmStringPool::intern(settings.value(oldKey).toString());
+
+    return KAlarmStringPool::intern(settings.value(key).toString());
+}
+
+void KAlarmItem::saveAlarm(QSettings &settings, int index,
+                           KAlarmStringTable *strings) const
+{
+    QString widgetId(QString("Widget%1").arg(index));
+
+    settings.beginGroup(widgetId);
+    settings.setValue("Id", id());
+    settings.setValue("AlarmEnabled", isAlarmEnabled());
+    settings.setValue("Name", name());
+    settings.setValue("StartTime", startTime());
+    settings.setValue("AlarmType", alarmType());
+    settings.setValue("IntervalTime", intervalTime());
+
+    settings.beginGroup("Weekdays");
+    for (int day = 1; day <= 7; ++day)
+        settings.setValue(QString::number(day),
+                          isWeekDayEnabled(numToWeekDay(day)));
+    settings.endGroup();
+
+    settings.setValue("ShowAlarmWindow", showAlarmWindow());
+    settings.setValue("PlaySound", playSound());
+    saveString(settings, "SoundFile", _soundFileId, strings);
+    settings.setValue("ExecuteProgram", execProgram());
+    saveString(settings, "ExecuteProgramName", _execProgramNameId, strings);
+    saveString(settings, "ExecuteProgramParameters", _execProgramParamsId,
+               strings);
+    settings.remove("ExcuteProgramParameters");
+    settings.setValue("Priority", priority());
+    settings.setValue("Group", group());
+    settings.setValue("Calendar", calendar());
+    settings.endGroup();
+}
+
+void KAlarmItem::loadAlarm(QSettings &settings, int index,
+                           const KAlarmStringTable *strings)
+{
+    QString widgetId(QString("Widget%1").arg(index));
+
+    settings.beginGroup(widgetId);
+
+    // Alarms saved by old versions have no id
+    quint32 alarmId = settings.value("Id").toUInt();
+    setId(alarmId ? alarmId : newId());
+
+    setAlarmEnabled(settings.value("AlarmEnabled").toBool());
+    setName(settings.value("Name").toString());
+    setStartTime(settings.value("StartTime").toTime());
+    setIntervalTime(settings.value("IntervalTime").toTime());
+
+    settings.beginGroup("Weekdays");
+    for (int day = 1; day <= 7; ++day)
+        setWeekDayEnabled(numToWeekDay(day),
+                          settings.value(QString::number(day)).toBool());
+    settings.endGroup();
+
+    setAlarmType(static_cast<KAlarmType>(settings.value("AlarmType").toInt()));
+    setShowAlarmWindow(settings.value("ShowAlarmWindow").toBool());
+    setPlaySound(settings.value("PlaySound").toBool());
+    _soundFileId = loadString(settings, "SoundFile", strings);
+    setExecProgram(settings.value("ExecuteProgram").toBool());
+    _execProgramNameId = loadString(settings, "ExecuteProgramName", strings);
+    _execProgramParamsId = loadString(settings, "ExecuteProgramParameters",
+                                      strings, "ExcuteProgramParameters");
+    setPriority(static_cast<KPriority>(
+                    settings.value("Priority", NormalPriority).toInt()));
+    setGroup(settings.value("Group").toString());
+    setCalendar(settings.value("Calendar").toString());
+    settings.endGroup();
+}
+
+QDataStream &operator<<(QDataStream &out, const KAlarmItem &item)
+{
+    quint8 weekDays = 0;
+    for (int day = KAlarmItem::FirstDay; day <= KAlarmItem::LastDay; ++day)
+        if (item.isWeekDayEnabled(static_cast<KAlarmItem::KWeekDay>(day)))
+            weekDays |= 1 << day;
+
+    out << item.id()
+        << item.isAlarmEnabled()
+        << item.name()
+        << item.startTime()
+        << static_cast<qint32>(item.alarmType())
+        << item.intervalTime()
+        << weekDays
+        << item.showAlarmWindow()
+        << item.playSound()
+        << item.soundFile()
+        << item.execProgram()
+        << item.execProgramName()
+        << item.execProgramParams()
+        << static_cast<qint32>(item.priority())
+        << item.group()
+        << item.calendar();
+
+    return out;
+}
+
+QDataStream &operator>>(QDataStream &in, KAlarmItem &item)
+{
+    return readAlarmItem(in, item, 3);
+}
+
+QDataStream &readAlarmItem(QDataStream &in, KAlarmItem &item, int version)
+{
+    quint32 id;
+    bool alarmEnabled;
+    QString name;
+    QTime startTime;
+    qint32 alarmType;
+    QTime intervalTime;
+    quint8 weekDays;
+    bool showAlarmWindow;
+    bool playSound;
+    QString soundFile;
+    bool execProgram;
+    QString execProgramName;
+    QString execProgramParams;
+    qint32 priority;
+    QString group;
+    QString calendar;
+
+    in >> id >> alarmEnabled >> name >> startTime >> alarmType
+       >> intervalTime >> weekDays >> showAlarmWindow >> playSound
+       >> soundFile >> execProgram >> execProgramName >> execProgramParams
+       >> priority;
+
+    if (version >= 2)
+        in >> group;
+
+    if (version >= 3)
+        in >> calendar;
+
+    item.setId(id);
+    item.setAlarmEnabled(alarmEnabled);
+    item.setName(name);
+    item.setStartTime(startTime);
+    item.setAlarmType(static_cast<KAlarmItem::KAlarmType>(alarmType));
+    item.setIntervalTime(intervalTime);
+    for (int day = KAlarmItem::FirstDay; day <= KAlarmItem::LastDay; ++day)
+        item.setWeekDayEnabled(static_cast<KAlarmItem::KWeekDay>(day),
+                               weekDays & (1 << day));
+    item.setShowAlarmWindow(showAlarmWindow);
+    item.setPlaySound(playSound);
+    item.setSoundFile(soundFile);
+    item.setExecProgram(execProgram);
+    item.setExecProgramName(execProgramName);
+    item.setExecProgramParams(execProgramParams);
+    item.setPriority(static_cast<KAlarmItem::KPriority>(priority));
+    item.setGroup(group);
+    item.setCalendar(calendar);
+
+    return in;
+}
@@ -0,0 +1,179 @@
+/****************************************************************************
+**
+** KAlarmItem, alarm data shared by KAlarm and KAlarmQueue
+**
+** Copyright (C) 2015 by KO Myung-Hun
+** All rights reserved.
+** Contact: KO Myung-Hun (komh@chollian.net)
+**
+** This file is part of K Alarm
+**
+** $BEGIN_LICENSE$
+**
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** $END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef KALARMITEM_H
+#define KALARMITEM_H
+
+#include <QtCore>
+
+#include "kalarmstringpool.h"
+
+/*
+ * KAlarmItem holds alarm data only. It does not depend on any widget, so it
+ * can be copied to and used in a scheduler thread.
+ */
+class KAlarmItem
+{
+public:
+    KAlarmItem();
+
+    enum KAlarmType
+    {
+        IntervalAlarm = 0,
+        WeeklyAlarm,
+        SingleShotAlarm
+    };
+
+    enum KWeekDay
+    {
+        FirstDay = 0,
+        Monday = 0,
+        Tuesday,
+        Wednesday,
+        Thursday,
+        Friday,
+        Saturday,
+        Sunday,
+        LastDay = Sunday
+    };
+
+    /* Higher priority alarms are presented first when alarms are crowded */
+    enum KPriority
+    {
+        LowPriority = 0,
+        NormalPriority,
+        HighPriority,
+        CriticalPriority
+    };
+
+    /* An id identifies an alarm across threads and sessions */
+    quint32 id() const;
+    void setId(quint32 id);
+
+    static quint32 newId();
+
+    bool isAlarmEnabled() const;
+    void setAlarmEnabled(bool enabled);
+
+    QString name() const;
+    void setName(const QString &name);
+
+    QTime startTime() const;
+    void setStartTime(const QTime &startTime);
+
+    KAlarmType alarmType() const;
+    void setAlarmType(const KAlarmType &alarmType);
+
+    QTime intervalTime() const;
+    void setIntervalTime(const QTime &intervalTime);
+
+    bool isWeekDayEnabled(KWeekDay weekDay) const;
+    void setWeekDayEnabled(KWeekDay weekDay, bool enabled);
+
+    static KWeekDay numToWeekDay(int n);
+
+    bool showAlarmWindow() const;
+    void setShowAlarmWindow(bool show);
+
+    bool playSound() const;
+    void setPlaySound(bool play);
+
+    QString soundFile() const;
+    void setSoundFile(const QString &file);
+    quint32 soundFileId() const;    // in KAlarmStringPool
+
+    bool execProgram() const;
+    void setExecProgram(bool execProgram);
+
+    QString execProgramName() const;
+    void setExecProgramName(const QString &execProgramName);
+    quint32 execProgramNameId() const;
+
+    QString execProgramParams() const;
+    void setExecProgramParams(const QString &execProgramParams);
+    quint32 execProgramParamsId() const;
+
+    KPriority priority() const;
+    void setPriority(KPriority priority);
+
+    /* A group of an alarm, or an empty string if not grouped */
+    QString group() const;
+    void setGroup(const QString &group);
+
+    /*
+     * A name of a calendar of days excluded from an alarm, or an empty
+     * string to use a calendar of a group
+     */
+    QString calendar() const;
+    void setCalendar(const QString &calendar);
+
+    void saveAlarm(int index) const;
+    void loadAlarm(int index);
+
+    /*
+     * Save to or load from settings instead of the default settings. With
+     * strings, sound files and programs refer to strings of a store.
+     */
+    void saveAlarm(QSettings &settings, int index,
+                   KAlarmStringTable *strings = 0) const;
+    void loadAlarm(QSettings &settings, int index,
+                   const KAlarmStringTable *strings = 0);
+
+private:
+    quint32 _id;
+    bool _alarmEnabled;
+    QString _name;
+    QTime _startTime;
+    KAlarmType _alarmType;
+    QTime _intervalTime;
+    int _weekDays;  // bit mask of KWeekDay
+
+    bool    _showAlarmWindow;
+    bool    _playSound;
+    quint32 _soundFileId;
+
+    bool    _execProgram;
+    quint32 _execProgramNameId;
+    quint32 _execProgramParamsId;
+
+    KPriority _priority;
+    QString _group;
+    QString _calendar;
+
+    static quint32 _lastId;
+};
+
+/* Serialize all the alarm data including an id */
+QDataStream &operator<<(QDataStream &out, const KAlarmItem &item);
+QDataStream &operator>>(QDataStream &in, KAlarmItem &item);
+
+/*
+ * Read alarm data written in a format of version. A group was added in
+ * version 2, and a calendar in version 3, the current one.
+ */
+QDataStream &readAlarmItem(QDataStream &in, KAlarmItem &item, int version);
+
+Q_DECLARE_METATYPE(KAlarmItem)
+
+#endif // KALARMITEM_H
@@ -26,23 +26,30 @@
 
 KAlarmItemWidget::KAlarmItemWidget(QWidget *parent)
     : QWidget(parent)
-    , _showAlarmWindow(true)
-    , _playSound(false)
-    , _execProgram(false)
 {
+    _item.setId(KAlarmItem::newId());
+
     _alarmEnabledCheck = new QCheckBox;
     _startTimeLabel = new QLabel;
     _alarmConditionLabel = new QLabel;
+    _countdownLabel = new QLabel;
+    _countdownLabel->setAlignment(Qt::AlignRight | Qt::AlignVCenter);
+    _warningLabel = new QLabel;
+    _warningLabel->setPixmap(style()->standardIcon(
+                                 QStyle::SP_MessageBoxWarning).pixmap(16));
+    _warningLabel->hide();
 
     QHBoxLayout *mainLayout = new QHBoxLayout;
     mainLayout->addWidget(_alarmEnabledCheck, 1);
     mainLayout->addWidget(_startTimeLabel, 1);
     mainLayout->addWidget(_alarmConditionLabel, 4);
+    mainLayout->addWidget(_countdownLabel, 1);
+    mainLayout->addWidget(_warningLabel);
 
     setLayout(mainLayout);
 
     connect(_alarmEnabledCheck, SIGNAL(toggled(bool)),
-            this, SIGNAL(alarmEnabledToggled(bool)));
+            this, SLOT(alarmEnabledCheckToggled(bool)));
 }
 
 KAlarmItemWidget::~KAlarmItemWidget()
@@ -50,74 +57,100 @@ KAlarmItemWidget::~KAlarmItemWidget()
 
 }
 
+const KAlarmItem &KAlarmItemWidget::item() const
+{
+    return _item;
+}
+
+quint32 KAlarmItemWidget::id() const
+{
+    return _item.id();
+}
+
 bool KAlarmItemWidget::isAlarmEnabled() const
 {
-    return _alarmEnabledCheck->isChecked();
+    return _item.isAlarmEnabled();
 }
 
 void KAlarmItemWidget::setAlarmEnabled(bool enabled)
 {
     _alarmEnabledCheck->setChecked(enabled);
+
+    // toggled() is not emitted if a state is not changed
+    _item.setAlarmEnabled(enabled);
+}
+
+void KAlarmItemWidget::alarmEnabledCheckToggled(bool checked)
+{
+    _item.setAlarmEnabled(checked);
+
+    emit alarmEnabledToggled(checked);
 }
 
 QString KAlarmItemWidget::name() const
 {
-    return _name;
+    return _item.name();
 }
 
 void KAlarmItemWidget::setName(const QString &name)
 {
-    _name = name;
+    _item.setName(name);
 
-    _alarmEnabledCheck->setText(_name);
+    _alarmEnabledCheck->setText(name);
 }
 
 QTime KAlarmItemWidget::startTime() const
 {
-    return _startTime;
+    return _item.startTime();
 }
 
 void KAlarmItemWidget::setStartTime(const QTime &startTime)
 {
-    _startTime = startTime;
+    _item.setStartTime(startTime);
 
-    _startTimeLabel->setText(_startTime.toString("HH:mm"));
+    _startTimeLabel->setText(startTime.toString("HH:mm"));
 }
 
 KAlarmItemWidget::KAlarmType KAlarmItemWidget::alarmType() const
 {
-    return _alarmType;
+    return _item.alarmType();
 }
 
 /* Should be called after interval time is set and weekdays are enabled */
 void KAlarmItemWidget::setAlarmType(
         const KAlarmItemWidget::KAlarmType &alarmType)
 {
-    _alarmType = alarmType;
+    _item.setAlarmType(alarmType);
 
-    switch (_alarmType)
+    updateAlarmConditionLabel();
+}
+
+void KAlarmItemWidget::updateAlarmConditionLabel()
+{
+    switch (_item.alarmType())
     {
-    case IntervalAlarm:
+    case KAlarmItem::IntervalAlarm:
     {
+        QTime intervalTime(_item.intervalTime());
         QString s;
 
-        if (_intervalTime.hour() != 0)
+        if (intervalTime.hour() != 0)
         {
-            s.append(tr("%1 hour").arg(_intervalTime.toString("H")));
+            s.append(tr("%1 hour").arg(intervalTime.toString("H")));
             s.append(" ");
         }
 
-        if (_intervalTime.minute() != 0)
-            s.append(tr("%1 minute").arg(_intervalTime.toString("m")));
+        if (intervalTime.minute() != 0)
+            s.append(tr("%1 minute").arg(intervalTime.toString("m")));
 
         _alarmConditionLabel->setText(tr("every %1").arg(s));
         break;
     }
-    case WeeklyAlarm:
+    case KAlarmItem::WeeklyAlarm:
         _alarmConditionLabel->setText(weekDaysToString());
         break;
 
-    case SingleShotAlarm:
+    case KAlarmItem::SingleShotAlarm:
     default:
         _alarmConditionLabel->setText(tr("Single shot"));
         break;
@@ -126,49 +159,49 @@ void KAlarmItemWidget::setAlarmType(
 
 QTime KAlarmItemWidget::intervalTime() const
 {
-    return _intervalTime;
+    return _item.intervalTime();
 }
 
 void KAlarmItemWidget::setIntervalTime(const QTime &intervalTime)
 {
-    _intervalTime = intervalTime;
+    _item.setIntervalTime(intervalTime);
 }
 
 bool KAlarmItemWidget::isWeekDayEnabled(KAlarmItemWidget::KWeekDay weekDay)
         const
 {
-    return _weekDaysMap.value(weekDay);
+    return _item.isWeekDayEnabled(weekDay);
 }
 
 void KAlarmItemWidget::setWeekDayEnabled(KAlarmItemWidget::KWeekDay weekDay,
                                          bool enabled)
 {
-    _weekDaysMap.insert(weekDay, enabled);
+    _item.setWeekDayEnabled(weekDay, enabled);
 }
 
 QString KAlarmItemWidget::weekDaysToString() const
 {
     QString s;
 
-    if (isWeekDayEnabled(Monday))
+    if (isWeekDayEnabled(KAlarmItem::Monday))
         s.append(tr("Mon")).append(" ");
 
-    if (isWeekDayEnabled(Tuesday))
+    if (isWeekDayEnabled(KAlarmItem::Tuesday))
         s.append(tr("Tue")).append(" ");
 
-    if (isWeekDayEnabled(Wednesday))
+    if (isWeekDayEnabled(KAlarmItem::Wednesday))
         s.append(tr("Wed")).append(" ");
 
-    if (isWeekDayEnabled(Thursday))
+    if (isWeekDayEnabled(KAlarmItem::Thursday))
         s.append(tr("Thu")).append(" ");
 
-    if (isWeekDayEnabled(Friday))
+    if (isWeekDayEnabled(KAlarmItem::Friday))
         s.append(tr("Fri")).append(" ");
 
-    if (isWeekDayEnabled(Saturday))
+    if (isWeekDayEnabled(KAlarmItem::Saturday))
         s.append(tr("Sat")).append(" ");
 
-    if (isWeekDayEnabled(Sunday))
+    if (isWeekDayEnabled(KAlarmItem::Sunday))
         s.append(tr("Sun"));
 
     return s;
@@ -176,118 +209,171 @@ QString KAlarmItemWidget::weekDaysToString() const
 
 KAlarmItemWidget::KWeekDay KAlarmItemWidget::numToWeekDay(int n)
 {
-    // 1 to Monday
-    // ...
-    // 7 to Sunday
-    return static_cast<KWeekDay>(n - 1);
+    return KAlarmItem::numToWeekDay(n);
 }
+
 bool KAlarmItemWidget::showAlarmWindow() const
 {
-    return _showAlarmWindow;
+    return _item.showAlarmWindow();
 }
 
 void KAlarmItemWidget::setShowAlarmWindow(bool show)
 {
-    _showAlarmWindow = show;
+    _item.setShowAlarmWindow(show);
 }
+
 bool KAlarmItemWidget::playSound() const
 {
-    return _playSound;
+    return _item.playSound();
 }
 
 void KAlarmItemWidget::setPlaySound(bool play)
 {
-    _playSound = play;
+    _item.setPlaySound(play);
 }
+
 QString KAlarmItemWidget::soundFile() const
 {
-    return _soundFile;
+    return _item.soundFile();
 }
 
 void KAlarmItemWidget::setSoundFile(const QString &file)
 {
-    _soundFile = file;
+    _item.setSoundFile(file);
 }
+
 bool KAlarmItemWidget::execProgram() const
 {
-    return _execProgram;
+    return _item.execProgram();
 }
 
 void KAlarmItemWidget::setExecProgram(bool execProgram)
 {
-    _execProgram = execProgram;
+    _item.setExecProgram(execProgram);
 }
+
 QString KAlarmItemWidget::execProgramName() const
 {
-    return _execProgramName;
+    return _item.execProgramName();
 }
 
 void KAlarmItemWidget::setExecProgramName(const QString &execProgramName)
 {
-    _execProgramName = execProgramName;
+    _item.setExecProgramName(execProgramName);
 }
+
 QString KAlarmItemWidget::execProgramParams() const
 {
-    return _execProgramParams;
+    return _item.execProgramParams();
 }
 
 void KAlarmItemWidget::setExecProgramParams(const QString &execProgramParams)
 {
-    _execProgramParams = execProgramParams;
+    _item.setExecProgramParams(execProgramParams);
+}
+
+KAlarmItemWidget::KPriority KAlarmItemWidget::priority() const
+{
+    return _item.priority();
+}
+
+void KAlarmItemWidget::setPriority(KPriority priority)
+{
+    _item.setPriority(priority);
+}
+
+QString KAlarmItemWidget::group() const
+{
+    return _item.group();
+}
+
+void KAlarmItemWidget::setGroup(const QString &group)
+{
+    _item.setGroup(group);
+}
+
+QString KAlarmItemWidget::calendar() const
+{
+    return _item.calendar();
+}
+
+void KAlarmItemWidget::setCalendar(const QString &calendar)
+{
+    _item.setCalendar(calendar);
 }
 
 void KAlarmItemWidget::saveAlarm(int index) const
 {
-    QString widgetId(QString("Widget%1").arg(index));
+    _item.saveAlarm(index);
+}
+
+void KAlarmItemWidget::setWarning(const QString &warning)
+{
+    _warningLabel->setToolTip(warning);
+    _warningLabel->setVisible(!warning.isEmpty());
+}
+
+QDateTime KAlarmItemWidget::nextAlarm() const
+{
+    return _nextAlarm;
+}
+
+void KAlarmItemWidget::setNextAlarm(const QDateTime &next)
+{
+    _nextAlarm = next;
+}
+
+bool KAlarmItemWidget::updateCountdown(const QDateTime &now)
+{
+    QString text;
+
+    if (now.isValid() && _item.isAlarmEnabled())
+        text = countdownText(now, _nextAlarm);
+
+    if (text == _countdownLabel->text())
+        return false;
+
+    _countdownLabel->setText(text);
+
+    return true;
+}
 
-    QSettings settings;
+QString KAlarmItemWidget::countdownText(const QDateTime &now,
+                                        const QDateTime &next)
+{
+    if (!next.isValid() || next < now)
+        return QString();
+
+    // Round up, so that an alarm in 30 seconds is in 1 minute
+    qint64 minutes = (now.msecsTo(next) + 59999) / 60000;
+    qint64 hours = minutes / 60;
+    qint64 days = hours / 24;
 
-    settings.beginGroup(widgetId);
-    settings.setValue("AlarmEnabled", isAlarmEnabled());
-    settings.setValue("Name", name());
-    settings.setValue("StartTime", startTime());
-    settings.setValue("AlarmType", alarmType());
-    settings.setValue("IntervalTime", intervalTime());
+    if (days > 0)
+        return tr("in %1d %2h").arg(days).arg(hours % 24);
 
-    settings.beginGroup("Weekdays");
-    for (int day = 1; day <= 7; ++day)
-        settings.setValue(QString::number(day),
-                          isWeekDayEnabled(numToWeekDay(day)));
-    settings.endGroup();
+    if (hours > 0)
+        return tr("in %1h %2m").arg(hours).arg(minutes % 60);
 
-    settings.setValue("ShowAlarmWindow", showAlarmWindow());
-    settings.setValue("PlaySound", playSound());
-    settings.setValue("SoundFile", soundFile());
-    settings.setValue("ExecuteProgram", execProgram());
-    settings.setValue("ExecuteProgramName", execProgramName());
-    settings.setValue("ExcuteProgramParameters", execProgramParams());
-    settings.endGroup();
+    return tr("in %1m").arg(minutes);
 }
 
 void KAlarmItemWidget::loadAlarm(int index)
 {
-    QString widgetId(QString("Widget%1").arg(index));
-
-    QSettings settings;
-
-    settings.beginGroup(widgetId);
-    setAlarmEnabled(settings.value("AlarmEnabled").toBool());
-    setName(settings.value("Name").toString());
-    setStartTime(settings.value("StartTime").toTime());
-    setIntervalTime(settings.value("IntervalTime").toTime());
-
-    settings.beginGroup("Weekdays");
-    for (int day = 1; day <= 7; ++day)
-        setWeekDayEnabled(numToWeekDay(day),
-                          settings.value(QString::number(day)).toBool());
-    settings.endGroup();
-
-    setAlarmType(static_cast<KAlarmType>(settings.value("AlarmType").toInt()));
-    setShowAlarmWindow(settings.value("ShowAlarmWindow").toBool());
-    setPlaySound(settings.value("PlaySound").toBool());
-    setSoundFile(settings.value("SoundFile").toString());
-    setExecProgram(settings.value("ExecuteProgram").toBool());
-    setExecProgramName(settings.value("ExecuteProgramName").toString());
-    setExecProgramParams(settings.value("ExecuteProgramParameters").toString());
-    settings.endGroup();
+    KAlarmItem item;
+
+    item.loadAlarm(index);
+
+    setItem(item);
+}
+
+void KAlarmItemWidget::setItem(const KAlarmItem &item)
+{
+    _item = item;
+
+    // Update child widgets
+    _alarmEnabledCheck->setChecked(_item.isAlarmEnabled());
+    _alarmEnabledCheck->setText(_item.name());
+    _startTimeLabel->setText(_item.startTime().toString("HH:mm"));
+    updateAlarmConditionLabel();
 }
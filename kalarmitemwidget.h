@@ -34,6 +34,8 @@
 #include <QtGui>
 #endif
 
+#include "kalarmitem.h"
+
 class KAlarmItemWidget : public QWidget
 {
     Q_OBJECT
@@ -41,6 +43,15 @@ public:
     explicit KAlarmItemWidget(QWidget *parent = 0);
     ~KAlarmItemWidget();
 
+    typedef KAlarmItem::KAlarmType KAlarmType;
+    typedef KAlarmItem::KWeekDay KWeekDay;
+    typedef KAlarmItem::KPriority KPriority;
+
+    /* Alarm data of this widget */
+    const KAlarmItem &item() const;
+
+    quint32 id() const;
+
     bool isAlarmEnabled() const;
     void setAlarmEnabled(bool enabled);
 
@@ -50,26 +61,6 @@ public:
     QTime startTime() const;
     void setStartTime(const QTime &startTime);
 
-    enum KAlarmType
-    {
-        IntervalAlarm = 0,
-        WeeklyAlarm,
-        SingleShotAlarm
-    };
-
-    enum KWeekDay
-    {
-        FirstDay = 0,
-        Monday = 0,
-        Tuesday,
-        Wednesday,
-        Thursday,
-        Friday,
-        Saturday,
-        Sunday,
-        LastDay = Sunday
-    };
-
     KAlarmType alarmType() const;
     /* Should be called after interval time is set and weekdays are enabled */
     void setAlarmType(const KAlarmType &alarmType);
@@ -102,32 +93,55 @@ public:
     QString execProgramParams() const;
     void setExecProgramParams(const QString &execProgramParams);
 
+    KPriority priority() const;
+    void setPriority(KPriority priority);
+
+    QString group() const;
+    void setGroup(const QString &group);
+
+    QString calendar() const;
+    void setCalendar(const QString &calendar);
+
     void saveAlarm(int index) const;
     void loadAlarm(int index);
 
+    /* Replace alarm data of this widget */
+    void setItem(const KAlarmItem &item);
+
+    /* Show a warning icon with warning, or hide it if empty */
+    void setWarning(const QString &warning);
+
+    /* The next alarm time, shown as a countdown */
+    QDateTime nextAlarm() const;
+    void setNextAlarm(const QDateTime &next);
+
+    /*
+     * Update a countdown to now. An invalid now hides a countdown. Returns
+     * false if a text is not changed, so that a label is not repainted.
+     */
+    bool updateCountdown(const QDateTime &now);
+
+    /* "in 3h 12m" from now to next, or an empty string if passed */
+    static QString countdownText(const QDateTime &now, const QDateTime &next);
+
 signals:
     void alarmEnabledToggled(bool checked);
 
 private:
-    QCheckBox *_alarmEnabledCheck;
-    QString _name;
+    KAlarmItem _item;
 
+    QCheckBox *_alarmEnabledCheck;
     QLabel *_startTimeLabel;
-    QTime _startTime;
-
     QLabel *_alarmConditionLabel;
-    KAlarmType _alarmType;
+    QLabel *_countdownLabel;
+    QLabel *_warningLabel;
 
-    QTime _intervalTime;
-    QMap<KWeekDay, bool> _weekDaysMap;
+    QDateTime _nextAlarm;
 
-    bool    _showAlarmWindow;
-    bool    _playSound;
-    QString _soundFile;
+    void updateAlarmConditionLabel();
 
-    bool    _execProgram;
-    QString _execProgramName;
-    QString _execProgramParams;
+private slots:
+    void alarmEnabledCheckToggled(bool checked);
 };
 
 #endif // KALARMITEMWIDGET_H
@@ -0,0 +1,463 @@
+/****************************************************************************
+**
+** KAlarmJournal, an append-only journal of alarm mutations
+**
+** Copyright (C) 2015 by KO Myung-Hun
+** All rights reserved.
+** Contact: KO Myung-Hun (komh@chollian.net)
+**
+** This file is part of K Alarm.
+**
+** $BEGIN_LICENSE$
+**
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** $END_LICENSE$
+**
+****************************************************************************/
+
+#include "kalarmjournal.h"
+#include "kalarmwatchdog.h"
+#include "kalarmmetricsserver.h"
+
+#include <QElapsedTimer>
+#include <QTextStream>
+
+#include <cstring>
+
+// Written at the beginning of a journal. Changed when a format of an alarm
+// is changed. Journals of old formats are still read.
+static const char journalMagic[] = "KAJ3";
+static const int journalMagicSize = 4;
+static const int journalVersion = 3;
+
+/* A version of an alarm format of data, or 0 if not a journal */
+static int formatVersion(const QByteArray &data)
+{
+    static const char *const magics[] = { "KAJ1", "KAJ2", journalMagic };
+
+    if (data.size() < journalMagicSize)
+        return 0;
+
+    for (int i = 0; i < journalVersion; ++i)
+    {
+        if (!memcmp(data.constData(), magics[i], journalMagicSize))
+            return i + 1;
+    }
+
+    return 0;
+}
+
+// A record starts with a size and a checksum of its payload
+static const int recordHeaderSize = sizeof(quint32) + sizeof(quint16);
+
+KAlarmJournal::KAlarmJournal(const QString &fileName)
+    : _fileName(fileName)
+    , _file(fileName)
+    , _recordCount(0)
+    , _appendCount(0)
+    , _appendBytes(0)
+    , _appendNSecs(0)
+    , _snapshotCount(0)
+    , _lastSnapshotMSecs(0)
+    , _replayCount(0)
+    , _replayMSecs(0)
+{
+}
+
+KAlarmJournal::~KAlarmJournal()
+{
+    _file.close();
+}
+
+void KAlarmJournal::setFileName(const QString &fileName)
+{
+    _file.close();
+
+    _fileName = fileName;
+    _file.setFileName(fileName);
+    _recordCount = 0;
+}
+
+int KAlarmJournal::replay(QList<KAlarmItem> *items)
+{
+    KAlarmActivityScope activity("KAlarmJournal::replay()");
+
+    QElapsedTimer timer;
+    timer.start();
+
+    _file.close();
+
+    if (!_file.open(QIODevice::ReadWrite))
+        return 0;
+
+    QByteArray data(_file.readAll());
+    int version = formatVersion(data);
+
+    if (version == 0)
+    {
+        // Killed before a header was written. Start over, so that records
+        // are appended after a header.
+        if (data.size() < journalMagicSize)
+        {
+            _file.resize(0);
+            _file.close();
+
+            return 0;
+        }
+
+        _file.close();
+
+        qWarning("KAlarmJournal: %s is not a journal, and is moved to %s.bad",
+                 qPrintable(_fileName), qPrintable(_fileName));
+
+        QFile::remove(_fileName + ".bad");
+        QFile::rename(_fileName, _fileName + ".bad");
+
+        return 0;
+    }
+
+    int pos;
+    int applied = applyRecords(data, items, &pos, version);
+
+    // Discard a torn record, so that records are appended after valid ones
+    if (pos < data.size())
+        _file.resize(pos);
+
+    _file.close();
+
+    // Records of an old format are kept aside until they are written to a
+    // snapshot, and new records are appended to a new journal
+    if (version < journalVersion)
+    {
+        qWarning("KAlarmJournal: %s of an old format is moved to %s.old",
+                 qPrintable(_fileName), qPrintable(_fileName));
+
+        QFile::remove(_fileName + ".old");
+        QFile::rename(_fileName, _fileName + ".old");
+    }
+
+    _recordCount = applied;
+    _replayCount = applied;
+    _replayMSecs = timer.elapsed();
+
+    return applied;
+}
+
+int KAlarmJournal::read(QList<KAlarmItem> *items) const
+{
+    KAlarmActivityScope activity("KAlarmJournal::read()");
+
+    QFile file(_fileName);
+
+    if (!file.open(QIODevice::ReadOnly))
+        return 0;
+
+    return read(file.readAll(), items);
+}
+
+int KAlarmJournal::read(const QByteArray &data,
+                        QList<KAlarmItem> *items) const
+{
+    int version = formatVersion(data);
+
+    if (version == 0)
+        return 0;
+
+    int pos;
+
+    return applyRecords(data, items, &pos, version);
+}
+
+int KAlarmJournal::applyRecords(const QByteArray &data,
+                                QList<KAlarmItem> *items, int *end,
+                                int version) const
+{
+    QHash<quint32, int> indexes;
+    for (int i = 0; i < items->size(); ++i)
+        indexes.insert(items->at(i).id(), i);
+
+    int applied = 0;
+    int pos = journalMagicSize;
+
+    while (pos + recordHeaderSize <= data.size())
+    {
+        QDataStream header(data.mid(pos, recordHeaderSize));
+        quint32 size;
+        quint16 checksum;
+
+        header >> size >> checksum;
+
+        if (size > static_cast<quint32>(data.size() - pos - recordHeaderSize))
+            break;
+
+        const char *payload = data.constData() + pos + recordHeaderSize;
+
+        if (qChecksum(payload, size) != checksum)
+            break;
+
+        QDataStream in(QByteArray::fromRawData(payload, size));
+        in.setVersion(QDataStream::Qt_4_6);
+
+        apply(in, items, &indexes, version);
+
+        ++applied;
+        pos += recordHeaderSize + size;
+    }
+
+    *end = pos;
+
+    if (indexes.size() < items->size())
+    {
+        QList<KAlarmItem> alive;
+
+        foreach (const KAlarmItem &item, *items)
+        {
+            if (item.id() != 0)
+                alive.append(item);
+        }
+
+        *items = alive;
+    }
+
+    return applied;
+}
+
+void KAlarmJournal::apply(QDataStream &in, QList<KAlarmItem> *items,
+                          QHash<quint32, int> *indexes, int version) const
+{
+    quint8 type;
+
+    in >> type;
+
+    if (type == BatchRecord)
+    {
+        quint32 count;
+
+        in >> count;
+
+        for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i)
+            apply(in, items, indexes, version);
+
+        return;
+    }
+
+    quint32 id;
+
+    in >> id;
+
+    if (type == PutRecord)
+    {
+        KAlarmItem item;
+
+        readAlarmItem(in, item, version);
+
+        QHash<quint32, int>::const_iterator it = indexes->constFind(id);
+
+        if (it != indexes->constEnd())
+            (*items)[it.value()] = item;
+        else
+        {
+            indexes->insert(id, items->size());
+            items->append(item);
+        }
+    }
+    else if (type == RemoveRecord)
+    {
+        // Removed items are marked with an id of 0, and dropped later
+        int index = indexes->value(id, -1);
+
+        if (index != -1)
+        {
+            (*items)[index].setId(0);
+
+            indexes->remove(id);
+        }
+    }
+}
+
+void KAlarmJournal::put(const KAlarmItem &item)
+{
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_4_6);
+
+    out << static_cast<quint8>(PutRecord) << item.id() << item;
+
+    append(payload);
+}
+
+void KAlarmJournal::remove(quint32 id)
+{
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_4_6);
+
+    out << static_cast<quint8>(RemoveRecord) << id;
+
+    append(payload);
+}
+
+void KAlarmJournal::put(const QList<KAlarmItem> &items)
+{
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_4_6);
+
+    out << static_cast<quint8>(BatchRecord)
+        << static_cast<quint32>(items.size());
+
+    foreach (const KAlarmItem &item, items)
+        out << static_cast<quint8>(PutRecord) << item.id() << item;
+
+    append(payload, items.size());
+}
+
+void KAlarmJournal::remove(const QList<quint32> &ids)
+{
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_4_6);
+
+    out << static_cast<quint8>(BatchRecord)
+        << static_cast<quint32>(ids.size());
+
+    foreach (quint32 id, ids)
+        out << static_cast<quint8>(RemoveRecord) << id;
+
+    append(payload, ids.size());
+}
+
+void KAlarmJournal::reset(qint64 snapshotMSecs)
+{
+    _file.close();
+
+    if (_file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        _file.write(journalMagic, journalMagicSize);
+        _file.close();
+    }
+
+    // Records of an old format are in a snapshot now
+    QFile::remove(_fileName + ".old");
+
+    _recordCount = 0;
+
+    ++_snapshotCount;
+    _lastSnapshotMSecs = snapshotMSecs;
+    _lastSnapshotTime = QDateTime::currentDateTime();
+}
+
+int KAlarmJournal::recordCount() const
+{
+    return _recordCount;
+}
+
+QString KAlarmJournal::summary() const
+{
+    QString s;
+    QTextStream out(&s);
+
+    out << tr("Journal: %1").arg(_fileName) << "\n";
+    out << tr("Records since the last snapshot: %1").arg(_recordCount)
+        << "\n";
+    out << tr("Appended records: %1, %2 bytes").arg(_appendCount)
+                                                .arg(_appendBytes) << "\n";
+    out << tr("Replayed records at start-up: %1 in %2 ms")
+           .arg(_replayCount).arg(_replayMSecs) << "\n";
+    out << tr("Snapshots: %1").arg(_snapshotCount) << "\n";
+
+    if (_lastSnapshotTime.isValid())
+        out << tr("Last snapshot: %1, %2 ms")
+               .arg(_lastSnapshotTime.toString("yyyy-MM-dd HH:mm:ss"))
+               .arg(_lastSnapshotMSecs) << "\n";
+
+    return s;
+}
+
+void KAlarmJournal::writeMetrics(QTextStream &out) const
+{
+    KAlarmMetricsServer::writeHeader(out, "kalarm_journal_appends_total",
+                                     "counter",
+                                     "Records appended to a journal.");
+    out << "kalarm_journal_appends_total " << _appendCount << "\n";
+
+    KAlarmMetricsServer::writeHeader(out, "kalarm_journal_append_bytes_total",
+                                     "counter",
+                                     "Bytes appended to a journal.");
+    out << "kalarm_journal_append_bytes_total " << _appendBytes << "\n";
+
+    KAlarmMetricsServer::writeHeader(out,
+                                     "kalarm_journal_append_seconds_total",
+                                     "counter",
+                                     "Time spent appending to a journal.");
+    out << "kalarm_journal_append_seconds_total " << _appendNSecs / 1e9
+        << "\n";
+
+    KAlarmMetricsServer::writeHeader(out, "kalarm_journal_records", "gauge",
+                                     "Records since the last snapshot.");
+    out << "kalarm_journal_records " << _recordCount << "\n";
+
+    KAlarmMetricsServer::writeHeader(out, "kalarm_snapshots_total", "counter",
+                                     "Snapshots written to settings.");
+    out << "kalarm_snapshots_total " << _snapshotCount << "\n";
+
+    KAlarmMetricsServer::writeHeader(out,
+                                     "kalarm_snapshot_last_duration_seconds",
+                                     "gauge",
+                                     "Time taken to write the last "
+                                     "snapshot.");
+    out << "kalarm_snapshot_last_duration_seconds "
+        << _lastSnapshotMSecs / 1000.0 << "\n";
+}
+
+bool KAlarmJournal::open()
+{
+    if (_file.isOpen())
+        return true;
+
+    if (!_file.open(QIODevice::WriteOnly | QIODevice::Append))
+    {
+        qWarning("KAlarmJournal: Cannot open %s", qPrintable(_fileName));
+
+        return false;
+    }
+
+    if (_file.size() == 0)
+        _file.write(journalMagic, journalMagicSize);
+
+    return true;
+}
+
+void KAlarmJournal::append(const QByteArray &payload, int count)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    if (!open())
+        return;
+
+    QByteArray record;
+    QDataStream out(&record, QIODevice::WriteOnly);
+
+    out << static_cast<quint32>(payload.size())
+        << qChecksum(payload.constData(), payload.size());
+
+    record.append(payload);
+
+    // Flush to an operating system, so that a record survives even if K
+    // Alarm is killed. Not synced to a disk, which is left to a system.
+    _file.write(record);
+    _file.flush();
+
+    _recordCount += count;
+    ++_appendCount;
+    _appendBytes += record.size();
+    _appendNSecs += timer.nsecsElapsed();
+}
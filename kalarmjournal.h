@@ -0,0 +1,134 @@
+/****************************************************************************
+**
+** KAlarmJournal, an append-only journal of alarm mutations
+**
+** Copyright (C) 2015 by KO Myung-Hun
+** All rights reserved.
+** Contact: KO Myung-Hun (komh@chollian.net)
+**
+** This file is part of K Alarm.
+**
+** $BEGIN_LICENSE$
+**
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** $END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef KALARMJOURNAL_H
+#define KALARMJOURNAL_H
+
+#include <QCoreApplication>
+#include <QFile>
+#include <QDataStream>
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QDateTime>
+
+#include "kalarmitem.h"
+
+class QTextStream;
+
+/*
+ * KAlarmJournal records mutations of alarms after the last snapshot in
+ * settings. Each mutation is appended as a record with a checksum, and
+ * flushed to an operating system. So a mutation costs one append, and is
+ * not lost even if K Alarm is killed. A snapshot is written periodically,
+ * and then a journal is reset.
+ */
+class KAlarmJournal
+{
+    Q_DECLARE_TR_FUNCTIONS(KAlarmJournal)
+
+public:
+    explicit KAlarmJournal(const QString &fileName);
+    ~KAlarmJournal();
+
+    /* Switch to another journal. Records are not carried over */
+    void setFileName(const QString &fileName);
+
+    /*
+     * Apply records to items loaded from the last snapshot. A torn record
+     * at the end, written when K Alarm was killed, is discarded. Returns
+     * the number of records applied.
+     */
+    int replay(QList<KAlarmItem> *items);
+
+    /*
+     * Apply records to items like replay(), but leave a journal as it is,
+     * so that a journal written by another process can be read
+     */
+    int read(QList<KAlarmItem> *items) const;
+
+    /* Apply records of data, read from a journal by a caller, to items */
+    int read(const QByteArray &data, QList<KAlarmItem> *items) const;
+
+    /* Record that item is added or modified */
+    void put(const KAlarmItem &item);
+
+    /* Record that an alarm of id is removed */
+    void remove(quint32 id);
+
+    /* Record many mutations as one record, which is applied all or none */
+    void put(const QList<KAlarmItem> &items);
+    void remove(const QList<quint32> &ids);
+
+    /*
+     * Should be called after a snapshot is written. snapshotMSecs is the
+     * time taken to write it
+     */
+    void reset(qint64 snapshotMSecs);
+
+    /* Records since the last snapshot */
+    int recordCount() const;
+
+    /* Persistence statistics */
+    QString summary() const;
+
+    /* Write metrics in Prometheus text format */
+    void writeMetrics(QTextStream &out) const;
+
+private:
+    enum KRecordType
+    {
+        PutRecord = 1,
+        RemoveRecord,
+        BatchRecord     // count of records, then records without a size
+    };
+
+    QString _fileName;
+    QFile _file;
+    int _recordCount;
+
+    qint64 _appendCount;
+    qint64 _appendBytes;
+    qint64 _appendNSecs;
+    qint64 _snapshotCount;
+    qint64 _lastSnapshotMSecs;
+    QDateTime _lastSnapshotTime;
+    int _replayCount;
+    qint64 _replayMSecs;
+
+    bool open();
+
+    /*
+     * Apply valid records of data, whose alarms are in a format of
+     * version, to items. Returns the number of records applied, and an end
+     * of them in end.
+     */
+    int applyRecords(const QByteArray &data, QList<KAlarmItem> *items,
+                     int *end, int version) const;
+    void apply(QDataStream &in, QList<KAlarmItem> *items,
+               QHash<quint32, int> *indexes, int version) const;
+    void append(const QByteArray &payload, int count = 1);
+};
+
+#endif // KALARMJOURNAL_H
@@ -0,0 +1,106 @@
+/****************************************************************************
+**
+** KAlarmListItem, a sortable list widget item for KAlarm
+**
+** Copyright (C) 2015 by KO Myung-Hun
+** All rights reserved.
+** Contact: KO Myung-Hun (komh@chollian.net)
+**
+** This file is part of K Alarm
+**
+** $BEGIN_LICENSE$
+**
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** $END_LICENSE$
+**
+****************************************************************************/
+
+#include "kalarmlistitem.h"
+
+quint64 KAlarmListItem::_lastSequence = 0;
+
+KAlarmListItem::KAlarmListItem(QListWidget *parent)
+    : QListWidgetItem(parent, QListWidgetItem::UserType)
+    , _sequence(++_lastSequence)
+{
+}
+
+KAlarmListItem::~KAlarmListItem()
+{
+
+}
+
+void KAlarmListItem::setSortKey(const QVariant &key)
+{
+    // Changing a key of an item in a sorted list moves only this item
+    if (data(SortKeyRole) != key)
+        setData(SortKeyRole, key);
+}
+
+void KAlarmListItem::setGroup(const QString &group)
+{
+    if (data(GroupRole).toString() != group)
+        setData(GroupRole, group);
+}
+
+QString KAlarmListItem::group() const
+{
+    return data(GroupRole).toString();
+}
+
+void KAlarmListItem::setHeader(bool header)
+{
+    setData(HeaderRole, header);
+}
+
+bool KAlarmListItem::isHeader() const
+{
+    return data(HeaderRole).toBool();
+}
+
+bool KAlarmListItem::operator<(const QListWidgetItem &other) const
+{
+    // Ungrouped alarms first
+    QString group(data(GroupRole).toString());
+    QString otherGroup(other.data(GroupRole).toString());
+
+    if (group != otherGroup)
+    {
+        if (group.isEmpty() || otherGroup.isEmpty())
+            return group.isEmpty();
+
+        return QString::localeAwareCompare(group, otherGroup) < 0;
+    }
+
+    bool header = data(HeaderRole).toBool();
+    bool otherHeader = other.data(HeaderRole).toBool();
+
+    if (header != otherHeader)
+        return header;
+
+    QVariant key(data(SortKeyRole));
+    QVariant otherKey(other.data(SortKeyRole));
+
+    if (key.isValid() && otherKey.isValid())
+    {
+        if (key.type() == QVariant::String)
+        {
+            int result = QString::localeAwareCompare(key.toString(),
+                                                     otherKey.toString());
+            if (result)
+                return result < 0;
+        }
+        else if (key.toLongLong() != otherKey.toLongLong())
+            return key.toLongLong() < otherKey.toLongLong();
+    }
+
+    // Only KAlarmListItem is added to a list
+    return _sequence < static_cast<const KAlarmListItem &>(other)._sequence;
+}
@@ -0,0 +1,76 @@
+/****************************************************************************
+**
+** KAlarmListItem, a sortable list widget item for KAlarm
+**
+** Copyright (C) 2015 by KO Myung-Hun
+** All rights reserved.
+** Contact: KO Myung-Hun (komh@chollian.net)
+**
+** This file is part of K Alarm
+**
+** $BEGIN_LICENSE$
+**
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** $END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef KALARMLISTITEM_H
+#define KALARMLISTITEM_H
+
+#ifdef CONFIG_QT5
+#include <QtWidgets>
+#else
+#include <QtGui>
+#endif
+
+class KAlarmListItem : public QListWidgetItem
+{
+public:
+    enum
+    {
+        /* A string or an integer key to sort items */
+        SortKeyRole = Qt::UserRole + 1,
+
+        /* A group of an alarm or a group header */
+        GroupRole,
+
+        /* True for a group header */
+        HeaderRole
+    };
+
+    explicit KAlarmListItem(QListWidget *parent = 0);
+    ~KAlarmListItem();
+
+    /*
+     * Items with equal keys, or without a valid key on either side such
+     * as group headers, are kept in order of creation
+     */
+    void setSortKey(const QVariant &key);
+
+    void setGroup(const QString &group);
+    QString group() const;
+
+    void setHeader(bool header);
+    bool isHeader() const;
+
+    /*
+     * Items are grouped first, a header is followed by items of its group,
+     * and then sorted by keys
+     */
+    bool operator<(const QListWidgetItem &other) const;
+
+private:
+    quint64 _sequence;
+
+    static quint64 _lastSequence;
+};
+
+#endif // KALARMLISTITEM_H
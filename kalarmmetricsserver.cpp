@@ -0,0 +1,173 @@
+/****************************************************************************
+**
+** KAlarmMetricsServer, serves metrics in Prometheus text format
+**
+** Copyright (C) 2015 by KO Myung-Hun
+** All rights reserved.
+** Contact: KO Myung-Hun (komh@chollian.net)
+**
+** This file is part of K Alarm.
+**
+** $BEGIN_LICENSE$
+**
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** $END_LICENSE$
+**
+****************************************************************************/
+
+#include "kalarmmetricsserver.h"
+#include "kalarmwatchdog.h"
+
+#include <QHostAddress>
+#include <QTimer>
+
+// A request larger than this is not a scrape
+static const int maxRequestSize = 8192;
+
+// Connections idle longer than this are dropped
+static const int requestTimeout = 5000;
+
+KAlarmMetricsServer::KAlarmMetricsServer(QObject *parent)
+    : QObject(parent)
+    , _scrapeCount(0)
+{
+    connect(&_server, SIGNAL(newConnection()), this, SLOT(newConnection()));
+}
+
+KAlarmMetricsServer::~KAlarmMetricsServer()
+{
+
+}
+
+bool KAlarmMetricsServer::listen(quint16 port)
+{
+    if (!_server.listen(QHostAddress::LocalHost, port))
+    {
+        qWarning("KAlarmMetricsServer: Cannot listen on port %d, %s", port,
+                 qPrintable(_server.errorString()));
+
+        return false;
+    }
+
+    return true;
+}
+
+void KAlarmMetricsServer::writeHeader(QTextStream &out, const char *name,
+                                      const char *type, const char *help)
+{
+    out << "# HELP " << name << " " << help << "\n";
+    out << "# TYPE " << name << " " << type << "\n";
+}
+
+void KAlarmMetricsServer::respond(QTcpSocket *socket,
+                                  const QByteArray &request)
+{
+    KAlarmActivityScope activity("KAlarmMetricsServer::respond()");
+
+    QList<QByteArray> requestLine(request.left(request.indexOf("\r\n"))
+                                  .split(' '));
+
+    QByteArray status;
+    QByteArray contentType("text/plain; charset=utf-8");
+    QString body;
+
+    if (requestLine.size() != 3 || requestLine.at(0) != "GET")
+    {
+        status = "405 Method Not Allowed";
+        body = "Method not allowed\n";
+    }
+    else if (requestLine.at(1) != "/metrics")
+    {
+        status = "404 Not Found";
+        body = "Not found\n";
+    }
+    else
+    {
+        ++_scrapeCount;
+
+        status = "200 OK";
+        contentType = "text/plain; version=0.0.4; charset=utf-8";
+
+        QTextStream out(&body);
+
+        writeHeader(out, "kalarm_scrapes_total", "counter",
+                    "Scrapes of this endpoint.");
+        out << "kalarm_scrapes_total " << _scrapeCount << "\n";
+
+        emit collect(&out);
+    }
+
+    QByteArray content(body.toUtf8());
+    QByteArray response;
+
+    response.append("HTTP/1.0 ").append(status).append("\r\n");
+    response.append("Content-Type: ").append(contentType).append("\r\n");
+    response.append("Content-Length: ")
+            .append(QByteArray::number(content.size())).append("\r\n");
+    response.append("Connection: close\r\n");
+    response.append("\r\n");
+    response.append(content);
+
+    socket->write(response);
+    socket->disconnectFromHost();
+}
+
+void KAlarmMetricsServer::newConnection()
+{
+    while (_server.hasPendingConnections())
+    {
+        QTcpSocket *socket = _server.nextPendingConnection();
+
+        _requests.insert(socket, QByteArray());
+
+        connect(socket, SIGNAL(readyRead()), this, SLOT(socketReadyRead()));
+        connect(socket, SIGNAL(disconnected()),
+                this, SLOT(socketDisconnected()));
+
+        QTimer::singleShot(requestTimeout, socket, SLOT(abort()));
+    }
+}
+
+void KAlarmMetricsServer::socketReadyRead()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+
+    if (!_requests.contains(socket))
+        return;
+
+    QByteArray &request = _requests[socket];
+
+    request.append(socket->readAll());
+
+    // Headers are not used, but wait for all of them
+    if (request.contains("\r\n\r\n"))
+    {
+        QByteArray complete(request);
+
+        _requests.remove(socket);
+
+        respond(socket, complete);
+    }
+    else if (request.size() > maxRequestSize)
+    {
+        _requests.remove(socket);
+
+        socket->abort();
+    }
+}
+
+void KAlarmMetricsServer::socketDisconnected()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+
+    _requests.remove(socket);
+
+    socket->deleteLater();
+}
@@ -0,0 +1,73 @@
+/****************************************************************************
+**
+** KAlarmMetricsServer, serves metrics in Prometheus text format
+**
+** Copyright (C) 2015 by KO Myung-Hun
+** All rights reserved.
+** Contact: KO Myung-Hun (komh@chollian.net)
+**
+** This file is part of K Alarm.
+**
+** $BEGIN_LICENSE$
+**
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** $END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef KALARMMETRICSSERVER_H
+#define KALARMMETRICSSERVER_H
+
+#include <QObject>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTextStream>
+#include <QHash>
+#include <QByteArray>
+
+/*
+ * KAlarmMetricsServer listens on localhost only, and answers GET /metrics
+ * with metrics in Prometheus text format. It lives in a GUI thread, and
+ * metrics are collected from statistics of each component, which are
+ * guarded by their own locks, so that a scrape never waits for a scheduler
+ * thread.
+ */
+class KAlarmMetricsServer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit KAlarmMetricsServer(QObject *parent = 0);
+    ~KAlarmMetricsServer();
+
+    bool listen(quint16 port);
+
+    /* Write a HELP and a TYPE line of a metric */
+    static void writeHeader(QTextStream &out, const char *name,
+                            const char *type, const char *help);
+
+signals:
+    /* Emitted for each scrape. Receivers should append metrics to out */
+    void collect(QTextStream *out);
+
+private:
+    QTcpServer _server;
+    QHash<QTcpSocket *, QByteArray> _requests;
+
+    qint64 _scrapeCount;
+
+    void respond(QTcpSocket *socket, const QByteArray &request);
+
+private slots:
+    void newConnection();
+    void socketReadyRead();
+    void socketDisconnected();
+};
+
+#endif // KALARMMETRICSSERVER_H
@@ -0,0 +1,307 @@
+/****************************************************************************
+**
+** KAlarmNotifier, presents alarms in a GUI thread
+**
+** Copyright (C) 2015 by KO Myung-Hun
+** All rights reserved.
+** Contact: KO Myung-Hun (komh@chollian.net)
+**
+** This file is part of K Alarm
+**
+** $BEGIN_LICENSE$
+**
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** $END_LICENSE$
+**
+****************************************************************************/
+
+#include "kalarmnotifier.h"
+#include "kalarmwatchdog.h"
+#include "kalarmresourceregistry.h"
+
+#ifdef CONFIG_QT5
+#include <QtWidgets>
+
+#include "kalarmaudioengine.h"
+#else
+#include <QtGui>
+#endif
+
+// Prepared alarms not notified within this are discarded
+static const int preparedExpiry = 60;
+
+KAlarmNotifier::KAlarmNotifier(QObject *parent)
+    : QObject(parent)
+    , _resources(0)
+#ifdef CONFIG_QT5
+    , _audioEngine(0)
+#endif
+{
+    for (int i = 0; i < PresentationCount; ++i)
+    {
+        _presentCount[i] = 0;
+        _presentTotal[i] = 0;
+        _presentMax[i] = 0;
+    }
+}
+
+KAlarmNotifier::~KAlarmNotifier()
+{
+    foreach (const Prepared &prepared, _prepared)
+        discard(prepared);
+}
+
+void KAlarmNotifier::setResourceRegistry(KAlarmResourceRegistry *registry)
+{
+    _resources = registry;
+}
+
+QString KAlarmNotifier::summary() const
+{
+    static const char *presentationNames[PresentationCount] = {
+        QT_TR_NOOP("Prepared"),
+        QT_TR_NOOP("Not prepared"),
+    };
+
+    QString s;
+    QTextStream out(&s);
+
+    out << tr("Prepared alarms pending: %1").arg(_prepared.size()) << "\n";
+
+    for (int i = 0; i < PresentationCount; ++i)
+    {
+        if (!_presentCount[i])
+            continue;
+
+        out << tr("%1: %2 alarms, average %3 us, max %4 us")
+               .arg(tr(presentationNames[i]))
+               .arg(_presentCount[i])
+               .arg(_presentTotal[i] / _presentCount[i])
+               .arg(_presentMax[i])
+            << "\n";
+    }
+
+    return s;
+}
+
+void KAlarmNotifier::prepare(const KAlarmItem &item, const QDateTime &dt)
+{
+    KAlarmActivityScope activity("KAlarmNotifier::prepare()");
+
+    // Forget alarms prepared but never notified, for example, deleted
+    QDateTime expiry(QDateTime::currentDateTime().addSecs(-preparedExpiry));
+
+    QHash<quint32, Prepared>::iterator it = _prepared.begin();
+    while (it != _prepared.end())
+    {
+        if (it.key() == item.id() || it.value().dt < expiry)
+        {
+            discard(it.value());
+            it = _prepared.erase(it);
+        }
+        else
+            ++it;
+    }
+
+    // Catch up with resources changed without notice, so that a program
+    // is resolved correctly when dispatched
+    if (_resources)
+        _resources->refresh(item.id());
+
+    if (!item.showAlarmWindow())
+        return;
+
+    Prepared prepared;
+    prepared.dt = dt;
+    prepared.name = item.name();
+
+#ifdef CONFIG_QT5
+    QString soundFile(item.soundFile());
+    if (item.playSound()
+            && (!_resources || _resources->resolveSound(item.soundFileId(),
+                                                        &soundFile))
+            && audioEngine()->preload(soundFile))
+        prepared.soundFile = soundFile;
+#endif
+
+    prepared.window = createAlarmWindow(item, dt);
+
+    // Lay out and polish now, not when shown
+    prepared.window->ensurePolished();
+    prepared.window->layout()->activate();
+
+    _prepared.insert(item.id(), prepared);
+}
+
+void KAlarmNotifier::notify(const KAlarmItem &item, const QDateTime &dt)
+{
+    KAlarmActivityScope activity("KAlarmNotifier::notify()");
+
+    QElapsedTimer elapsed;
+    elapsed.start();
+
+    Prepared prepared;
+    prepared.window = 0;
+
+    bool warm = _prepared.contains(item.id());
+    if (warm)
+        prepared = _prepared.take(item.id());
+
+    // A missing sound file is known already, so do not try to play it
+    QString soundFile(item.soundFile());
+    bool playSound = item.playSound()
+            && (!_resources || _resources->resolveSound(item.soundFileId(),
+                                                        &soundFile));
+
+#ifdef CONFIG_QT5
+    // Sounds of all the alarms are mixed into one output stream
+    int soundHandle = 0;
+    if (playSound && item.showAlarmWindow())
+        soundHandle = audioEngine()->play(soundFile, item.priority());
+
+    // A playing sound holds its own reference
+    if (!prepared.soundFile.isEmpty())
+        _audioEngine->unload(prepared.soundFile);
+#else
+    QSound *sound = new QSound(soundFile);
+    if (playSound)
+    {
+        sound->setLoops(-1);
+        sound->play();
+    }
+#endif
+
+    if (!item.showAlarmWindow())
+    {
+#ifndef CONFIG_QT5
+        delete sound;
+#endif
+        delete prepared.window;
+
+        emit presented(item.id());
+
+        return;
+    }
+
+    QMessageBox *msgBox = prepared.window;
+
+    if (!msgBox)
+        msgBox = createAlarmWindow(item, dt);
+    else if (prepared.dt != dt || prepared.name != item.name())
+    {
+        // Modified after prepared
+        msgBox->setText(alarmText(item.name(), dt));
+    }
+
+#ifdef CONFIG_QT5
+    if (soundHandle)
+    {
+        _soundHandles.insert(msgBox, soundHandle);
+
+        connect(msgBox, SIGNAL(destroyed(QObject*)),
+                this, SLOT(alarmWindowDestroyed(QObject*)));
+    }
+#else
+    connect(msgBox, SIGNAL(destroyed()), sound, SLOT(deleteLater()));
+#endif
+
+    msgBox->show();
+    // Activate a message box.
+    // If not activated, change the color of  a task bar entry.
+    msgBox->activateWindow();
+    // Ensure that a message box is stacked on top.
+    msgBox->raise();
+
+    emit presented(item.id());
+
+    KPresentation presentation = warm ? WarmPresentation : ColdPresentation;
+    qint64 usecs = elapsed.nsecsElapsed() / 1000;
+
+    ++_presentCount[presentation];
+    _presentTotal[presentation] += usecs;
+    _presentMax[presentation] = qMax(_presentMax[presentation], usecs);
+}
+
+QMessageBox *KAlarmNotifier::createAlarmWindow(const KAlarmItem &item,
+                                               const QDateTime &dt) const
+{
+    QMessageBox *msgBox = new QMessageBox;
+    msgBox->setModal(false);
+    msgBox->setAttribute(Qt::WA_DeleteOnClose);
+    msgBox->setText(alarmText(item.name(), dt));
+
+    // Resize a message box, minimum width of 320
+    QSpacerItem* hspacer = new QSpacerItem(320, 0,
+                                           QSizePolicy::Minimum,
+                                           QSizePolicy::Expanding);
+
+    QGridLayout* layout = qobject_cast<QGridLayout *>(msgBox->layout());
+    layout->addItem(hspacer, layout->rowCount(), 0, 1, layout->columnCount());
+
+    return msgBox;
+}
+
+QString KAlarmNotifier::alarmText(const QString &name, const QDateTime &dt)
+{
+    QString text;
+    text.append("<p align=center>");
+
+    text.append("<h1>");
+    text.append(dt.toString("HH:mm"));
+    text.append("</h1>");
+
+    text.append("<h3>");
+    text.append(name);
+    text.append("</h3>");
+
+    text.append("</p>");
+
+    return text;
+}
+
+void KAlarmNotifier::clear()
+{
+    foreach (const Prepared &prepared, _prepared)
+        discard(prepared);
+
+    _prepared.clear();
+}
+
+void KAlarmNotifier::discard(const Prepared &prepared)
+{
+    delete prepared.window;
+
+#ifdef CONFIG_QT5
+    if (!prepared.soundFile.isEmpty())
+        _audioEngine->unload(prepared.soundFile);
+#endif
+}
+
+#ifdef CONFIG_QT5
+KAlarmAudioEngine *KAlarmNotifier::audioEngine()
+{
+    // An audio output is opened when a sound is played at first
+    if (!_audioEngine)
+    {
+        QSettings settings;
+
+        _audioEngine = new KAlarmAudioEngine(this);
+        _audioEngine->setMaxVoices(
+                    settings.value("AudioMaxVoices", 4).toInt());
+    }
+
+    return _audioEngine;
+}
+
+void KAlarmNotifier::alarmWindowDestroyed(QObject *window)
+{
+    _audioEngine->stop(_soundHandles.take(window));
+}
+#endif
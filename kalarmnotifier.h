@@ -0,0 +1,115 @@
+/****************************************************************************
+**
+** KAlarmNotifier, presents alarms in a GUI thread
+**
+** Copyright (C) 2015 by KO Myung-Hun
+** All rights reserved.
+** Contact: KO Myung-Hun (komh@chollian.net)
+**
+** This file is part of K Alarm
+**
+** $BEGIN_LICENSE$
+**
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** $END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef KALARMNOTIFIER_H
+#define KALARMNOTIFIER_H
+
+#include <QObject>
+#include <QDateTime>
+#include <QHash>
+
+#include "kalarmitem.h"
+
+class QMessageBox;
+class KAlarmResourceRegistry;
+
+#ifdef CONFIG_QT5
+class KAlarmAudioEngine;
+#endif
+
+class KAlarmNotifier : public QObject
+{
+    Q_OBJECT
+public:
+    explicit KAlarmNotifier(QObject *parent = 0);
+    ~KAlarmNotifier();
+
+    /*
+     * Sound files are played with paths resolved by registry, and
+     * resources are validated again when alarms are prepared
+     */
+    void setResourceRegistry(KAlarmResourceRegistry *registry);
+
+    /* Presentation times of prepared and unprepared alarms */
+    QString summary() const;
+
+public slots:
+    /*
+     * Load a sound and build an alarm window of item ahead of dt, so that
+     * notify() only has to show them
+     */
+    void prepare(const KAlarmItem &item, const QDateTime &dt);
+
+    /* Play a sound and show an alarm window of item */
+    void notify(const KAlarmItem &item, const QDateTime &dt);
+
+    /* Discard all the prepared alarms, for example, of another profile */
+    void clear();
+
+signals:
+    /* Emitted when an alarm of id has been presented */
+    void presented(quint32 id);
+
+private:
+    struct Prepared
+    {
+        QDateTime dt;
+        QString name;
+        QMessageBox *window;    // hidden until notified
+        QString soundFile;      // preloaded sound, empty if none
+    };
+
+    enum KPresentation
+    {
+        WarmPresentation = 0,
+        ColdPresentation,
+        PresentationCount
+    };
+
+    KAlarmResourceRegistry *_resources;
+
+    QHash<quint32, Prepared> _prepared;
+
+    // Presentation times in micro-seconds
+    int _presentCount[PresentationCount];
+    qint64 _presentTotal[PresentationCount];
+    qint64 _presentMax[PresentationCount];
+
+    QMessageBox *createAlarmWindow(const KAlarmItem &item,
+                                   const QDateTime &dt) const;
+    static QString alarmText(const QString &name, const QDateTime &dt);
+    void discard(const Prepared &prepared);
+
+#ifdef CONFIG_QT5
+    KAlarmAudioEngine *_audioEngine;
+    QHash<QObject *, int> _soundHandles; // sound of each alarm window
+
+    KAlarmAudioEngine *audioEngine();
+
+private slots:
+    void alarmWindowDestroyed(QObject *window);
+#endif
+};
+
+#endif // KALARMNOTIFIER_H
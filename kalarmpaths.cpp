@@ -0,0 +1,48 @@
+/****************************************************************************
+**
+** KAlarmPaths, locations of files used by K Alarm
+**
+** Copyright (C) 2015 by KO Myung-Hun
+** All rights reserved.
+** Contact: KO Myung-Hun (komh@chollian.net)
+**
+** This file is part of K Alarm
+**
+** $BEGIN_LICENSE$
+**
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** $END_LICENSE$
+**
+****************************************************************************/
+
+#include "kalarmpaths.h"
+
+#include <QtCore>
+
+QString KAlarmPaths::dataDir()
+{
+    // Use a directory beside an INI file of QSettings. Native settings
+    // may be a registry, which has no directory.
+    QSettings ini(QSettings::IniFormat, QSettings::UserScope,
+                  QCoreApplication::organizationName(),
+                  QCoreApplication::applicationName());
+
+    QString dir(QFileInfo(ini.fileName()).absolutePath() + "/"
+                + QCoreApplication::applicationName());
+
+    QDir().mkpath(dir);
+
+    return dir;
+}
+
+QString KAlarmPaths::dataFile(const QString &name)
+{
+    return dataDir() + "/" + name;
+}
@@ -0,0 +1,40 @@
+/****************************************************************************
+**
+** KAlarmPaths, locations of files used by K Alarm
+**
+** Copyright (C) 2015 by KO Myung-Hun
+** All rights reserved.
+** Contact: KO Myung-Hun (komh@chollian.net)
+**
+** This file is part of K Alarm
+**
+** $BEGIN_LICENSE$
+**
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** $END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef KALARMPATHS_H
+#define KALARMPATHS_H
+
+#include <QString>
+
+class KAlarmPaths
+{
+public:
+    /* A directory for logs and data files. Created if not exist */
+    static QString dataDir();
+
+    /* Path of name in dataDir() */
+    static QString dataFile(const QString &name);
+};
+
+#endif // KALARMPATHS_H
@@ -23,202 +23,793 @@
 ****************************************************************************/
 
 #include "kalarmqueue.h"
-
-#ifdef CONFIG_QT5
-#include <QSoundEffect>
+#include "kalarmwatchdog.h"
+#include "kalarmmetricsserver.h"
+
+#include <QTextStream>
+#include <QFile>
+#include <QDataStream>
+
+#ifdef Q_OS_LINUX
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+// Not defined by old headers
+#ifndef TFD_TIMER_CANCEL_ON_SET
+#define TFD_TIMER_CANCEL_ON_SET (1 << 1)
+#endif
 #endif
 
-KAlarmQueue::KAlarmQueue(QObject *parent) : QObject(parent)
+// Wake up at least once an hour, in case a time zone is changed
+static const qint64 maxSleepMSecs = 60 * 60 * 1000;
+
+static const char nextAlarmsMagic[] = "KAN1";
+static const int nextAlarmsMagicSize = 4;
+
+/* Seconds from a local time to UTC of the same wall clock */
+static int utcOffset(const QDateTime &dt)
 {
-    connect(&_timer, SIGNAL(timeout()), this, SLOT(timerTimeout()));
-    _timer.start(1000); // 1 second timer
+    return dt.secsTo(QDateTime(dt.date(), dt.time(), Qt::UTC));
+}
+
+KAlarmQueue::KAlarmQueue(QObject *parent)
+    : QObject(parent)
+    , _timer(0)
+    , _backend(TimerBackend)
+    , _timerFd(-1)
+    , _armRequested(0)
+    , _warmUpLeadTime(0)
+    , _timerFdNotifier(0)
+    , _utcOffset(0)
+    , _utcOffsetValid(false)
+    , _usefulWakeups(0)
+    , _spuriousWakeups(0)
+    , _clockChanges(0)
+    , _rebuilds(0)
+    , _lastRebuildCount(0)
+    , _lastRebuildNSecs(0)
+    , _lastReplaceCount(0)
+    , _lastReplaceCached(0)
+    , _scheduledCount(0)
+{
+    qRegisterMetaType<KAlarmItem>("KAlarmItem");
+    qRegisterMetaType<quint32>("quint32");
+
+    // A child is moved to a scheduler thread together
+    _dispatcher = new KAlarmDispatcher(this);
+
+    connect(_dispatcher, SIGNAL(alarmTriggered(KAlarmItem,QDateTime)),
+            this, SIGNAL(alarmTriggered(KAlarmItem,QDateTime)));
 }
 
 KAlarmQueue::~KAlarmQueue()
 {
+    stopTimerFd();
+}
+
+void KAlarmQueue::setBackend(KBackend backend)
+{
+    _backend = backend;
+}
+
+void KAlarmQueue::setWarmUpLeadTime(int msecs)
+{
+    _warmUpLeadTime = qMax(msecs, 0);
+}
+
+void KAlarmQueue::start()
+{
+    {
+        QMutexLocker locker(&_statsMutex);
+
+        _uptime.start();
+    }
+
+    // An offset to compare with on wakeups
+    timeZoneChanged();
+
+    if (_backend == TimerFdBackend && startTimerFd())
+    {
+        arm();
+
+        return;
+    }
+
+    {
+        QMutexLocker locker(&_statsMutex);
+
+        _backend = TimerBackend;
+    }
+
+    // A timer is created in a scheduler thread
+    if (!_timer)
+    {
+        _timer = new QTimer(this);
+        connect(_timer, SIGNAL(timeout()), this, SLOT(timerTimeout()));
+    }
 
+    _timer->start(1000); // 1 second timer
 }
 
-void KAlarmQueue::add(const KAlarmItemWidget *w)
+void KAlarmQueue::stop()
 {
-    _alarmMap.insert(w, findNextAlarm(w, QDateTime(QDate::currentDate(),
-                                                   w->startTime()), true));
+    if (_timer)
+        _timer->stop();
+
+    stopTimerFd();
 }
 
-void KAlarmQueue::remove(const KAlarmItemWidget *w)
+bool KAlarmQueue::startTimerFd()
 {
-    _alarmMap.remove(w);
+#ifdef Q_OS_LINUX
+    if (_timerFd != -1)
+        return true;
+
+    _timerFd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+
+    if (_timerFd == -1)
+    {
+        qWarning("KAlarmQueue: timerfd_create() failed, errno = %d", errno);
+
+        return false;
+    }
+
+    // A notifier is created in a scheduler thread
+    _timerFdNotifier = new QSocketNotifier(_timerFd, QSocketNotifier::Read,
+                                           this);
+    connect(_timerFdNotifier, SIGNAL(activated(int)),
+            this, SLOT(timerFdActivated()));
+
+    return true;
+#else
+    return false;
+#endif
 }
 
-void KAlarmQueue::modify(const KAlarmItemWidget *w)
+void KAlarmQueue::stopTimerFd()
 {
-    _alarmMap.insert(w, findNextAlarm(w, QDateTime(QDate::currentDate(),
-                                                   w->startTime()), true));
+#ifdef Q_OS_LINUX
+    if (_timerFd == -1)
+        return;
+
+    delete _timerFdNotifier;
+    _timerFdNotifier = 0;
+
+    close(_timerFd);
+    _timerFd = -1;
+#endif
 }
 
-QDateTime KAlarmQueue::findNextAlarm(const KAlarmItemWidget *w,
-                                     const QDateTime &dt, bool inclusive)
+void KAlarmQueue::requestArm()
 {
-    QDateTime current(QDateTime::currentDateTime());
+    // The next alarm time may be changed. Arm in a scheduler thread, once
+    // for many mutations.
+    if (_armRequested.fetchAndStoreOrdered(1) == 0)
+        QMetaObject::invokeMethod(this, "arm", Qt::QueuedConnection);
+}
 
-    // Clear seconds and milli-seconds parts
-    current.setTime(QTime(current.time().hour(), current.time().minute()));
+void KAlarmQueue::arm()
+{
+    _armRequested.fetchAndStoreOrdered(0);
 
-    QDateTime nextAlarm(dt);
+    QDateTime deadline;
+    int scheduledCount;
 
-    if (w->alarmType() == KAlarmItemWidget::IntervalAlarm)
     {
-        if (inclusive && nextAlarm >= current)
-            return nextAlarm;
+        QMutexLocker locker(&_mutex);
 
-        while (nextAlarm <= current)
-        {
-            if (inclusive && nextAlarm == current)
-                break;
+        deadline = _schedule.nextDeadline();
+        scheduledCount = _schedule.size();
+    }
 
-            nextAlarm = nextAlarm.addSecs(w->intervalTime().hour() * 3600 +
-                                          w->intervalTime().minute() * 60);
-        }
+    // Published for metrics, which should not wait for _mutex
+    {
+        QMutexLocker locker(&_statsMutex);
+
+        _scheduledCount = scheduledCount;
+        _nextDeadline = deadline;
     }
-    else if (w->alarmType() == KAlarmItemWidget::WeeklyAlarm)
+
+#ifdef Q_OS_LINUX
+    if (_timerFd == -1)
+        return;
+
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+
+    if (deadline.isValid())
     {
-        if (inclusive
-                && w->isWeekDayEnabled(
-                    w->numToWeekDay(nextAlarm.date().dayOfWeek()))
-                && nextAlarm >= current)
-            return nextAlarm;
+        qint64 msecs = deadline.toMSecsSinceEpoch();
+
+        // Wake up for warm-up first
+        if (_warmUpLeadTime > 0 && deadline != _warmedDeadline)
+            msecs -= _warmUpLeadTime;
+
+        msecs = qMin(msecs, QDateTime::currentDateTime().toMSecsSinceEpoch()
+                                + maxSleepMSecs);
+
+        // 0 disarms a timer, so wake up at least 1 ns after the epoch
+        spec.it_value.tv_sec = msecs / 1000;
+        spec.it_value.tv_nsec = (msecs % 1000) * 1000000 + 1;
+    }
+
+    // Cancelled when a wall clock is set, so that alarms are rescheduled
+    // at once
+    if (timerfd_settime(_timerFd, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET,
+                        &spec, 0) == -1)
+        qWarning("KAlarmQueue: timerfd_settime() failed, errno = %d", errno);
+#endif
+}
+
+void KAlarmQueue::timerFdActivated()
+{
+#ifdef Q_OS_LINUX
+    quint64 expirations;
 
-        for (int days = 1; days <= 7; ++days)
+    if (read(_timerFd, &expirations, sizeof(expirations)) == -1)
+    {
+        if (errno == ECANCELED)
         {
-            int dayOfWeek = nextAlarm.addDays(days).date().dayOfWeek();
+            QMutexLocker locker(&_statsMutex);
 
-            if (w->isWeekDayEnabled(w->numToWeekDay(dayOfWeek)))
-            {
-                nextAlarm = nextAlarm.addDays(days);
-                break;
-            }
+            ++_clockChanges;
         }
+        else if (errno == EAGAIN)
+            return;
+    }
+
+    bool useful = process();
+
+    // Local times of alarms are other instants in a new time zone
+    if (timeZoneChanged())
+    {
+        rebuild();
+        useful = true;
     }
 
-    return nextAlarm;
+    if (warmUp())
+        useful = true;
+
+    {
+        QMutexLocker locker(&_statsMutex);
+
+        if (useful)
+            ++_usefulWakeups;
+        else
+            ++_spuriousWakeups;
+    }
+
+    arm();
+#endif
 }
 
-void KAlarmQueue::alarm(const KAlarmItemWidget *w, const QDateTime &dt)
+void KAlarmQueue::add(const KAlarmItem &item)
 {
-#ifdef CONFIG_QT5
-    QSoundEffect *sound = new QSoundEffect;
-    if (w->playSound())
+    QDateTime next;
+
     {
-        sound->setSource(QUrl::fromLocalFile(w->soundFile()));
-        sound->setLoopCount(QSoundEffect::Infinite);
-        sound->setVolume(1.0f);
-        sound->play();
+        QMutexLocker locker(&_mutex);
+
+        _schedule.add(item);
+        next = _schedule.nextAlarm(item.id());
     }
-#else
-    QSound *sound = new QSound(w->soundFile());
-    if (w->playSound())
+
+    requestArm();
+
+    emit alarmScheduled(item.id(), next);
+}
+
+void KAlarmQueue::remove(quint32 id)
+{
     {
-        sound->setLoops(-1);
-        sound->play();
+        QMutexLocker locker(&_mutex);
+
+        _schedule.remove(id);
     }
-#endif
 
-    if (w->execProgram())
+    requestArm();
+}
+
+void KAlarmQueue::modify(const KAlarmItem &item)
+{
+    QDateTime next;
+
     {
-        QProcess::startDetached(w->execProgramName() + " " +
-                                w->execProgramParams());
+        QMutexLocker locker(&_mutex);
+
+        _schedule.modify(item);
+        next = _schedule.nextAlarm(item.id());
     }
 
-    if (!w->showAlarmWindow())
+    requestArm();
+
+    emit alarmScheduled(item.id(), next);
+}
+
+void KAlarmQueue::modify(const QList<KAlarmItem> &items)
+{
+    QList<QDateTime> nextList;
+
     {
-        delete sound;
+        QMutexLocker locker(&_mutex);
 
-        return;
+        _schedule.modify(items);
+
+        foreach (const KAlarmItem &item, items)
+            nextList.append(_schedule.nextAlarm(item.id()));
     }
 
-    QString text;
-    text.append("<p align=center>");
+    requestArm();
 
-    text.append("<h1>");
-    text.append(dt.toString("HH:mm"));
-    text.append("</h1>");
+    for (int i = 0; i < items.size(); ++i)
+        emit alarmScheduled(items.at(i).id(), nextList.at(i));
+}
 
-    text.append("<h3>");
-    text.append(w->name());
-    text.append("</h3>");
+void KAlarmQueue::remove(const QList<quint32> &ids)
+{
+    {
+        QMutexLocker locker(&_mutex);
 
-    text.append("</p>");
+        _schedule.remove(ids);
+    }
 
-    QMessageBox *msgBox = new QMessageBox;
-    msgBox->setModal(false);
-    msgBox->setAttribute(Qt::WA_DeleteOnClose);
-    msgBox->setText(text);
+    requestArm();
+}
 
-    connect(msgBox, SIGNAL(destroyed()), sound, SLOT(deleteLater()));
+void KAlarmQueue::replace(const QList<KAlarmItem> &items,
+                          const QString &nextAlarmsFile)
+{
+    QHash<quint32, Schedule::CachedNext> cache;
+    QDate evaluated;
+
+    // Read before locking, not to block a scheduler
+    if (!nextAlarmsFile.isEmpty())
+        readNextAlarms(nextAlarmsFile, &cache, &evaluated);
 
-    // Resize a message box, minimum width of 320
-    QSpacerItem* hspacer = new QSpacerItem(320, 0,
-                                           QSizePolicy::Minimum,
-                                           QSizePolicy::Expanding);
+    QList<QDateTime> nextList;
+    qint64 nsecs;
+    int cached;
+
+    {
+        QMutexLocker locker(&_mutex);
+        QElapsedTimer timer;
 
-    QGridLayout* layout = qobject_cast<QGridLayout *>(msgBox->layout());
-    layout->addItem(hspacer, layout->rowCount(), 0, 1, layout->columnCount());
+        timer.start();
 
-    msgBox->show();
-    // Activate a message box.
-    // If not activated, change the color of  a task bar entry.
-    msgBox->activateWindow();
-    // Ensure that a message box is stacked on top.
-    msgBox->raise();
+        // A scheduler sees either an old set or a new set
+        _schedule.clear();
+        cached = _schedule.modify(items, cache, evaluated);
+
+        nsecs = timer.nsecsElapsed();
+
+        foreach (const KAlarmItem &item, items)
+            nextList.append(_schedule.nextAlarm(item.id()));
+    }
+
+    recordRebuild(items.size(), nsecs);
+
+    {
+        QMutexLocker locker(&_statsMutex);
+
+        _lastReplaceCount = items.size();
+        _lastReplaceCached = cached;
+    }
+
+    requestArm();
+
+    for (int i = 0; i < items.size(); ++i)
+        emit alarmScheduled(items.at(i).id(), nextList.at(i));
 }
 
-void KAlarmQueue::timerTimeout()
+void KAlarmQueue::setGroupEnabled(const QString &group, bool enabled)
 {
-    QDateTime currentDateTime(QDateTime::currentDateTime());
+    QMutexLocker locker(&_mutex);
+
+    if (enabled)
+        _disabledGroups.remove(group);
+    else
+        _disabledGroups.insert(group);
+}
+
+void KAlarmQueue::setDisabledGroups(const QStringList &groups)
+{
+    QMutexLocker locker(&_mutex);
 
-    QMap<const KAlarmItemWidget *, QDateTime> bellMap;
-    QMapIterator<const KAlarmItemWidget *, QDateTime> it(_alarmMap);
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+    _disabledGroups = QSet<QString>(groups.begin(), groups.end());
+#else
+    _disabledGroups = groups.toSet();
+#endif
+}
+
+void KAlarmQueue::setCalendars(const QList<KAlarmCalendar> &calendars,
+                               const QHash<QString, QString> &groupCalendars)
+{
+    QHash<QString, KAlarmCalendar> calendarMap;
+
+    foreach (const KAlarmCalendar &calendar, calendars)
+        calendarMap.insert(calendar.name(), calendar);
+
+    QList<KAlarmItem> items;
+    QList<QDateTime> nextList;
+    qint64 nsecs;
 
-    while (it.hasNext())
     {
-        it.next();
+        QMutexLocker locker(&_mutex);
 
-        const KAlarmItemWidget *w(it.key());
-        QDateTime dt(it.value());
+        _schedule.setCalendars(calendarMap, groupCalendars);
 
-        if (dt.date() == currentDateTime.date()
-                && dt.time().hour() == currentDateTime.time().hour()
-                && dt.time().minute() == currentDateTime.time().minute())
-        {
-            bellMap.insert(w, dt);
-        }
+        nsecs = rebuildSchedule(&items, &nextList);
     }
 
-    it = QMapIterator<const KAlarmItemWidget *, QDateTime>(bellMap);
-    while (it.hasNext())
+    recordRebuild(items.size(), nsecs);
+    requestArm();
+
+    for (int i = 0; i < items.size(); ++i)
+        emit alarmScheduled(items.at(i).id(), nextList.at(i));
+}
+
+qint64 KAlarmQueue::rebuildSchedule(QList<KAlarmItem> *items,
+                                    QList<QDateTime> *nextList)
+{
+    QElapsedTimer timer;
+
+    timer.start();
+
+    // Computed in parallel, and heapified at once
+    *items = _schedule.items();
+    _schedule.modify(*items);
+
+    qint64 nsecs = timer.nsecsElapsed();
+
+    foreach (const KAlarmItem &item, *items)
+        nextList->append(_schedule.nextAlarm(item.id()));
+
+    return nsecs;
+}
+
+void KAlarmQueue::recordRebuild(int count, qint64 nsecs)
+{
+    QMutexLocker locker(&_statsMutex);
+
+    ++_rebuilds;
+    _lastRebuildCount = count;
+    _lastRebuildNSecs = nsecs;
+}
+
+void KAlarmQueue::rebuild()
+{
+    QList<KAlarmItem> items;
+    QList<QDateTime> nextList;
+    qint64 nsecs;
+
     {
-        it.next();
+        QMutexLocker locker(&_mutex);
 
-        const KAlarmItemWidget *w(it.key());
-        QDateTime dt(it.value());
+        nsecs = rebuildSchedule(&items, &nextList);
+    }
 
-        // Alarm if enabled
-        if (w->isAlarmEnabled())
-            alarm(w, currentDateTime);
+    recordRebuild(items.size(), nsecs);
 
-        // Update alarm
-        if (w->alarmType() == KAlarmItemWidget::SingleShotAlarm)
-        {
-            // Remove single-shot alarm to prevent from alarming repeately
-            // until a minute is changed.
-            remove(w);
+    for (int i = 0; i < items.size(); ++i)
+        emit alarmScheduled(items.at(i).id(), nextList.at(i));
+}
 
-            // Disable alarm if single-shot alarm
-            // FIXEME: implement this without const_cast !!!
-            const_cast<KAlarmItemWidget *>(w)->setAlarmEnabled(false);
-        }
+bool KAlarmQueue::timeZoneChanged()
+{
+    int offset = utcOffset(QDateTime::currentDateTime());
+
+    bool changed = _utcOffsetValid && offset != _utcOffset;
+
+    _utcOffset = offset;
+    _utcOffsetValid = true;
+
+    return changed;
+}
+
+bool KAlarmQueue::saveNextAlarms(const QString &fileName) const
+{
+    QVector<Schedule::CachedNext> list;
+
+    {
+        QMutexLocker locker(&_mutex);
+
+        list = _schedule.cachedNexts();
+    }
+
+    QDateTime evaluated(QDateTime::currentDateTime());
+
+    QFile file(fileName);
+
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+
+    file.write(nextAlarmsMagic, nextAlarmsMagicSize);
+
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_4_6);
+
+    out << evaluated.toMSecsSinceEpoch()
+        << static_cast<qint32>(utcOffset(evaluated))
+        << static_cast<quint32>(list.size());
+
+    foreach (const Schedule::CachedNext &cached, list)
+        out << cached.id << cached.ruleHash << cached.next;
+
+    return out.status() == QDataStream::Ok && file.flush();
+}
+
+bool KAlarmQueue::readNextAlarms(
+        const QString &fileName,
+        QHash<quint32, Schedule::CachedNext> *cache, QDate *evaluated)
+{
+    QFile file(fileName);
+
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    if (file.read(nextAlarmsMagicSize)
+            != QByteArray(nextAlarmsMagic, nextAlarmsMagicSize))
+        return false;
+
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_4_6);
+
+    qint64 msecs;
+    qint32 offset;
+    quint32 count;
+
+    in >> msecs >> offset >> count;
+
+    if (in.status() != QDataStream::Ok)
+        return false;
+
+    QDateTime dt(QDateTime::fromMSecsSinceEpoch(msecs));
+
+    // Local times were computed with other rules of a time zone
+    if (utcOffset(dt) != offset)
+        return false;
+
+    QHash<quint32, Schedule::CachedNext> list;
+
+    // A count is not trusted for a reservation
+    for (quint32 i = 0; i < count; ++i)
+    {
+        Schedule::CachedNext cached;
+
+        in >> cached.id >> cached.ruleHash >> cached.next;
+
+        if (in.status() != QDataStream::Ok)
+            return false;
+
+        list.insert(cached.id, cached);
+    }
+
+    *cache = list;
+    *evaluated = dt.date();
+
+    return true;
+}
+
+QDateTime KAlarmQueue::nextAlarm(quint32 id) const
+{
+    QMutexLocker locker(&_mutex);
+
+    return _schedule.nextAlarm(id);
+}
+
+QList<QPair<KAlarmItem, QDateTime> > KAlarmQueue::upcomingAlarms(
+        int count, int timeout) const
+{
+    QList<QPair<KAlarmItem, QDateTime> > list;
+
+    if (!_mutex.tryLock(timeout))
+        return list;
+
+    // Disabled alarms are passed over, but a heap is not searched deeply
+    foreach (const Schedule::Entry &entry,
+             _schedule.upcomingEntries(count, _disabledGroups, 1024))
+        list.append(qMakePair(entry.item, entry.next));
+
+    _mutex.unlock();
+
+    return list;
+}
+
+KAlarmDispatcher *KAlarmQueue::dispatcher() const
+{
+    return _dispatcher;
+}
+
+QString KAlarmQueue::summary() const
+{
+    QMutexLocker locker(&_statsMutex);
+
+    QString s;
+    QTextStream out(&s);
+
+    qint64 wakeups = _usefulWakeups + _spuriousWakeups;
+    double hours = _uptime.isValid() ? _uptime.elapsed() / 3600000.0 : 0;
+
+    out << (_backend == TimerFdBackend
+            ? tr("Backend: timerfd on the next alarm time")
+            : tr("Backend: 1 second timer")) << "\n";
+    out << tr("Wakeups: %1, useful: %2, spurious: %3")
+           .arg(wakeups).arg(_usefulWakeups).arg(_spuriousWakeups) << "\n";
+
+    if (hours > 0)
+        out << tr("Wakeups per hour: %1, useful: %2, spurious: %3")
+               .arg(wakeups / hours, 0, 'f', 1)
+               .arg(_usefulWakeups / hours, 0, 'f', 1)
+               .arg(_spuriousWakeups / hours, 0, 'f', 1) << "\n";
+
+    if (_backend == TimerFdBackend)
+        out << tr("Wall clock changes: %1").arg(_clockChanges) << "\n";
+
+    if (_rebuilds > 0)
+        out << tr("Rebuilds: %1, last: %2 alarms in %3 ms")
+               .arg(_rebuilds).arg(_lastRebuildCount)
+               .arg(_lastRebuildNSecs / 1000000.0, 0, 'f', 1) << "\n";
+
+    if (_lastReplaceCount > 0)
+        out << tr("Next alarm times reused: %1 of %2")
+               .arg(_lastReplaceCached).arg(_lastReplaceCount) << "\n";
+
+    return s;
+}
+
+void KAlarmQueue::writeMetrics(QTextStream &out) const
+{
+    QMutexLocker locker(&_statsMutex);
+
+    KAlarmMetricsServer::writeHeader(out, "kalarm_scheduler_wakeups_total",
+                                     "counter", "Wakeups of a scheduler.");
+    out << "kalarm_scheduler_wakeups_total{result=\"useful\"} "
+        << _usefulWakeups << "\n";
+    out << "kalarm_scheduler_wakeups_total{result=\"spurious\"} "
+        << _spuriousWakeups << "\n";
+
+    KAlarmMetricsServer::writeHeader(out, "kalarm_clock_changes_total",
+                                     "counter", "Wall clock changes seen.");
+    out << "kalarm_clock_changes_total " << _clockChanges << "\n";
+
+    KAlarmMetricsServer::writeHeader(out, "kalarm_schedule_rebuilds_total",
+                                     "counter",
+                                     "Recomputations of all the next alarm "
+                                     "times.");
+    out << "kalarm_schedule_rebuilds_total " << _rebuilds << "\n";
+
+    KAlarmMetricsServer::writeHeader(out, "kalarm_schedule_rebuild_seconds",
+                                     "gauge",
+                                     "Duration of the last recomputation.");
+    out << "kalarm_schedule_rebuild_seconds "
+        << _lastRebuildNSecs / 1e9 << "\n";
+
+    KAlarmMetricsServer::writeHeader(out, "kalarm_schedule_cached_next_alarms",
+                                     "gauge",
+                                     "Next alarm times reused from a saved "
+                                     "schedule when alarms were loaded.");
+    out << "kalarm_schedule_cached_next_alarms " << _lastReplaceCached
+        << "\n";
+
+    KAlarmMetricsServer::writeHeader(out, "kalarm_queue_depth", "gauge",
+                                     "Alarms in a schedule.");
+    out << "kalarm_queue_depth " << _scheduledCount << "\n";
+
+    KAlarmMetricsServer::writeHeader(out, "kalarm_next_deadline_seconds",
+                                     "gauge",
+                                     "Next alarm time in seconds since "
+                                     "the epoch, 0 if none.");
+    out << "kalarm_next_deadline_seconds "
+        << (_nextDeadline.isValid()
+            ? _nextDeadline.toMSecsSinceEpoch() / 1000 : 0) << "\n";
+}
+
+void KAlarmQueue::timerTimeout()
+{
+    bool useful = process();
+
+    // Local times of alarms are other instants in a new time zone
+    if (timeZoneChanged())
+    {
+        rebuild();
+        useful = true;
+    }
+
+    if (warmUp())
+        useful = true;
+
+    {
+        QMutexLocker locker(&_statsMutex);
+
+        if (useful)
+            ++_usefulWakeups;
         else
-            _alarmMap.insert(w, findNextAlarm(w, dt));
+            ++_spuriousWakeups;
     }
+
+    // Nothing to arm, but update statistics
+    if (useful)
+        arm();
 }
 
+bool KAlarmQueue::warmUp()
+{
+    if (_warmUpLeadTime <= 0)
+        return false;
+
+    QList<Schedule::Entry> entryList;
+    QDateTime deadline;
+    QSet<QString> disabledGroups;
+
+    {
+        QMutexLocker locker(&_mutex);
+
+        disabledGroups = _disabledGroups;
+
+        deadline = _schedule.nextDeadline();
+
+        if (!deadline.isValid() || deadline == _warmedDeadline
+                || QDateTime::currentDateTime().msecsTo(deadline)
+                    > _warmUpLeadTime)
+            return false;
+
+        entryList = _schedule.dueEntries(deadline);
+    }
+
+    KAlarmActivityScope activity("KAlarmQueue::warmUp()");
+
+    _warmedDeadline = deadline;
+
+    foreach (const Schedule::Entry &entry, entryList)
+    {
+        if (entry.item.isAlarmEnabled()
+                && !disabledGroups.contains(entry.item.group()))
+            emit alarmWarmUp(entry.item, entry.next);
+    }
+
+    return true;
+}
+
+bool KAlarmQueue::process()
+{
+    KAlarmActivityScope activity("KAlarmQueue::process()");
+
+    QDateTime currentDateTime(QDateTime::currentDateTime());
+
+    QList<Schedule::Entry> bellList;
+    QList<quint32> rescheduledList;
+    QSet<QString> disabledGroups;
+
+    {
+        QMutexLocker locker(&_mutex);
+
+        _schedule.tick(&bellList, &rescheduledList);
+        disabledGroups = _disabledGroups;
+    }
+
+    // Alarm without a lock, so that mutation is not blocked
+    QList<KAlarmItem> dueList;
+
+    foreach (const Schedule::Entry &entry, bellList)
+    {
+        // Alarm if enabled, and its group is enabled
+        if (entry.item.isAlarmEnabled()
+                && !disabledGroups.contains(entry.item.group()))
+            dueList.append(entry.item);
+
+        // Disable alarm if single-shot alarm
+        if (entry.item.alarmType() == KAlarmItem::SingleShotAlarm)
+            emit alarmDisabled(entry.item.id());
+    }
+
+    // Alarms due together are dispatched as a batch in order of priority
+    _dispatcher->dispatch(dueList, currentDateTime);
+
+    foreach (quint32 id, rescheduledList)
+        emit alarmScheduled(id, nextAlarm(id));
+
+    return !bellList.isEmpty() || !rescheduledList.isEmpty();
+}
@@ -29,10 +29,29 @@
 
 #include <QTimer>
 #include <QMap>
+#include <QSet>
+#include <QStringList>
 #include <QDateTime>
+#include <QMutex>
+#include <QElapsedTimer>
+#include <QSocketNotifier>
 
-#include "kalarmitemwidget.h"
+#include "kalarmitem.h"
+#include "kalarmschedule.h"
+#include "kalarmdispatcher.h"
 
+class QTextStream;
+
+/*
+ * KAlarmQueue runs in a scheduler thread. add(), remove(), modify() and
+ * nextAlarm() are thread-safe, and can be called from a GUI thread.
+ * Due alarms are handed to a dispatcher, and presentation of an alarm is
+ * requested with alarmTriggered().
+ *
+ * On Linux, a scheduler sleeps until the next alarm time with a timerfd,
+ * which also wakes it up when a wall clock is changed. Elsewhere, it wakes
+ * up every second.
+ */
 class KAlarmQueue : public QObject
 {
     Q_OBJECT
@@ -40,21 +59,160 @@ public:
     explicit KAlarmQueue(QObject *parent = 0);
     ~KAlarmQueue();
 
-    void add(const KAlarmItemWidget *w);
-    void remove(const KAlarmItemWidget *w);
-    void modify(const KAlarmItemWidget *w);
+    enum KBackend
+    {
+        TimerBackend = 0,   // 1 second timer
+        TimerFdBackend      // Linux timerfd on the next alarm time
+    };
+
+    /* Should be called before start(). Falls back to TimerBackend */
+    void setBackend(KBackend backend);
+
+    /*
+     * Should be called before start(). alarmWarmUp() is emitted msecs
+     * before alarms are due. 0 disables warm-up.
+     */
+    void setWarmUpLeadTime(int msecs);
+
+    void add(const KAlarmItem &item);
+    void remove(quint32 id);
+    void modify(const KAlarmItem &item);
+
+    /* Modify or remove many alarms with one lock */
+    void modify(const QList<KAlarmItem> &items);
+    void remove(const QList<quint32> &ids);
+
+    /*
+     * Replace all the alarms with items at once. Next alarm times saved in
+     * nextAlarmsFile by saveNextAlarms() are taken if still valid, instead
+     * of being computed again.
+     */
+    void replace(const QList<KAlarmItem> &items,
+                 const QString &nextAlarmsFile = QString());
+
+    /* Save next alarm times of all the alarms. Thread-safe */
+    bool saveNextAlarms(const QString &fileName) const;
+
+    /*
+     * Alarms of a disabled group stay scheduled, but are not alarmed.
+     * Constant time regardless of the number of alarms in a group.
+     */
+    void setGroupEnabled(const QString &group, bool enabled);
+    void setDisabledGroups(const QStringList &groups);
+
+    /*
+     * Set calendars of excluded days, and names of calendars by group, and
+     * reschedule all the alarms with them
+     */
+    void setCalendars(const QList<KAlarmCalendar> &calendars,
+                      const QHash<QString, QString> &groupCalendars);
+
+    /* Return the next alarm time of id, or an invalid time if not queued */
+    QDateTime nextAlarm(quint32 id) const;
+
+    /*
+     * Return at most count alarms to be alarmed next, in order, with their
+     * next alarm times. Waits for a lock at most timeout milli-seconds, and
+     * returns an empty list on timeout.
+     */
+    QList<QPair<KAlarmItem, QDateTime> > upcomingAlarms(
+            int count, int timeout = 100) const;
+
+    /*
+     * A dispatcher lives in a scheduler thread. Should be configured
+     * before start()
+     */
+    KAlarmDispatcher *dispatcher() const;
+
+    /* Wakeup statistics of a scheduler. Thread-safe */
+    QString summary() const;
+
+    /* Write metrics in Prometheus text format. Thread-safe */
+    void writeMetrics(QTextStream &out) const;
+
+public slots:
+    /* Should be called in a scheduler thread */
+    void start();
+    void stop();
+
+signals:
+    /* Emitted when the next alarm time of id is updated */
+    void alarmScheduled(quint32 id, const QDateTime &dt);
+
+    /* Emitted to show an alarm window or to play a sound of item */
+    void alarmTriggered(const KAlarmItem &item, const QDateTime &dt);
+
+    /* Emitted msecs of a lead time before item is due at dt */
+    void alarmWarmUp(const KAlarmItem &item, const QDateTime &dt);
+
+    /* Emitted when a single-shot alarm is disabled after alarming */
+    void alarmDisabled(quint32 id);
 
 private:
-    QTimer _timer;
-    QMap<const KAlarmItemWidget *, QDateTime> _alarmMap;
+    typedef KAlarmSchedule<KAlarmSystemClock> Schedule;
+
+    mutable QMutex _mutex;
+    QTimer *_timer;
+    Schedule _schedule;
+    QSet<QString> _disabledGroups;
+    KAlarmDispatcher *_dispatcher;
+
+    KBackend _backend;
+    int _timerFd;
+    QAtomicInt _armRequested;
+    int _warmUpLeadTime;
+    QDateTime _warmedDeadline;    // Deadline already warmed up
+    QSocketNotifier *_timerFdNotifier;
+
+    // An offset from UTC in seconds, seen last in a scheduler thread
+    int _utcOffset;
+    bool _utcOffsetValid;
+
+    // Wakeup statistics, guarded by _statsMutex
+    mutable QMutex _statsMutex;
+    QElapsedTimer _uptime;
+    qint64 _usefulWakeups;
+    qint64 _spuriousWakeups;
+    qint64 _clockChanges;
+    qint64 _rebuilds;
+    int _lastRebuildCount;
+    qint64 _lastRebuildNSecs;
+    int _lastReplaceCount;
+    int _lastReplaceCached;
+    int _scheduledCount;
+    QDateTime _nextDeadline;
+
+    bool startTimerFd();
+    void stopTimerFd();
+    void requestArm();
+
+    /* Process due alarms. Returns false if there was nothing to do */
+    bool process();
+
+    /* Warm up alarms due within a lead time. Returns false if none */
+    bool warmUp();
+
+    /* Whether an offset from UTC is changed since the last call */
+    bool timeZoneChanged();
 
-    QDateTime findNextAlarm(const KAlarmItemWidget *w, const QDateTime &dt,
-                            bool inclusive = false);
+    /*
+     * Recompute next alarm times of all the alarms. _mutex should be
+     * locked. Returns elapsed nano-seconds.
+     */
+    qint64 rebuildSchedule(QList<KAlarmItem> *items,
+                           QList<QDateTime> *nextList);
+    void recordRebuild(int count, qint64 nsecs);
 
-    void alarm(const KAlarmItemWidget *w, const QDateTime &dt);
+    /* Read next alarm times saved by saveNextAlarms(), by id */
+    static bool readNextAlarms(const QString &fileName,
+                               QHash<quint32, Schedule::CachedNext> *cache,
+                               QDate *evaluated);
+    void rebuild();
 
 private slots:
     void timerTimeout();
+    void timerFdActivated();
+    void arm();
 };
 
 #endif // KALARMQUEUE_H
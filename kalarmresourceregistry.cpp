@@ -0,0 +1,385 @@
+/****************************************************************************
+**
+** KAlarmResourceRegistry, validates and watches alarm resources
+**
+** Copyright (C) 2015 by KO Myung-Hun
+** All rights reserved.
+** Contact: KO Myung-Hun (komh@chollian.net)
+**
+** This file is part of K Alarm.
+**
+** $BEGIN_LICENSE$
+**
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** $END_LICENSE$
+**
+****************************************************************************/
+
+#include "kalarmresourceregistry.h"
+#include "kalarmwatchdog.h"
+
+#include <QFileInfo>
+#include <QDir>
+#include <QProcessEnvironment>
+#include <QSet>
+
+KAlarmResourceRegistry::KAlarmResourceRegistry(QObject *parent)
+    : QObject(parent)
+{
+#if defined(Q_OS_WIN) || defined(Q_OS_OS2)
+    const char pathSeparator = ';';
+#else
+    const char pathSeparator = ':';
+#endif
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+    const Qt::SplitBehavior skipEmptyParts = Qt::SkipEmptyParts;
+#else
+    const QString::SplitBehavior skipEmptyParts = QString::SkipEmptyParts;
+#endif
+
+    QString path(QProcessEnvironment::systemEnvironment().value("PATH"));
+
+    foreach (const QString &dir,
+             path.split(pathSeparator, skipEmptyParts))
+        _searchPaths.append(QDir::fromNativeSeparators(dir));
+
+    connect(&_watcher, SIGNAL(fileChanged(QString)),
+            this, SLOT(pathChanged(QString)));
+    connect(&_watcher, SIGNAL(directoryChanged(QString)),
+            this, SLOT(pathChanged(QString)));
+}
+
+KAlarmResourceRegistry::~KAlarmResourceRegistry()
+{
+
+}
+
+void KAlarmResourceRegistry::add(const KAlarmItem &item)
+{
+    // Id 0 is an empty string
+    if (item.playSound() && item.soundFileId())
+        acquire(item.id(), SoundResource, item.soundFileId());
+
+    if (item.execProgram() && item.execProgramNameId())
+        acquire(item.id(), ProgramResource, item.execProgramNameId());
+}
+
+void KAlarmResourceRegistry::remove(quint32 id)
+{
+    foreach (quint64 k, _alarmResources.take(id))
+        release(k);
+}
+
+void KAlarmResourceRegistry::modify(const KAlarmItem &item)
+{
+    // Acquire first, so that resources in use are not validated again
+    QList<quint64> oldKeys(_alarmResources.take(item.id()));
+
+    add(item);
+
+    foreach (quint64 k, oldKeys)
+        release(k);
+}
+
+void KAlarmResourceRegistry::refresh(quint32 id)
+{
+    revalidate(_alarmResources.value(id));
+}
+
+QString KAlarmResourceRegistry::warning(quint32 id) const
+{
+    QStringList errors;
+
+    foreach (quint64 k, _alarmResources.value(id))
+    {
+        const Resource &resource = _resources.value(k);
+
+        if (!resource.error.isEmpty())
+            errors.append(resource.error);
+    }
+
+    return errors.join("\n");
+}
+
+bool KAlarmResourceRegistry::resolveSound(quint32 fileId,
+                                          QString *path) const
+{
+    return resolve(key(SoundResource, fileId), path);
+}
+
+bool KAlarmResourceRegistry::resolveProgram(quint32 nameId,
+                                            QString *path) const
+{
+    return resolve(key(ProgramResource, nameId), path);
+}
+
+quint64 KAlarmResourceRegistry::key(KResourceKind kind, quint32 nameId)
+{
+    return (static_cast<quint64>(kind) << 32) | nameId;
+}
+
+void KAlarmResourceRegistry::acquire(quint32 id, KResourceKind kind,
+                                     quint32 nameId)
+{
+    quint64 k(key(kind, nameId));
+
+    _alarmResources[id].append(k);
+
+    QHash<quint64, Resource>::iterator it = _resources.find(k);
+
+    if (it != _resources.end())
+    {
+        ++it.value().refCount;
+
+        return;
+    }
+
+    Resource resource;
+    resource.kind = kind;
+    resource.name = KAlarmStringPool::string(nameId);
+    resource.refCount = 1;
+
+    validate(&resource);
+    watch(&resource);
+
+    QMutexLocker locker(&_mutex);
+
+    _resources.insert(k, resource);
+}
+
+void KAlarmResourceRegistry::release(quint64 key)
+{
+    QHash<quint64, Resource>::iterator it = _resources.find(key);
+
+    if (it == _resources.end() || --it.value().refCount > 0)
+        return;
+
+    unwatch(&it.value());
+
+    QMutexLocker locker(&_mutex);
+
+    _resources.erase(it);
+}
+
+bool KAlarmResourceRegistry::resolve(quint64 key, QString *path) const
+{
+    QMutexLocker locker(&_mutex);
+
+    QHash<quint64, Resource>::const_iterator it = _resources.constFind(key);
+
+    if (it == _resources.constEnd() || it.value().path.isEmpty())
+        return false;
+
+    *path = it.value().path;
+
+    return true;
+}
+
+void KAlarmResourceRegistry::validate(Resource *resource) const
+{
+    KAlarmActivityScope activity("KAlarmResourceRegistry::validate()");
+
+    resource->path.clear();
+    resource->error.clear();
+
+    if (resource->kind == SoundResource)
+    {
+        QFileInfo fi(resource->name);
+
+        if (!fi.exists())
+            resource->error = tr("Sound file not found: %1")
+                                .arg(resource->name);
+        else if (!fi.isFile() || !fi.isReadable())
+            resource->error = tr("Sound file not readable: %1")
+                                .arg(resource->name);
+        else
+            resource->path = fi.absoluteFilePath();
+
+        return;
+    }
+
+    QStringList candidates;
+
+    if (isBareProgram(resource->name))
+    {
+        foreach (const QString &dir, _searchPaths)
+            candidates.append(dir + "/" + resource->name);
+    }
+    else
+        candidates.append(resource->name);
+
+#if defined(Q_OS_WIN) || defined(Q_OS_OS2)
+    // A program may be given without an extension
+    if (QFileInfo(resource->name).suffix().isEmpty())
+    {
+        static const char *const extensions[] =
+                {".exe", ".com", ".cmd", ".bat"};
+
+        QStringList withExtensions;
+
+        foreach (const QString &candidate, candidates)
+        {
+            withExtensions.append(candidate);
+
+            for (size_t i = 0;
+                 i < sizeof(extensions) / sizeof(extensions[0]); ++i)
+                withExtensions.append(candidate + extensions[i]);
+        }
+
+        candidates = withExtensions;
+    }
+#endif
+
+    bool found = false;
+
+    foreach (const QString &candidate, candidates)
+    {
+        QFileInfo fi(candidate);
+
+        if (!fi.isFile())
+            continue;
+
+        if (fi.isExecutable())
+        {
+            resource->path = fi.absoluteFilePath();
+
+            return;
+        }
+
+        found = true;
+    }
+
+    resource->error = (found ? tr("Program not executable: %1")
+                             : tr("Program not found: %1"))
+                      .arg(resource->name);
+}
+
+void KAlarmResourceRegistry::watch(Resource *resource)
+{
+    QStringList paths;
+
+    // A file is watched to know that it is modified or removed, and a
+    // directory to know that a file is created
+    if (!resource->path.isEmpty())
+        paths.append(resource->path);
+
+    if (resource->kind == ProgramResource && isBareProgram(resource->name))
+        paths.append(_searchPaths);
+    else
+        paths.append(QFileInfo(resource->name).absolutePath());
+
+    resource->watched.clear();
+
+    // A directory not created yet is watched through the nearest existing
+    // parent, and watched itself when it is created there
+    foreach (const QString &path, paths)
+    {
+        QString existing(existingPath(path));
+
+        if (_watchCounts[existing]++ == 0)
+            _watcher.addPath(existing);
+
+        resource->watched.append(existing);
+    }
+}
+
+void KAlarmResourceRegistry::unwatch(Resource *resource)
+{
+    foreach (const QString &path, resource->watched)
+    {
+        QHash<QString, int>::iterator it = _watchCounts.find(path);
+
+        if (it != _watchCounts.end() && --it.value() == 0)
+        {
+            _watchCounts.erase(it);
+            _watcher.removePath(path);
+        }
+    }
+
+    resource->watched.clear();
+}
+
+void KAlarmResourceRegistry::revalidate(const QList<quint64> &keys)
+{
+    QSet<quint64> changedKeys;
+
+    foreach (quint64 k, keys)
+    {
+        QHash<quint64, Resource>::iterator it = _resources.find(k);
+
+        if (it == _resources.end())
+            continue;
+
+        Resource resource(it.value());
+
+        validate(&resource);
+
+        // A removed file is not watched any more, so watch again
+        unwatch(&it.value());
+        watch(&resource);
+
+        if (resource.path != it.value().path
+                || resource.error != it.value().error)
+            changedKeys.insert(k);
+
+        QMutexLocker locker(&_mutex);
+
+        it.value() = resource;
+    }
+
+    if (changedKeys.isEmpty())
+        return;
+
+    QHash<quint32, QList<quint64> >::const_iterator it;
+    for (it = _alarmResources.constBegin(); it != _alarmResources.constEnd();
+         ++it)
+    {
+        foreach (quint64 k, it.value())
+        {
+            if (changedKeys.contains(k))
+            {
+                emit warningChanged(it.key(), warning(it.key()));
+
+                break;
+            }
+        }
+    }
+}
+
+QString KAlarmResourceRegistry::existingPath(const QString &path)
+{
+    QFileInfo fi(path);
+
+    // A root always exists
+    while (!fi.exists() && !fi.isRoot())
+        fi.setFile(fi.absolutePath());
+
+    return fi.absoluteFilePath();
+}
+
+bool KAlarmResourceRegistry::isBareProgram(const QString &name) const
+{
+    return !name.contains('/') && !name.contains('\\')
+            && !QFileInfo(name).isAbsolute();
+}
+
+void KAlarmResourceRegistry::pathChanged(const QString &path)
+{
+    QList<quint64> keys;
+
+    QHash<quint64, Resource>::const_iterator it;
+    for (it = _resources.constBegin(); it != _resources.constEnd(); ++it)
+    {
+        if (it.value().watched.contains(path))
+            keys.append(it.key());
+    }
+
+    revalidate(keys);
+}
@@ -0,0 +1,119 @@
+/****************************************************************************
+**
+** KAlarmResourceRegistry, validates and watches alarm resources
+**
+** Copyright (C) 2015 by KO Myung-Hun
+** All rights reserved.
+** Contact: KO Myung-Hun (komh@chollian.net)
+**
+** This file is part of K Alarm.
+**
+** $BEGIN_LICENSE$
+**
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** $END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef KALARMRESOURCEREGISTRY_H
+#define KALARMRESOURCEREGISTRY_H
+
+#include <QObject>
+#include <QFileSystemWatcher>
+#include <QMutex>
+#include <QHash>
+#include <QList>
+#include <QStringList>
+
+#include "kalarmitem.h"
+
+/*
+ * KAlarmResourceRegistry validates sound files and programs of alarms when
+ * they are added or modified, and keeps the results current by watching
+ * files and their directories. It lives in a GUI thread, and
+ * resolveSound() and resolveProgram() are thread-safe, so that alarms are
+ * dispatched without touching a file system.
+ */
+class KAlarmResourceRegistry : public QObject
+{
+    Q_OBJECT
+public:
+    explicit KAlarmResourceRegistry(QObject *parent = 0);
+    ~KAlarmResourceRegistry();
+
+    void add(const KAlarmItem &item);
+    void remove(quint32 id);
+    void modify(const KAlarmItem &item);
+
+    /*
+     * Validate resources of id again. Watching may miss some changes such
+     * as ones on network file systems, so this is done before alarming.
+     */
+    void refresh(quint32 id);
+
+    /* A warning about resources of id, or an empty string if valid */
+    QString warning(quint32 id) const;
+
+    /*
+     * Resolve a registered resource given by an id in KAlarmStringPool to
+     * a path. Returns false if it is invalid or not registered.
+     */
+    bool resolveSound(quint32 fileId, QString *path) const;
+    bool resolveProgram(quint32 nameId, QString *path) const;
+
+signals:
+    /* Emitted when a warning of id is changed */
+    void warningChanged(quint32 id, const QString &warning);
+
+private:
+    enum KResourceKind
+    {
+        SoundResource = 0,
+        ProgramResource
+    };
+
+    struct Resource
+    {
+        KResourceKind kind;
+        QString name;
+        QString path;       // resolved path, empty if invalid
+        QString error;
+        QStringList watched;
+        int refCount;
+    };
+
+    mutable QMutex _mutex;
+    QFileSystemWatcher _watcher;
+
+    QHash<quint64, Resource> _resources;        // by key()
+    QHash<quint32, QList<quint64> > _alarmResources;// keys used by an alarm
+    QStringList _searchPaths;                   // PATH for bare programs
+    QHash<QString, int> _watchCounts;
+
+    // A key of a resource named by an id in KAlarmStringPool
+    static quint64 key(KResourceKind kind, quint32 nameId);
+
+    void acquire(quint32 id, KResourceKind kind, quint32 nameId);
+    void release(quint64 key);
+    bool resolve(quint64 key, QString *path) const;
+    void validate(Resource *resource) const;
+    void watch(Resource *resource);
+    void unwatch(Resource *resource);
+    void revalidate(const QList<quint64> &keys);
+    bool isBareProgram(const QString &name) const;
+
+    /* A path itself if exists, or its nearest existing parent */
+    static QString existingPath(const QString &path);
+
+private slots:
+    void pathChanged(const QString &path);
+};
+
+#endif // KALARMRESOURCEREGISTRY_H
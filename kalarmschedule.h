@@ -0,0 +1,858 @@
+/****************************************************************************
+**
+** KAlarmSchedule, a clock-independent alarm schedule
+**
+** Copyright (C) 2015 by KO Myung-Hun
+** All rights reserved.
+** Contact: KO Myung-Hun (komh@chollian.net)
+**
+** This file is part of K Alarm
+**
+** $BEGIN_LICENSE$
+**
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** $END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef KALARMSCHEDULE_H
+#define KALARMSCHEDULE_H
+
+#include <QtCore>
+#include <QtConcurrentMap>
+
+#include "kalarmitem.h"
+#include "kalarmcalendar.h"
+
+/* A clock of a real time */
+class KAlarmSystemClock
+{
+public:
+    QDateTime now() const { return QDateTime::currentDateTime(); }
+};
+
+/* A clock of a virtual time, which is moved manually */
+class KAlarmVirtualClock
+{
+public:
+    KAlarmVirtualClock() {}
+    explicit KAlarmVirtualClock(const QDateTime &now) : _now(now) {}
+
+    QDateTime now() const { return _now; }
+    void setNow(const QDateTime &now) { _now = now; }
+    void advance(qint64 msecs) { _now = _now.addMSecs(msecs); }
+
+private:
+    QDateTime _now;
+};
+
+/*
+ * KAlarmSchedule keeps the next alarm times of alarms in a binary heap.
+ * A clock is a template parameter, so that a real time clock costs nothing
+ * and a virtual time clock can run a schedule at CPU speed. A clock should
+ * provide QDateTime now() const.
+ *
+ * When many alarms are changed at once, next alarm times are computed in
+ * parallel by QtConcurrent, and a clock should be thread-safe for reading.
+ *
+ * KAlarmSchedule is not thread-safe.
+ */
+template <class Clock>
+class KAlarmSchedule
+{
+public:
+    struct Entry
+    {
+        KAlarmItem item;
+        QDateTime next;
+        int heapIndex;  // -1 if not in a heap
+
+        Entry() : heapIndex(-1) {}
+    };
+
+    /* A next alarm time with a hash of a rule it was computed from */
+    struct CachedNext
+    {
+        quint32 id;
+        quint64 ruleHash;
+        qint64 next;    // milli-seconds since epoch
+    };
+
+    KAlarmSchedule() {}
+    explicit KAlarmSchedule(const Clock &clock) : _clock(clock) {}
+
+    Clock &clock() { return _clock; }
+    const Clock &clock() const { return _clock; }
+
+    int size() const { return _entries.size(); }
+
+    /* Schedule item from its start time of today */
+    void add(const KAlarmItem &item)
+    {
+        QDateTime dt(_clock.now().date(), item.startTime());
+
+        schedule(item, findNextAlarm(item, dt, true));
+    }
+
+    void modify(const KAlarmItem &item) { add(item); }
+
+    void remove(quint32 id)
+    {
+        typename QHash<quint32, Entry>::iterator it = _entries.find(id);
+
+        if (it == _entries.end())
+            return;
+
+        if (it.value().heapIndex != -1)
+            heapRemove(it.value().heapIndex);
+
+        _entries.erase(it);
+    }
+
+    /*
+     * Modify or remove many alarms. A heap is rebuilt at once if many
+     * alarms are changed, instead of being updated for each alarm. Next
+     * alarm times of many alarms are computed in chunks on all the cores.
+     */
+    void modify(const QList<KAlarmItem> &items)
+    {
+        modify(items, QHash<quint32, CachedNext>(), QDate());
+    }
+
+    /*
+     * Modify many alarms like above, but take next alarm times from cache
+     * saved on evaluated, by id, if they are still valid. A cached time is
+     * valid if a rule is not changed and it is not passed. Except weekly
+     * alarms, which do not depend on a day when they are scheduled, it
+     * should be saved today. Returns the number of times taken.
+     */
+    int modify(const QList<KAlarmItem> &items,
+               const QHash<quint32, CachedNext> &cache,
+               const QDate &evaluated)
+    {
+        QDate today(_clock.now().date());
+        qint64 currentKey = currentMinuteKey();
+        int cachedCount = 0;
+
+        if (!isBulk(items.size()))
+        {
+            foreach (const KAlarmItem &item, items)
+            {
+                typename QHash<quint32, CachedNext>::const_iterator it =
+                        cache.constFind(item.id());
+
+                if (it != cache.constEnd()
+                        && isCacheValid(item, it.value(), evaluated, today,
+                                        currentKey))
+                {
+                    schedule(item,
+                             QDateTime::fromMSecsSinceEpoch(it.value().next));
+                    ++cachedCount;
+                }
+                else
+                    modify(item);
+            }
+
+            return cachedCount;
+        }
+
+        // Insert all the entries first, so that they are not moved in a
+        // hash while worker threads write to them
+        QVector<quint32> ids;
+        ids.reserve(items.size());
+
+        QVector<HeapNode> cachedNodes;
+
+        foreach (const KAlarmItem &item, items)
+        {
+            Entry &entry = _entries[item.id()];
+
+            entry.item = item;
+
+            // An alarm listed twice is computed once
+            if (entry.heapIndex == ChangedIndex)
+                continue;
+
+            entry.heapIndex = ChangedIndex;
+
+            typename QHash<quint32, CachedNext>::const_iterator it =
+                    cache.constFind(item.id());
+
+            if (it != cache.constEnd()
+                    && isCacheValid(item, it.value(), evaluated, today,
+                                    currentKey))
+            {
+                entry.next = QDateTime::fromMSecsSinceEpoch(it.value().next);
+
+                HeapNode node;
+                node.key = it.value().next;
+                node.id = item.id();
+
+                cachedNodes.append(node);
+            }
+            else
+                ids.append(item.id());
+        }
+
+        QVector<Entry *> entries(ids.size());
+        for (int i = 0; i < ids.size(); ++i)
+            entries[i] = &_entries[ids.at(i)];
+
+        QVector<HeapNode> nodes(ids.size());
+
+        // Small chunks are not worth a thread
+        int chunkCount = qBound(1, entries.size() / minChunkSize,
+                                QThread::idealThreadCount() * 4);
+        int chunkSize = qMax(1, (entries.size() + chunkCount - 1)
+                                / chunkCount);
+
+        QVector<NextAlarmChunk> chunks;
+
+        for (int begin = 0; begin < entries.size(); begin += chunkSize)
+        {
+            NextAlarmChunk chunk;
+
+            chunk.schedule = this;
+            chunk.today = today;
+            chunk.entries = entries.data() + begin;
+            chunk.nodes = nodes.data() + begin;
+            chunk.count = qMin(chunkSize, entries.size() - begin);
+
+            chunks.append(chunk);
+        }
+
+        if (chunks.size() == 1)
+            chunks.first().run();
+        else if (!chunks.isEmpty())
+            QtConcurrent::blockingMap(chunks, &NextAlarmChunk::run);
+
+        QVector<HeapNode> heapNodes(cachedNodes);
+
+        for (int i = 0; i < nodes.size(); ++i)
+        {
+            if (isPassedSingleShot(entries.at(i)->item, nodes.at(i).key,
+                                   currentKey))
+                entries.at(i)->heapIndex = -1;
+            else
+                heapNodes.append(nodes.at(i));
+        }
+
+        rebuildHeap(heapNodes);
+
+        return cachedNodes.size();
+    }
+
+    void remove(const QList<quint32> &ids)
+    {
+        if (!isBulk(ids.size()))
+        {
+            foreach (quint32 id, ids)
+                remove(id);
+
+            return;
+        }
+
+        foreach (quint32 id, ids)
+            _entries.remove(id);
+
+        rebuildHeap();
+    }
+
+    void clear()
+    {
+        _entries.clear();
+        _heap.clear();
+    }
+
+    /* All the alarms in a schedule */
+    QList<KAlarmItem> items() const
+    {
+        QList<KAlarmItem> list;
+
+        typename QHash<quint32, Entry>::const_iterator it;
+        for (it = _entries.constBegin(); it != _entries.constEnd(); ++it)
+            list.append(it.value().item);
+
+        return list;
+    }
+
+    /*
+     * Calendars by name, and names of calendars by group. Alarms should be
+     * modified again to be rescheduled with them.
+     */
+    void setCalendars(const QHash<QString, KAlarmCalendar> &calendars,
+                      const QHash<QString, QString> &groupCalendars)
+    {
+        _calendars = calendars;
+        _groupCalendars = groupCalendars;
+
+        // Hashed once for rule hashes of alarms
+        _calendarHashes.clear();
+
+        typename QHash<QString, KAlarmCalendar>::const_iterator it;
+        for (it = _calendars.constBegin(); it != _calendars.constEnd(); ++it)
+            _calendarHashes.insert(it.key(), it.value().hash());
+    }
+
+    /* Return a calendar of item, or 0 if none */
+    const KAlarmCalendar *calendar(const KAlarmItem &item) const
+    {
+        QString name(item.calendar());
+
+        if (name.isEmpty())
+            name = _groupCalendars.value(item.group());
+
+        if (name.isEmpty())
+            return 0;
+
+        typename QHash<QString, KAlarmCalendar>::const_iterator it =
+                _calendars.constFind(name);
+
+        return it == _calendars.constEnd() ? 0 : &it.value();
+    }
+
+    /* Return the next alarm time of id, or an invalid time if not queued */
+    QDateTime nextAlarm(quint32 id) const
+    {
+        typename QHash<quint32, Entry>::const_iterator it =
+                _entries.constFind(id);
+
+        return it == _entries.constEnd() ? QDateTime() : it.value().next;
+    }
+
+    /* Return the earliest next alarm time, or an invalid time if none */
+    QDateTime nextDeadline() const
+    {
+        return _heap.isEmpty() ? QDateTime()
+                               : _entries.value(_heap.first().id).next;
+    }
+
+    /*
+     * Return entries whose next alarm time is not after dt. Visits only
+     * such nodes of a heap.
+     */
+    QList<Entry> dueEntries(const QDateTime &dt) const
+    {
+        QList<Entry> list;
+        qint64 key = dt.toMSecsSinceEpoch();
+
+        QVector<int> stack;
+        if (!_heap.isEmpty())
+            stack.append(0);
+
+        while (!stack.isEmpty())
+        {
+            int i = stack.last();
+            stack.pop_back();
+
+            if (_heap.at(i).key > key)
+                continue;
+
+            list.append(_entries.value(_heap.at(i).id));
+
+            if (2 * i + 1 < _heap.size())
+                stack.append(2 * i + 1);
+            if (2 * i + 2 < _heap.size())
+                stack.append(2 * i + 2);
+        }
+
+        return list;
+    }
+
+    /*
+     * Return at most count enabled alarms not in skippedGroups, in order of
+     * next alarm time. Visits a heap best-first, and at most maxVisits
+     * nodes of it.
+     */
+    QList<Entry> upcomingEntries(int count,
+                                 const QSet<QString> &skippedGroups,
+                                 int maxVisits) const
+    {
+        QList<Entry> list;
+
+        // Children of visited nodes by their keys
+        QMultiMap<qint64, int> frontier;
+        if (!_heap.isEmpty())
+            frontier.insert(_heap.first().key, 0);
+
+        while (!frontier.isEmpty() && list.size() < count
+               && maxVisits-- > 0)
+        {
+            QMultiMap<qint64, int>::iterator first = frontier.begin();
+            int i = first.value();
+
+            frontier.erase(first);
+
+            const Entry &entry = _entries.constFind(_heap.at(i).id).value();
+
+            if (entry.item.isAlarmEnabled()
+                    && !skippedGroups.contains(entry.item.group()))
+                list.append(entry);
+
+            if (2 * i + 1 < _heap.size())
+                frontier.insert(_heap.at(2 * i + 1).key, 2 * i + 1);
+            if (2 * i + 2 < _heap.size())
+                frontier.insert(_heap.at(2 * i + 2).key, 2 * i + 2);
+        }
+
+        return list;
+    }
+
+    /* Next alarm times of alarms in a heap, to be given to modify() later */
+    QVector<CachedNext> cachedNexts() const
+    {
+        QVector<CachedNext> list;
+        list.reserve(_heap.size());
+
+        foreach (const HeapNode &node, _heap)
+        {
+            CachedNext cached;
+            cached.id = node.id;
+            cached.ruleHash = ruleHash(_entries.constFind(node.id)
+                                       .value().item);
+            cached.next = node.key;
+
+            list.append(cached);
+        }
+
+        return list;
+    }
+
+    /*
+     * A hash of what a next alarm time of item is computed from, that is,
+     * an alarm type, times, week days and excluded days
+     */
+    quint64 ruleHash(const KAlarmItem &item) const
+    {
+        int weekDays = 0;
+        for (int day = KAlarmItem::FirstDay; day <= KAlarmItem::LastDay;
+             ++day)
+        {
+            if (item.isWeekDayEnabled(static_cast<KAlarmItem::KWeekDay>(day)))
+                weekDays |= 1 << day;
+        }
+
+        const KAlarmCalendar *excluded = calendar(item);
+
+        // FNV-1a over 64-bit values, without allocation
+        quint64 h = Q_UINT64_C(14695981039346656037);
+
+        h = (h ^ static_cast<quint64>(item.alarmType()))
+                * Q_UINT64_C(1099511628211);
+        h = (h ^ static_cast<quint64>(QTime(0, 0).msecsTo(item.startTime())))
+                * Q_UINT64_C(1099511628211);
+        h = (h ^ static_cast<quint64>(
+                 QTime(0, 0).msecsTo(item.intervalTime())))
+                * Q_UINT64_C(1099511628211);
+        h = (h ^ static_cast<quint64>(weekDays)) * Q_UINT64_C(1099511628211);
+        h = (h ^ (excluded ? _calendarHashes.value(excluded->name()) : 0))
+                * Q_UINT64_C(1099511628211);
+
+        return h;
+    }
+
+    /*
+     * Process alarms up to the current minute. Alarms from the minute
+     * processed last are due, so that alarms are alarmed late instead of
+     * being lost if a tick is delayed across minutes. Due entries are
+     * appended to bells, and ids of rescheduled alarms to rescheduled.
+     */
+    void tick(QList<Entry> *bells, QList<quint32> *rescheduled)
+    {
+        QDateTime current(_clock.now());
+
+        // Clear seconds and milli-seconds parts
+        QDateTime currentMinute(current.date(),
+                                QTime(current.time().hour(),
+                                      current.time().minute()));
+
+        QDateTime fromMinute(_lastMinute.isValid()
+                             && _lastMinute < currentMinute
+                             ? _lastMinute : currentMinute);
+
+        _lastMinute = currentMinute;
+
+        qint64 currentKey = currentMinute.toMSecsSinceEpoch();
+
+        while (!_heap.isEmpty() && _heap.first().key <= currentKey)
+        {
+            quint32 id = _heap.first().id;
+            Entry &entry = _entries[id];
+            QDateTime dt(entry.next);
+
+            bool singleShot =
+                    entry.item.alarmType() == KAlarmItem::SingleShotAlarm;
+
+            if (dt >= fromMinute)
+            {
+                bells->append(entry);
+
+                // Remove single-shot alarm to prevent from alarming
+                // repeately until a minute is changed.
+                if (singleShot)
+                {
+                    remove(id);
+                    continue;
+                }
+            }
+            else if (singleShot)
+            {
+                // A single-shot alarm passed before the minute processed
+                // last, is never alarmed. Keep it out of a heap.
+                heapRemove(entry.heapIndex);
+                continue;
+            }
+
+            // Passed alarms are rescheduled, too. For example, alarms
+            // passed while a system was suspended.
+            QDateTime next(findNextAlarm(entry.item, dt));
+
+            if (next <= dt)
+            {
+                // Cannot be rescheduled
+                heapRemove(entry.heapIndex);
+                continue;
+            }
+
+            entry.next = next;
+            heapUpdate(entry.heapIndex, next.toMSecsSinceEpoch());
+
+            if (rescheduled)
+                rescheduled->append(id);
+        }
+    }
+
+    QDateTime findNextAlarm(const KAlarmItem &item, const QDateTime &dt,
+                            bool inclusive = false) const
+    {
+        QDateTime current(_clock.now());
+
+        // Clear seconds and milli-seconds parts
+        current.setTime(QTime(current.time().hour(),
+                              current.time().minute()));
+
+        QDateTime nextAlarm(dt);
+        const KAlarmCalendar *excluded = calendar(item);
+
+        if (item.alarmType() == KAlarmItem::IntervalAlarm)
+        {
+            qint64 interval = item.intervalTime().hour() * 3600 +
+                              item.intervalTime().minute() * 60;
+
+            if (inclusive && nextAlarm >= current)
+                return skipExcludedDays(excluded, nextAlarm, interval);
+
+            if (interval <= 0)
+                return nextAlarm;
+
+            // Jump to the last alarm not after current at once, instead of
+            // adding an interval repeatedly
+            if (nextAlarm <= current)
+            {
+                qint64 steps = nextAlarm.secsTo(current) / interval;
+
+                nextAlarm = nextAlarm.addSecs(steps * interval);
+
+                if (!(inclusive && nextAlarm == current))
+                    nextAlarm = nextAlarm.addSecs(interval);
+            }
+
+            return skipExcludedDays(excluded, nextAlarm, interval);
+        }
+        else if (item.alarmType() == KAlarmItem::WeeklyAlarm)
+        {
+            if (excluded)
+            {
+                int weekDays = 0;
+                for (int day = KAlarmItem::FirstDay;
+                     day <= KAlarmItem::LastDay; ++day)
+                {
+                    if (item.isWeekDayEnabled(
+                            static_cast<KAlarmItem::KWeekDay>(day)))
+                        weekDays |= 1 << day;
+                }
+
+                QDate from(nextAlarm.date());
+                if (!(inclusive && nextAlarm >= current))
+                    from = from.addDays(1);
+
+                // Excluded days are skipped by bits, not day by day
+                QDate next(excluded->nextOccurrence(from, weekDays));
+
+                return next.isValid() ? QDateTime(next, nextAlarm.time())
+                                      : nextAlarm;
+            }
+
+            if (inclusive
+                    && item.isWeekDayEnabled(
+                        item.numToWeekDay(nextAlarm.date().dayOfWeek()))
+                    && nextAlarm >= current)
+                return nextAlarm;
+
+            for (int days = 1; days <= 7; ++days)
+            {
+                int dayOfWeek = nextAlarm.addDays(days).date().dayOfWeek();
+
+                if (item.isWeekDayEnabled(item.numToWeekDay(dayOfWeek)))
+                {
+                    nextAlarm = nextAlarm.addDays(days);
+                    break;
+                }
+            }
+        }
+
+        return nextAlarm;
+    }
+
+private:
+    struct HeapNode
+    {
+        qint64 key;     // next alarm time in milli-seconds since epoch
+        quint32 id;
+    };
+
+    // A heap index of an entry whose heap node is to be replaced
+    enum { ChangedIndex = -2 };
+
+    // Entries per chunk of parallel computation, at least
+    enum { minChunkSize = 1024 };
+
+    /* Next alarm times and heap nodes of entries, computed by a worker */
+    struct NextAlarmChunk
+    {
+        const KAlarmSchedule *schedule;
+        QDate today;
+        Entry **entries;
+        HeapNode *nodes;
+        int count;
+
+        void run()
+        {
+            for (int i = 0; i < count; ++i)
+            {
+                Entry *entry = entries[i];
+                QDateTime dt(today, entry->item.startTime());
+
+                entry->next = schedule->findNextAlarm(entry->item, dt, true);
+
+                nodes[i].key = entry->next.toMSecsSinceEpoch();
+                nodes[i].id = entry->item.id();
+            }
+        }
+    };
+
+    Clock _clock;
+    QHash<quint32, Entry> _entries;
+    QHash<QString, KAlarmCalendar> _calendars;
+    QHash<QString, QString> _groupCalendars;
+    QHash<QString, quint64> _calendarHashes;
+    QVector<HeapNode> _heap;
+    QDateTime _lastMinute;
+
+    /* The current time without seconds and milli-seconds, as a key */
+    qint64 currentMinuteKey() const
+    {
+        QDateTime current(_clock.now());
+
+        current.setTime(QTime(current.time().hour(),
+                              current.time().minute()));
+
+        return current.toMSecsSinceEpoch();
+    }
+
+    bool isCacheValid(const KAlarmItem &item, const CachedNext &cached,
+                      const QDate &evaluated, const QDate &today,
+                      qint64 currentKey) const
+    {
+        // Other alarms are scheduled from a start time of a day
+        if (item.alarmType() != KAlarmItem::WeeklyAlarm
+                && evaluated != today)
+            return false;
+
+        return cached.next >= currentKey
+                && cached.ruleHash == ruleHash(item);
+    }
+
+    /* Move an interval alarm on an excluded day to the next day */
+    static QDateTime skipExcludedDays(const KAlarmCalendar *excluded,
+                                      const QDateTime &dt, qint64 interval)
+    {
+        if (!excluded || interval <= 0 || !excluded->isExcluded(dt.date()))
+            return dt;
+
+        // The first alarm on the next day not excluded
+        QDateTime day(excluded->nextIncluded(dt.date()), QTime(0, 0));
+        qint64 steps = (dt.secsTo(day) + interval - 1) / interval;
+
+        return dt.addSecs(steps * interval);
+    }
+
+    void schedule(const KAlarmItem &item, const QDateTime &next)
+    {
+        Entry &entry = _entries[item.id()];
+
+        entry.item = item;
+        entry.next = next;
+
+        qint64 key = next.toMSecsSinceEpoch();
+
+        if (isPassedSingleShot(item, key, currentMinuteKey()))
+        {
+            if (entry.heapIndex != -1)
+                heapRemove(entry.heapIndex);
+
+            return;
+        }
+
+        if (entry.heapIndex == -1)
+        {
+            HeapNode node;
+            node.key = key;
+            node.id = item.id();
+
+            entry.heapIndex = _heap.size();
+            _heap.append(node);
+            siftUp(entry.heapIndex);
+        }
+        else
+            heapUpdate(entry.heapIndex, key);
+    }
+
+    /*
+     * A single-shot alarm before the current minute is never alarmed, even
+     * if the minute processed last is earlier, as when a timer sleeps long
+     */
+    static bool isPassedSingleShot(const KAlarmItem &item, qint64 key,
+                                   qint64 currentKey)
+    {
+        return item.alarmType() == KAlarmItem::SingleShotAlarm
+                && key < currentKey;
+    }
+
+    /* Whether rebuilding a heap is cheaper than updating it count times */
+    bool isBulk(int count) const
+    {
+        return count > 16 && count > _heap.size() / 16;
+    }
+
+    /*
+     * Rebuild a heap from nodes of entries left unchanged in it and from
+     * changed nodes, and heapify in O(n). Keys of unchanged nodes are not
+     * computed again.
+     */
+    void rebuildHeap(const QVector<HeapNode> &changed = QVector<HeapNode>())
+    {
+        QVector<HeapNode> heap;
+        heap.reserve(_heap.size() + changed.size());
+
+        for (int i = 0; i < _heap.size(); ++i)
+        {
+            typename QHash<quint32, Entry>::const_iterator it =
+                    _entries.constFind(_heap.at(i).id);
+
+            // Removed or changed entries are left out
+            if (it != _entries.constEnd() && it.value().heapIndex == i)
+                heap.append(_heap.at(i));
+        }
+
+        heap += changed;
+        _heap.swap(heap);
+
+        for (int i = 0; i < _heap.size(); ++i)
+            _entries[_heap.at(i).id].heapIndex = i;
+
+        for (int i = _heap.size() / 2 - 1; i >= 0; --i)
+            siftDown(i);
+    }
+
+    void heapSet(int i, const HeapNode &node)
+    {
+        _heap[i] = node;
+        _entries[node.id].heapIndex = i;
+    }
+
+    void siftUp(int i)
+    {
+        HeapNode node(_heap.at(i));
+
+        while (i > 0)
+        {
+            int parent = (i - 1) / 2;
+
+            if (_heap.at(parent).key <= node.key)
+                break;
+
+            heapSet(i, _heap.at(parent));
+            i = parent;
+        }
+
+        heapSet(i, node);
+    }
+
+    void siftDown(int i)
+    {
+        HeapNode node(_heap.at(i));
+        int size = _heap.size();
+
+        for (;;)
+        {
+            int child = 2 * i + 1;
+
+            if (child >= size)
+                break;
+
+            if (child + 1 < size
+                    && _heap.at(child + 1).key < _heap.at(child).key)
+                ++child;
+
+            if (node.key <= _heap.at(child).key)
+                break;
+
+            heapSet(i, _heap.at(child));
+            i = child;
+        }
+
+        heapSet(i, node);
+    }
+
+    void heapUpdate(int i, qint64 key)
+    {
+        qint64 oldKey = _heap.at(i).key;
+
+        _heap[i].key = key;
+
+        if (key < oldKey)
+            siftUp(i);
+        else
+            siftDown(i);
+    }
+
+    void heapRemove(int i)
+    {
+        _entries[_heap.at(i).id].heapIndex = -1;
+
+        HeapNode last(_heap.last());
+        _heap.pop_back();
+
+        if (i == _heap.size())
+            return;
+
+        qint64 oldKey = _heap.at(i).key;
+
+        heapSet(i, last);
+
+        if (last.key < oldKey)
+            siftUp(i);
+        else
+            siftDown(i);
+    }
+};
+
+#endif // KALARMSCHEDULE_H
@@ -0,0 +1,385 @@
+/****************************************************************************
+**
+** KAlarmSearchIndex, a search index for alarm items
+**
+** Copyright (C) 2015 by KO Myung-Hun
+** All rights reserved.
+** Contact: KO Myung-Hun (komh@chollian.net)
+**
+** This file is part of K Alarm
+**
+** $BEGIN_LICENSE$
+**
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** $END_LICENSE$
+**
+****************************************************************************/
+
+#include "kalarmsearchindex.h"
+
+KAlarmSearchIndex::KAlarmSearchIndex()
+{
+}
+
+KAlarmSearchIndex::~KAlarmSearchIndex()
+{
+}
+
+void KAlarmSearchIndex::add(const KAlarmItemWidget *w)
+{
+    if (_slotMap.contains(w))
+    {
+        modify(w);
+
+        return;
+    }
+
+    int slot;
+
+    if (!_freeSlots.isEmpty())
+    {
+        slot = _freeSlots.last();
+        _freeSlots.pop_back();
+    }
+    else
+    {
+        slot = _slots.size();
+        resize(slot + 1);
+    }
+
+    _slotMap.insert(w, slot);
+    _slots[slot] = w;
+
+    indexSlot(slot, w);
+}
+
+void KAlarmSearchIndex::remove(const KAlarmItemWidget *w)
+{
+    int slot = _slotMap.value(w, -1);
+
+    if (slot == -1)
+        return;
+
+    unindexSlot(slot);
+
+    _slotMap.remove(w);
+    _slots[slot] = 0;
+    _freeSlots.append(slot);
+}
+
+void KAlarmSearchIndex::modify(const KAlarmItemWidget *w)
+{
+    int slot = _slotMap.value(w, -1);
+
+    if (slot == -1)
+    {
+        add(w);
+
+        return;
+    }
+
+    unindexSlot(slot);
+    indexSlot(slot, w);
+}
+
+bool KAlarmSearchIndex::isMatched(const KAlarmItemWidget *w) const
+{
+    int slot = _slotMap.value(w, -1);
+
+    return slot != -1 && _matched.testBit(slot);
+}
+
+QList<const KAlarmItemWidget *> KAlarmSearchIndex::setFilter(
+        const QString &filter)
+{
+    _query = parse(filter);
+
+    QBitArray matched(matchAll(_query));
+    QBitArray changed(matched ^ _matched);
+
+    _matched = matched;
+
+    QList<const KAlarmItemWidget *> changedList;
+
+    for (int slot = 0; slot < changed.size(); ++slot)
+    {
+        if (changed.testBit(slot))
+            changedList.append(_slots.at(slot));
+    }
+
+    return changedList;
+}
+
+QString KAlarmSearchIndex::indexText(const KAlarmItemWidget *w)
+{
+    // '\n' never appears in a filter, so no match spans two fields
+    return (w->name() + '\n' + w->execProgramName() + '\n'
+            + w->soundFile()).toLower();
+}
+
+QList<KAlarmSearchIndex::Trigram> KAlarmSearchIndex::trigrams(
+        const QString &s)
+{
+    QList<Trigram> list;
+
+    for (int i = 0; i + 3 <= s.length(); ++i)
+    {
+        Trigram t = (static_cast<Trigram>(s.at(i).unicode()) << 32)
+                    | (static_cast<Trigram>(s.at(i + 1).unicode()) << 16)
+                    | static_cast<Trigram>(s.at(i + 2).unicode());
+
+        if (!list.contains(t))
+            list.append(t);
+    }
+
+    return list;
+}
+
+KAlarmSearchIndex::Query KAlarmSearchIndex::parse(const QString &filter)
+{
+    static const char *typeNames[] = {"interval", "weekly", "single"};
+    static const char *dayNames[] = {"mon", "tue", "wed", "thu", "fri",
+                                     "sat", "sun"};
+
+    Query q;
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+    const Qt::SplitBehavior skipEmptyParts = Qt::SkipEmptyParts;
+#else
+    const QString::SplitBehavior skipEmptyParts = QString::SkipEmptyParts;
+#endif
+
+    foreach (const QString &word,
+             filter.toLower().split(' ', skipEmptyParts))
+    {
+        if (word.startsWith("type:"))
+        {
+            QString value(word.mid(5));
+
+            for (int i = 0; i < 3; ++i)
+            {
+                if (value == typeNames[i])
+                    q.alarmType = i;
+            }
+        }
+        else if (word.startsWith("day:"))
+        {
+            QString value(word.mid(4));
+
+            for (int i = KAlarmItem::FirstDay;
+                 i <= KAlarmItem::LastDay; ++i)
+            {
+                if (value == dayNames[i])
+                    q.weekDayMask |= 1 << i;
+            }
+        }
+        else if (word == "is:enabled")
+            q.enabled = 1;
+        else if (word == "is:disabled")
+            q.enabled = 0;
+        else
+            q.texts.append(word);
+    }
+
+    return q;
+}
+
+void KAlarmSearchIndex::indexSlot(int slot, const KAlarmItemWidget *w)
+{
+    QString text(indexText(w));
+
+    _texts[slot] = text;
+
+    foreach (Trigram t, trigrams(text))
+        _trigrams[t].insert(slot);
+
+    _used.setBit(slot);
+
+    _attrs[AttrEnabled].setBit(slot, w->isAlarmEnabled());
+    _attrs[AttrIntervalAlarm].setBit(
+                slot, w->alarmType() == KAlarmItem::IntervalAlarm);
+    _attrs[AttrWeeklyAlarm].setBit(
+                slot, w->alarmType() == KAlarmItem::WeeklyAlarm);
+    _attrs[AttrSingleShotAlarm].setBit(
+                slot, w->alarmType() == KAlarmItem::SingleShotAlarm);
+
+    for (int day = KAlarmItem::FirstDay;
+         day <= KAlarmItem::LastDay; ++day)
+    {
+        _attrs[AttrFirstWeekDay + day].setBit(
+                    slot,
+                    w->alarmType() == KAlarmItem::WeeklyAlarm
+                    && w->isWeekDayEnabled(
+                        static_cast<KAlarmItem::KWeekDay>(day)));
+    }
+
+    // Only this slot is matched again instead of all the slots
+    _matched.setBit(slot, matchSlot(slot, _query));
+}
+
+void KAlarmSearchIndex::unindexSlot(int slot)
+{
+    foreach (Trigram t, trigrams(_texts.at(slot)))
+    {
+        QHash<Trigram, QSet<int> >::iterator it = _trigrams.find(t);
+
+        if (it != _trigrams.end())
+        {
+            it.value().remove(slot);
+
+            if (it.value().isEmpty())
+                _trigrams.erase(it);
+        }
+    }
+
+    _texts[slot].clear();
+
+    _used.clearBit(slot);
+
+    for (int i = 0; i < AttrCount; ++i)
+        _attrs[i].clearBit(slot);
+
+    _matched.clearBit(slot);
+}
+
+void KAlarmSearchIndex::resize(int size)
+{
+    _slots.resize(size);
+    _texts.resize(size);
+    _used.resize(size);
+    _matched.resize(size);
+
+    for (int i = 0; i < AttrCount; ++i)
+        _attrs[i].resize(size);
+}
+
+bool KAlarmSearchIndex::matchSlot(int slot, const Query &q) const
+{
+    if (!_used.testBit(slot))
+        return false;
+
+    if (q.alarmType != -1
+            && !_attrs[AttrIntervalAlarm + q.alarmType].testBit(slot))
+        return false;
+
+    for (int day = KAlarmItem::FirstDay;
+         day <= KAlarmItem::LastDay; ++day)
+    {
+        if ((q.weekDayMask & (1 << day))
+                && !_attrs[AttrFirstWeekDay + day].testBit(slot))
+            return false;
+    }
+
+    if (q.enabled != -1 && _attrs[AttrEnabled].testBit(slot) != !!q.enabled)
+        return false;
+
+    foreach (const QString &text, q.texts)
+    {
+        if (!_texts.at(slot).contains(text))
+            return false;
+    }
+
+    return true;
+}
+
+QBitArray KAlarmSearchIndex::matchAll(const Query &q) const
+{
+    QBitArray candidates(_used);
+
+    if (q.isEmpty())
+        return candidates;
+
+    // Attributes are matched with bitsets
+    if (q.alarmType != -1)
+        candidates &= _attrs[AttrIntervalAlarm + q.alarmType];
+
+    for (int day = KAlarmItem::FirstDay;
+         day <= KAlarmItem::LastDay; ++day)
+    {
+        if (q.weekDayMask & (1 << day))
+            candidates &= _attrs[AttrFirstWeekDay + day];
+    }
+
+    if (q.enabled == 1)
+        candidates &= _attrs[AttrEnabled];
+    else if (q.enabled == 0)
+        candidates &= ~_attrs[AttrEnabled];
+
+    // Texts are matched with trigrams. A text shorter than a trigram is
+    // verified against the indexed texts of the remaining candidates.
+    foreach (const QString &text, q.texts)
+    {
+        QList<Trigram> textTrigrams(trigrams(text));
+
+        if (textTrigrams.isEmpty())
+        {
+            for (int slot = 0; slot < candidates.size(); ++slot)
+            {
+                if (candidates.testBit(slot)
+                        && !_texts.at(slot).contains(text))
+                    candidates.clearBit(slot);
+            }
+
+            continue;
+        }
+
+        // Start from the smallest posting set
+        const QSet<int> *smallest = 0;
+        QList<const QSet<int> *> postings;
+
+        foreach (Trigram t, textTrigrams)
+        {
+            QHash<Trigram, QSet<int> >::const_iterator it =
+                    _trigrams.constFind(t);
+
+            if (it == _trigrams.constEnd())
+            {
+                smallest = 0;
+                postings.clear();
+                break;
+            }
+
+            postings.append(&it.value());
+
+            if (!smallest || it.value().size() < smallest->size())
+                smallest = &it.value();
+        }
+
+        QBitArray matched(candidates.size());
+
+        if (smallest)
+        {
+            foreach (int slot, *smallest)
+            {
+                if (!candidates.testBit(slot))
+                    continue;
+
+                bool inAll = true;
+
+                foreach (const QSet<int> *posting, postings)
+                {
+                    if (posting != smallest && !posting->contains(slot))
+                    {
+                        inAll = false;
+                        break;
+                    }
+                }
+
+                // Trigrams may be in a different order
+                if (inAll && _texts.at(slot).contains(text))
+                    matched.setBit(slot);
+            }
+        }
+
+        candidates = matched;
+    }
+
+    return candidates;
+}
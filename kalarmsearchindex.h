@@ -0,0 +1,121 @@
+/****************************************************************************
+**
+** KAlarmSearchIndex, a search index for alarm items
+**
+** Copyright (C) 2015 by KO Myung-Hun
+** All rights reserved.
+** Contact: KO Myung-Hun (komh@chollian.net)
+**
+** This file is part of K Alarm
+**
+** $BEGIN_LICENSE$
+**
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** $END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef KALARMSEARCHINDEX_H
+#define KALARMSEARCHINDEX_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QHash>
+#include <QSet>
+#include <QBitArray>
+#include <QList>
+
+#include "kalarmitemwidget.h"
+
+/*
+ * Filter syntax
+ *
+ *  Words are separated by spaces and all of them should be matched.
+ *
+ *  text          a name, a program or a sound file contains text
+ *  type:interval an interval alarm. Also, type:weekly and type:single
+ *  day:mon       a weekly alarm on Monday. Also, day:tue ... day:sun
+ *  is:enabled    an enabled alarm. Also, is:disabled
+ */
+class KAlarmSearchIndex
+{
+public:
+    KAlarmSearchIndex();
+    ~KAlarmSearchIndex();
+
+    void add(const KAlarmItemWidget *w);
+    void remove(const KAlarmItemWidget *w);
+    void modify(const KAlarmItemWidget *w);
+
+    /* Whether w matches the current filter */
+    bool isMatched(const KAlarmItemWidget *w) const;
+
+    /* Set the current filter and return items whose match state changed */
+    QList<const KAlarmItemWidget *> setFilter(const QString &filter);
+
+private:
+    struct Query
+    {
+        QStringList texts;  // lower-cased
+        int alarmType;      // -1 for any type
+        int weekDayMask;    // weekdays which should be enabled
+        int enabled;        // -1 for any state
+
+        Query() : alarmType(-1), weekDayMask(0), enabled(-1) {}
+
+        bool isEmpty() const
+        {
+            return texts.isEmpty() && alarmType == -1 && weekDayMask == 0
+                    && enabled == -1;
+        }
+    };
+
+    enum
+    {
+        AttrEnabled = 0,
+        AttrIntervalAlarm,
+        AttrWeeklyAlarm,
+        AttrSingleShotAlarm,
+        AttrFirstWeekDay,
+        AttrCount = AttrFirstWeekDay + KAlarmItem::LastDay + 1
+    };
+
+    typedef quint64 Trigram;
+
+    QHash<const KAlarmItemWidget *, int> _slotMap;
+    QVector<const KAlarmItemWidget *> _slots;
+    QVector<int> _freeSlots;
+
+    // Lower-cased name, program and sound file joined by '\n'
+    QVector<QString> _texts;
+
+    QHash<Trigram, QSet<int> > _trigrams;
+    QBitArray _attrs[AttrCount];
+
+    // Slots in use
+    QBitArray _used;
+
+    Query _query;
+    QBitArray _matched;
+
+    static QString indexText(const KAlarmItemWidget *w);
+    static QList<Trigram> trigrams(const QString &s);
+    static Query parse(const QString &filter);
+
+    void indexSlot(int slot, const KAlarmItemWidget *w);
+    void unindexSlot(int slot);
+    void resize(int size);
+
+    bool matchSlot(int slot, const Query &q) const;
+    QBitArray matchAll(const Query &q) const;
+};
+
+#endif // KALARMSEARCHINDEX_H
@@ -0,0 +1,91 @@
+/****************************************************************************
+**
+** KAlarmStartupProfile, a start-up timing profiler for K Alarm
+**
+** Copyright (C) 2015 by KO Myung-Hun
+** All rights reserved.
+** Contact: KO Myung-Hun (komh@chollian.net)
+**
+** This file is part of K Alarm
+**
+** $BEGIN_LICENSE$
+**
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** $END_LICENSE$
+**
+****************************************************************************/
+
+#include "kalarmstartupprofile.h"
+
+#include <QTimer>
+
+#include <cstdio>
+
+KAlarmStartupProfile::KAlarmStartupProfile(QObject *parent)
+    : QObject(parent)
+    , _enabled(false)
+    , _lastElapsed(0)
+{
+}
+
+KAlarmStartupProfile *KAlarmStartupProfile::instance()
+{
+    static KAlarmStartupProfile profile;
+
+    return &profile;
+}
+
+void KAlarmStartupProfile::start()
+{
+    KAlarmStartupProfile *p = instance();
+
+    p->_enabled = true;
+    p->_timer.start();
+    p->_lastElapsed = 0;
+
+    fprintf(stderr, "%-32s %10s %10s\n", "phase", "ms", "total ms");
+}
+
+bool KAlarmStartupProfile::isEnabled()
+{
+    return instance()->_enabled;
+}
+
+void KAlarmStartupProfile::mark(const char *phase)
+{
+    KAlarmStartupProfile *p = instance();
+
+    if (!p->_enabled)
+        return;
+
+    qint64 elapsed = p->_timer.elapsed();
+
+    fprintf(stderr, "%-32s %10lld %10lld\n", phase,
+            static_cast<long long>(elapsed - p->_lastElapsed),
+            static_cast<long long>(elapsed));
+
+    p->_lastElapsed = elapsed;
+}
+
+void KAlarmStartupProfile::finishOnEventLoop()
+{
+    if (!isEnabled())
+        return;
+
+    // Called when an event loop processes its first events
+    QTimer::singleShot(0, instance(), SLOT(eventLoopEntered()));
+}
+
+void KAlarmStartupProfile::eventLoopEntered()
+{
+    mark("event loop entered");
+
+    _enabled = false;
+}
@@ -0,0 +1,58 @@
+/****************************************************************************
+**
+** KAlarmStartupProfile, a start-up timing profiler for K Alarm
+**
+** Copyright (C) 2015 by KO Myung-Hun
+** All rights reserved.
+** Contact: KO Myung-Hun (komh@chollian.net)
+**
+** This file is part of K Alarm
+**
+** $BEGIN_LICENSE$
+**
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** $END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef KALARMSTARTUPPROFILE_H
+#define KALARMSTARTUPPROFILE_H
+
+#include <QObject>
+#include <QElapsedTimer>
+
+class KAlarmStartupProfile : public QObject
+{
+    Q_OBJECT
+public:
+    static KAlarmStartupProfile *instance();
+
+    /* Start profiling. Phases are printed only after this is called */
+    static void start();
+    static bool isEnabled();
+
+    /* Print the time spent since the previous phase */
+    static void mark(const char *phase);
+
+    /* Print a summary when an event loop is entered */
+    static void finishOnEventLoop();
+
+private:
+    explicit KAlarmStartupProfile(QObject *parent = 0);
+
+    bool _enabled;
+    QElapsedTimer _timer;
+    qint64 _lastElapsed;
+
+private slots:
+    void eventLoopEntered();
+};
+
+#endif // KALARMSTARTUPPROFILE_H
@@ -0,0 +1,67 @@
+/****************************************************************************
+**
+** KAlarmStatsDialog, a statistics dialog for KAlarm
+**
+** Copyright (C) 2015 by KO Myung-Hun
+** All rights reserved.
+** Contact: KO Myung-Hun (komh@chollian.net)
+**
+** This file is part of K Alarm
+**
+** $BEGIN_LICENSE$
+**
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** $END_LICENSE$
+**
+****************************************************************************/
+
+#include "kalarmstatsdialog.h"
+
+#include "kalarm.h"
+
+KAlarmStatsDialog::KAlarmStatsDialog(QWidget *parent, Qt::WindowFlags f)
+    : QDialog(parent, f)
+{
+    setWindowTitle(tr("%1 Statistics").arg(KAlarm::title()));
+
+    _textEdit = new QPlainTextEdit;
+    _textEdit->setReadOnly(true);
+    _textEdit->setLineWrapMode(QPlainTextEdit::NoWrap);
+    _textEdit->setMinimumSize(480, 320);
+
+    QPushButton *refreshButton = new QPushButton(tr("&Refresh"));
+    QPushButton *closeButton = new QPushButton(tr("Close"));
+    closeButton->setDefault(true);
+
+    QHBoxLayout *buttonLayout = new QHBoxLayout;
+    buttonLayout->addStretch(1);
+    buttonLayout->addWidget(refreshButton);
+    buttonLayout->addWidget(closeButton);
+
+    QVBoxLayout *mainLayout = new QVBoxLayout;
+    mainLayout->addWidget(_textEdit);
+    mainLayout->addLayout(buttonLayout);
+
+    setLayout(mainLayout);
+
+    connect(refreshButton, SIGNAL(clicked()),
+            this, SIGNAL(refreshRequested()));
+    connect(closeButton, SIGNAL(clicked()), this, SLOT(accept()));
+}
+
+KAlarmStatsDialog::~KAlarmStatsDialog()
+{
+
+}
+
+void KAlarmStatsDialog::setText(const QString &text)
+{
+    _textEdit->setPlainText(text);
+}
@@ -0,0 +1,54 @@
+/****************************************************************************
+**
+** KAlarmStatsDialog, a statistics dialog for KAlarm
+**
+** Copyright (C) 2015 by KO Myung-Hun
+** All rights reserved.
+** Contact: KO Myung-Hun (komh@chollian.net)
+**
+** This file is part of K Alarm
+**
+** $BEGIN_LICENSE$
+**
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** $END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef KALARMSTATSDIALOG_H
+#define KALARMSTATSDIALOG_H
+
+#include <QDialog>
+
+#ifdef CONFIG_QT5
+#include <QtWidgets>
+#else
+#include <QtGui>
+#endif
+
+class KAlarmStatsDialog : public QDialog
+{
+    Q_OBJECT
+
+public:
+    KAlarmStatsDialog(QWidget *parent = 0, Qt::WindowFlags f = 0);
+    ~KAlarmStatsDialog();
+
+    void setText(const QString &text);
+
+signals:
+    /* Emitted when statistics should be updated with setText() */
+    void refreshRequested();
+
+private:
+    QPlainTextEdit *_textEdit;
+};
+
+#endif // KALARMSTATSDIALOG_H
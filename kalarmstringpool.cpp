@@ -0,0 +1,138 @@
+/****************************************************************************
+**
+** KAlarmStringPool, strings shared by alarms
+**
+** Copyright (C) 2015 by KO Myung-Hun
+** All rights reserved.
+** Contact: KO Myung-Hun (komh@chollian.net)
+**
+** This file is part of K Alarm.
+**
+** $BEGIN_LICENSE$
+**
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** $END_LICENSE$
+**
+****************************************************************************/
+
+
+#include "kalarmstringpool.h"
+
+#include <QVector>
+#include <QReadWriteLock>
+#include <QStringList>
+
+struct KAlarmStringPoolData
+{
+    KAlarmStringPoolData()
+    {
+        strings.append(QString());
+    }
+
+    QReadWriteLock lock;
+    QVector<QString> strings;       // by id
+    QHash<QString, quint32> ids;
+};
+
+Q_GLOBAL_STATIC(KAlarmStringPoolData, poolData)
+
+quint32 KAlarmStringPool::intern(const QString &s)
+{
+    if (s.isEmpty())
+        return 0;
+
+    KAlarmStringPoolData *d = poolData();
+
+    {
+        QReadLocker locker(&d->lock);
+
+        QHash<QString, quint32>::const_iterator it = d->ids.constFind(s);
+        if (it != d->ids.constEnd())
+            return it.value();
+    }
+
+    QWriteLocker locker(&d->lock);
+
+    // Interned by another thread in the meantime?
+    QHash<QString, quint32>::const_iterator it = d->ids.constFind(s);
+    if (it != d->ids.constEnd())
+        return it.value();
+
+    quint32 id = d->strings.size();
+
+    d->strings.append(s);
+    d->ids.insert(s, id);
+
+    return id;
+}
+
+QString KAlarmStringPool::string(quint32 id)
+{
+    KAlarmStringPoolData *d = poolData();
+
+    QReadLocker locker(&d->lock);
+
+    return id < static_cast<quint32>(d->strings.size()) ? d->strings.at(id)
+                                                         : QString();
+}
+
+int KAlarmStringPool::count()
+{
+    KAlarmStringPoolData *d = poolData();
+
+    QReadLocker locker(&d->lock);
+
+    // An empty string is not counted
+    return d->strings.size() - 1;
+}
+
+void KAlarmStringTable::load(QSettings &settings)
+{
+    _ids.clear();
+    _indexes.clear();
+
+    foreach (const QString &s, settings.value("Strings").toStringList())
+    {
+        quint32 id = KAlarmStringPool::intern(s);
+
+        _ids.append(id);
+        _indexes.insert(id, _ids.size());
+    }
+}
+
+void KAlarmStringTable::save(QSettings &settings) const
+{
+    QStringList strings;
+
+    foreach (quint32 id, _ids)
+        strings.append(KAlarmStringPool::string(id));
+
+    settings.setValue("Strings", strings);
+}
+
+int KAlarmStringTable::insert(quint32 id)
+{
+    if (id == 0)
+        return 0;
+
+    QHash<quint32, int>::const_iterator it = _indexes.constFind(id);
+    if (it != _indexes.constEnd())
+        return it.value();
+
+    _ids.append(id);
+    _indexes.insert(id, _ids.size());
+
+    return _ids.size();
+}
+
+quint32 KAlarmStringTable::id(int index) const
+{
+    return index > 0 && index <= _ids.size() ? _ids.at(index - 1) : 0;
+}
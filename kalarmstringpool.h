@@ -0,0 +1,75 @@
+/****************************************************************************
+**
+** KAlarmStringPool, strings shared by alarms
+**
+** Copyright (C) 2015 by KO Myung-Hun
+** All rights reserved.
+** Contact: KO Myung-Hun (komh@chollian.net)
+**
+** This file is part of K Alarm.
+**
+** $BEGIN_LICENSE$
+**
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** $END_LICENSE$
+**
+****************************************************************************/
+
+
+#ifndef KALARMSTRINGPOOL_H
+#define KALARMSTRINGPOOL_H
+
+#include <QString>
+#include <QList>
+#include <QHash>
+#include <QSettings>
+
+/*
+ * KAlarmStringPool interns strings repeated by many alarms such as sound
+ * files and programs, so that alarms hold ids instead of their own copies.
+ * Strings are never removed, so an id is valid until exit for any copy of
+ * an alarm, however long it lives. Only strings of alarms are saved, as a
+ * store builds its table on save. It is thread-safe, and id 0 is always an
+ * empty string.
+ */
+class KAlarmStringPool
+{
+public:
+    static quint32 intern(const QString &s);
+
+    /* A string of id, which shares data with a pooled one */
+    static QString string(quint32 id);
+
+    static int count();
+};
+
+/*
+ * KAlarmStringTable maps pooled strings to indexes of "Strings" of a
+ * store, so that alarms in a store refer to strings by index. Index 0 is
+ * an empty string and is not saved.
+ */
+class KAlarmStringTable
+{
+public:
+    void load(QSettings &settings);
+    void save(QSettings &settings) const;
+
+    /* An index of a pooled string, which is added if not in a table */
+    int insert(quint32 id);
+
+    /* A pooled id of index, or 0 if out of range */
+    quint32 id(int index) const;
+
+private:
+    QList<quint32> _ids;
+    QHash<quint32, int> _indexes;
+};
+
+#endif // KALARMSTRINGPOOL_H
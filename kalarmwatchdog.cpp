@@ -0,0 +1,356 @@
+/****************************************************************************
+**
+** KAlarmWatchdog, detects stalls of event loops
+**
+** Copyright (C) 2015 by KO Myung-Hun
+** All rights reserved.
+** Contact: KO Myung-Hun (komh@chollian.net)
+**
+** This file is part of K Alarm
+**
+** $BEGIN_LICENSE$
+**
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** $END_LICENSE$
+**
+****************************************************************************/
+
+#include "kalarmwatchdog.h"
+
+#include <QFile>
+#include <QTextStream>
+
+#include "kalarmpaths.h"
+
+// Maximum number of stalls kept for a summary
+static const int MaxRecentStalls = 10;
+
+// Heartbeats are checked four times in a threshold, but not so often as
+// to keep event loops busy
+static const int MinCheckInterval = 250;
+
+KAlarmHeartbeat::KAlarmHeartbeat(QObject *parent)
+    : QObject(parent)
+    , _serviced(0)
+{
+}
+
+int KAlarmHeartbeat::serviced() const
+{
+    return const_cast<QAtomicInt &>(_serviced).fetchAndAddOrdered(0);
+}
+
+void KAlarmHeartbeat::beat(int seq)
+{
+    _serviced.fetchAndStoreOrdered(seq);
+}
+
+QMutex KAlarmWatchdog::_activityMutex;
+QHash<QThread *, QStringList> KAlarmWatchdog::_activities;
+
+KAlarmWatchdog::KAlarmWatchdog(QObject *parent)
+    : QObject(parent)
+    , _timer(0)
+    , _threshold(1000)
+    , _stallCount(0)
+    , _maxStallDuration(0)
+    , _delayedAlarmCount(0)
+{
+}
+
+KAlarmWatchdog::~KAlarmWatchdog()
+{
+    foreach (const Loop &loop, _loops)
+        delete loop.heartbeat;
+}
+
+void KAlarmWatchdog::watch(const QString &name, QThread *thread,
+                           bool presentsAlarms)
+{
+    Loop loop;
+
+    loop.name = name;
+    loop.thread = thread;
+    loop.presentsAlarms = presentsAlarms;
+    loop.heartbeat = new KAlarmHeartbeat;
+    loop.heartbeat->moveToThread(thread);
+    loop.seq = 0;
+    loop.sentAt = -1;
+    loop.stalled = false;
+    loop.ending = false;
+    loop.stallDuration = 0;
+
+    _loops.append(loop);
+}
+
+void KAlarmWatchdog::setThreshold(int msecs)
+{
+    _threshold = msecs;
+}
+
+void KAlarmWatchdog::start()
+{
+    if (!_timer)
+    {
+        _timer = new QTimer(this);
+        connect(_timer, SIGNAL(timeout()), this, SLOT(timerTimeout()));
+    }
+
+    _clock.start();
+    _timer->start(qMax(MinCheckInterval, _threshold / 4));
+}
+
+void KAlarmWatchdog::stop()
+{
+    if (_timer)
+        _timer->stop();
+}
+
+void KAlarmWatchdog::enter(const char *activity)
+{
+    QMutexLocker locker(&_activityMutex);
+
+    _activities[QThread::currentThread()].append(QString(activity));
+}
+
+void KAlarmWatchdog::leave()
+{
+    QMutexLocker locker(&_activityMutex);
+
+    QHash<QThread *, QStringList>::iterator it =
+            _activities.find(QThread::currentThread());
+
+    if (it != _activities.end())
+    {
+        if (!it.value().isEmpty())
+            it.value().removeLast();
+
+        if (it.value().isEmpty())
+            _activities.erase(it);
+    }
+}
+
+QStringList KAlarmWatchdog::activities(QThread *thread)
+{
+    QMutexLocker locker(&_activityMutex);
+
+    return _activities.value(thread);
+}
+
+QString KAlarmWatchdog::alarmText(const KAlarmItem &item,
+                                  const QDateTime &dt)
+{
+    return QString("%1 (%2)").arg(item.name())
+                             .arg(dt.toString("yyyy-MM-dd HH:mm"));
+}
+
+void KAlarmWatchdog::alarmTriggered(const KAlarmItem &item,
+                                    const QDateTime &dt)
+{
+    QMutexLocker locker(&_mutex);
+
+    for (int i = 0; i < _loops.size(); ++i)
+    {
+        Loop &loop = _loops[i];
+
+        // An alarm triggered while a heartbeat is pending is presented
+        // after that heartbeat. It is discarded if no stall is detected.
+        if (loop.presentsAlarms && loop.sentAt != -1)
+            loop.delayedAlarms.append(alarmText(item, dt));
+
+        // A scheduler alarms alarms due during its stall when it catches
+        // up, which may be seen after the stall has ended
+        if (!loop.presentsAlarms && dt >= stallStartMinute(loop)
+                && (loop.stalled
+                    || (loop.ending && dt <= loop.stallStart.addMSecs(
+                                                 loop.stallDuration))))
+        {
+            QString text(alarmText(item, dt));
+
+            if (!loop.delayedAlarms.contains(text))
+                loop.delayedAlarms.append(text);
+        }
+    }
+}
+
+void KAlarmWatchdog::timerTimeout()
+{
+    QList<Stall> ended;
+
+    {
+        QMutexLocker locker(&_mutex);
+
+        qint64 now = _clock.elapsed();
+
+        for (int i = 0; i < _loops.size(); ++i)
+        {
+            Loop &loop = _loops[i];
+
+            // Alarms of a stall have been caught up since the last check
+            if (loop.ending)
+            {
+                ended.append(endStall(loop));
+                loop.delayedAlarms.clear();
+            }
+
+            if (loop.sentAt != -1 && loop.heartbeat->serviced() == loop.seq)
+            {
+                // A heartbeat was serviced
+                if (loop.stalled)
+                {
+                    loop.stalled = false;
+                    loop.stallDuration = now - loop.sentAt;
+
+                    // A scheduler alarms alarms due during its stall after
+                    // it, so they are collected until the next check
+                    if (loop.presentsAlarms)
+                        ended.append(endStall(loop));
+                    else
+                        loop.ending = true;
+                }
+
+                if (!loop.ending)
+                    loop.delayedAlarms.clear();
+
+                loop.sentAt = -1;
+            }
+
+            if (loop.sentAt == -1)
+            {
+                // Send a new heartbeat
+                ++loop.seq;
+                loop.sentAt = now;
+
+                QMetaObject::invokeMethod(loop.heartbeat, "beat",
+                                          Qt::QueuedConnection,
+                                          Q_ARG(int, loop.seq));
+                continue;
+            }
+
+            if (now - loop.sentAt < _threshold)
+                continue;
+
+            if (!loop.stalled)
+                stallDetected(loop);
+
+            // Record what is being executed during a stall
+            foreach (const QString &activity, activities(loop.thread))
+            {
+                if (!loop.activities.contains(activity))
+                    loop.activities.append(activity);
+            }
+        }
+
+        foreach (const Stall &stall, ended)
+            record(stall);
+    }
+
+    // A file is written without a lock, so that summary() does not wait
+    foreach (const Stall &stall, ended)
+        writeLog(stall);
+}
+
+void KAlarmWatchdog::stallDetected(Loop &loop)
+{
+    loop.stalled = true;
+    loop.stallStart = QDateTime::currentDateTime().addMSecs(
+                -(_clock.elapsed() - loop.sentAt));
+    loop.activities.clear();
+}
+
+KAlarmWatchdog::Stall KAlarmWatchdog::endStall(Loop &loop)
+{
+    Stall stall;
+
+    stall.loop = loop.name;
+    stall.start = loop.stallStart;
+    stall.duration = loop.stallDuration;
+    stall.activities = loop.activities;
+    stall.delayedAlarms = loop.delayedAlarms;
+
+    loop.ending = false;
+    loop.activities.clear();
+
+    return stall;
+}
+
+void KAlarmWatchdog::record(const Stall &stall)
+{
+    _stalls.append(stall);
+    if (_stalls.size() > MaxRecentStalls)
+        _stalls.removeFirst();
+
+    ++_stallCount;
+    _maxStallDuration = qMax(_maxStallDuration, stall.duration);
+    _delayedAlarmCount += stall.delayedAlarms.size();
+}
+
+QDateTime KAlarmWatchdog::stallStartMinute(const Loop &loop)
+{
+    QTime startTime(loop.stallStart.time());
+
+    return QDateTime(loop.stallStart.date(),
+                     QTime(startTime.hour(), startTime.minute()));
+}
+
+void KAlarmWatchdog::writeLog(const Stall &stall)
+{
+    QFile file(KAlarmPaths::dataFile("watchdog.log"));
+
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Append
+                   | QIODevice::Text))
+        return;
+
+    QTextStream out(&file);
+
+    out << stall.start.toString("yyyy-MM-dd HH:mm:ss.zzz")
+        << " " << stall.loop << " stalled for " << stall.duration << " ms"
+        << "; executing: " << (stall.activities.isEmpty()
+                               ? QString("unknown")
+                               : stall.activities.join(" > "))
+        << "; delayed alarms: " << (stall.delayedAlarms.isEmpty()
+                                    ? QString("none")
+                                    : stall.delayedAlarms.join(", "))
+        << "\n";
+}
+
+QString KAlarmWatchdog::summary() const
+{
+    QMutexLocker locker(&_mutex);
+
+    QString s;
+    QTextStream out(&s);
+
+    out << tr("Stalls longer than %1 ms: %2").arg(_threshold)
+                                              .arg(_stallCount) << "\n";
+    out << tr("Longest stall: %1 ms").arg(_maxStallDuration) << "\n";
+    out << tr("Delayed alarms: %1").arg(_delayedAlarmCount) << "\n";
+
+    if (!_stalls.isEmpty())
+        out << "\n" << tr("Recent stalls:") << "\n";
+
+    for (int i = _stalls.size() - 1; i >= 0; --i)
+    {
+        const Stall &stall = _stalls.at(i);
+
+        out << "  " << stall.start.toString("yyyy-MM-dd HH:mm:ss")
+            << "  " << tr("%1, %2 ms").arg(stall.loop).arg(stall.duration)
+            << "\n";
+
+        if (!stall.activities.isEmpty())
+            out << "    " << tr("executing: %1")
+                             .arg(stall.activities.join(" > ")) << "\n";
+
+        foreach (const QString &alarm, stall.delayedAlarms)
+            out << "    " << tr("delayed: %1").arg(alarm) << "\n";
+    }
+
+    return s;
+}
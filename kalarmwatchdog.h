@@ -0,0 +1,167 @@
+/****************************************************************************
+**
+** KAlarmWatchdog, detects stalls of event loops
+**
+** Copyright (C) 2015 by KO Myung-Hun
+** All rights reserved.
+** Contact: KO Myung-Hun (komh@chollian.net)
+**
+** This file is part of K Alarm
+**
+** $BEGIN_LICENSE$
+**
+** GNU Lesser General Public License Usage
+** This file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** $END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef KALARMWATCHDOG_H
+#define KALARMWATCHDOG_H
+
+#include <QObject>
+#include <QThread>
+#include <QTimer>
+#include <QMutex>
+#include <QElapsedTimer>
+#include <QDateTime>
+#include <QStringList>
+#include <QList>
+
+#include "kalarmitem.h"
+
+/*
+ * KAlarmHeartbeat lives in a watched thread, and records a heartbeat
+ * serviced by an event loop of that thread.
+ */
+class KAlarmHeartbeat : public QObject
+{
+    Q_OBJECT
+public:
+    explicit KAlarmHeartbeat(QObject *parent = 0);
+
+    int serviced() const;
+
+public slots:
+    void beat(int seq);
+
+private:
+    QAtomicInt _serviced;
+};
+
+/*
+ * KAlarmWatchdog runs in its own thread. It sends heartbeats to watched
+ * event loops, and records a stall when a heartbeat is not serviced within
+ * a threshold. A stall is recorded with what was being executed and with
+ * alarms delayed by it.
+ */
+class KAlarmWatchdog : public QObject
+{
+    Q_OBJECT
+public:
+    explicit KAlarmWatchdog(QObject *parent = 0);
+    ~KAlarmWatchdog();
+
+    /*
+     * Should be called before start(). If presentsAlarms is true, alarms
+     * triggered during a stall of thread are recorded as delayed.
+     * Otherwise, thread should be a scheduler, and alarms which it
+     * triggers late after a stall are recorded as delayed.
+     */
+    void watch(const QString &name, QThread *thread,
+               bool presentsAlarms = false);
+    void setThreshold(int msecs);
+
+    /* Summary of stalls. Thread-safe */
+    QString summary() const;
+
+    /* Mark what the current thread is executing. Thread-safe */
+    static void enter(const char *activity);
+    static void leave();
+
+public slots:
+    /* Should be called in a watchdog thread */
+    void start();
+    void stop();
+
+    /* Attribute alarms triggered during a stall of a GUI thread */
+    void alarmTriggered(const KAlarmItem &item, const QDateTime &dt);
+
+private:
+    struct Loop
+    {
+        QString name;
+        QThread *thread;
+        bool presentsAlarms;
+        KAlarmHeartbeat *heartbeat;
+        int seq;            // sequence of a heartbeat sent last
+        qint64 sentAt;      // when a pending heartbeat is sent, or -1
+        bool stalled;
+        bool ending;        // a stall ended, but alarms are still caught up
+        QDateTime stallStart;
+        qint64 stallDuration;
+        QStringList activities;
+        QStringList delayedAlarms;
+    };
+
+    struct Stall
+    {
+        QString loop;
+        QDateTime start;
+        qint64 duration;
+        QStringList activities;
+        QStringList delayedAlarms;
+    };
+
+    mutable QMutex _mutex;
+
+    QTimer *_timer;
+    QElapsedTimer _clock;
+    int _threshold;
+
+    QList<Loop> _loops;
+
+    QList<Stall> _stalls;   // recent stalls
+    int _stallCount;
+    qint64 _maxStallDuration;
+    int _delayedAlarmCount;
+
+    static QMutex _activityMutex;
+    static QHash<QThread *, QStringList> _activities;
+
+    static QStringList activities(QThread *thread);
+    static QString alarmText(const KAlarmItem &item, const QDateTime &dt);
+
+    static QDateTime stallStartMinute(const Loop &loop);
+
+    void stallDetected(Loop &loop);
+    Stall endStall(Loop &loop);
+    void record(const Stall &stall);
+    void writeLog(const Stall &stall);
+
+private slots:
+    void timerTimeout();
+};
+
+/* Mark an activity of the current thread in a scope */
+class KAlarmActivityScope
+{
+public:
+    explicit KAlarmActivityScope(const char *activity)
+    {
+        KAlarmWatchdog::enter(activity);
+    }
+
+    ~KAlarmActivityScope()
+    {
+        KAlarmWatchdog::leave();
+    }
+};
+
+#endif // KALARMWATCHDOG_H
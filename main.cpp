@@ -23,26 +23,34 @@
 ****************************************************************************/
 
 #include "kalarm.h"
+#include "kalarmstartupprofile.h"
 #include <QApplication>
 
 int main(int argc, char *argv[])
 {
     QApplication a(argc, argv);
 
+    if (QCoreApplication::arguments().contains("--startup-profile"))
+        KAlarmStartupProfile::start();
+
+    KAlarmStartupProfile::mark("application");
+
     // Default settings for QSettings
     QCoreApplication::setOrganizationName(KAlarm::organization());
     QCoreApplication::setApplicationName(KAlarm::title());
 
+    // Give sizes explicitly, so that images are decoded only when a size is
+    // really requested
+    static const int iconSizes[] = {16, 24, 32, 48, 64, 128, 256};
+
     QIcon icon;
-    icon.addFile(":/icons/candy_clock_16.png");
-    icon.addFile(":/icons/candy_clock_24.png");
-    icon.addFile(":/icons/candy_clock_32.png");
-    icon.addFile(":/icons/candy_clock_48.png");
-    icon.addFile(":/icons/candy_clock_64.png");
-    icon.addFile(":/icons/candy_clock_128.png");
-    icon.addFile(":/icons/candy_clock_256.png");
+    for (unsigned i = 0; i < sizeof(iconSizes) / sizeof(iconSizes[0]); ++i)
+        icon.addFile(QString(":/icons/candy_clock_%1.png").arg(iconSizes[i]),
+                     QSize(iconSizes[i], iconSizes[i]));
     QApplication::setWindowIcon(icon);
 
+    KAlarmStartupProfile::mark("window icon");
+
     // Load translations
     QString qmName("kalarm_" + QLocale::system().name());
     QString qmDir(QCoreApplication::applicationDirPath());
@@ -52,7 +60,12 @@ int main(int argc, char *argv[])
             || kalarmTrans.load(qmName, qmDir + "/translations"))
         a.installTranslator(&kalarmTrans);
 
+    KAlarmStartupProfile::mark("translations");
+
     KAlarm w;
 
+    KAlarmStartupProfile::mark("main window");
+    KAlarmStartupProfile::finishOnEventLoop();
+
     return a.exec();
 }
@@ -0,0 +1,548 @@
+/****************************************************************************
+**
+** Entry module of K Alarm scheduling simulator
+**
+** Copyright (C) 2015 by KO Myung-Hun
+** All rights reserved.
+** Contact: KO Myung-Hun (komh@chollian.net)
+**
+** This file is part of K Alarm
+**
+** $BEGIN_LICENSE$
+**
+** GNU General Public License Usage
+** This file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+** $END_LICENSE$
+**
+****************************************************************************/
+
+#include <QtCore>
+
+#include <ctime>
+
+#include "kalarmitem.h"
+#include "kalarmcalendar.h"
+#include "kalarmschedule.h"
+
+typedef KAlarmSchedule<KAlarmVirtualClock> Schedule;
+
+static QTextStream out(stdout);
+
+static void usage()
+{
+    out << "Usage: kalarmsim [options]\n"
+           "\n"
+           "Run the K Alarm scheduler over simulated time and report "
+           "its load.\n"
+           "\n"
+           "  --store FILE        load alarms from an INI store FILE\n"
+           "  --synthetic N       generate N alarms of each alarm type\n"
+           "  --start YYYY-MM-DD  first simulated day (default: today)\n"
+           "  --days N            simulated days (default: 365)\n"
+           "  --min-interval M    minimum synthetic interval in minutes "
+           "(default: 60)\n"
+           "  --max-interval M    maximum synthetic interval in minutes "
+           "(default: 1439)\n"
+           "  --seed N            random seed for synthetic alarms\n"
+           "  --check-calendar    compare excluded-day computations with "
+           "day-by-day\n"
+           "                      ones across year boundaries, and exit\n"
+           "\n"
+           "Without --store and --synthetic, alarms of the current user "
+           "are loaded.\n";
+    out.flush();
+}
+
+static int loadAlarms(QSettings &settings, QList<KAlarmItem> *items)
+{
+    int count = settings.value("AlarmCount").toInt();
+
+    KAlarmStringTable strings;
+    strings.load(settings);
+
+    for (int i = 0; i < count; ++i)
+    {
+        KAlarmItem item;
+
+        item.loadAlarm(settings, i, &strings);
+        items->append(item);
+    }
+
+    return count;
+}
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 10, 0)
+// qrand() and qsrand() are deprecated
+static QRandomGenerator randomGenerator;
+#endif
+
+static void seedRandom(uint seed)
+{
+#if QT_VERSION >= QT_VERSION_CHECK(5, 10, 0)
+    randomGenerator.seed(seed);
+#else
+    qsrand(seed);
+#endif
+}
+
+static int randomInt(int min, int max)
+{
+#if QT_VERSION >= QT_VERSION_CHECK(5, 10, 0)
+    return randomGenerator.bounded(min, max + 1);
+#else
+    return min + qrand() % (max - min + 1);
+#endif
+}
+
+static void generateAlarms(int count, int minInterval, int maxInterval,
+                           QList<KAlarmItem> *items)
+{
+    for (int type = KAlarmItem::IntervalAlarm;
+         type <= KAlarmItem::SingleShotAlarm; ++type)
+    {
+        for (int i = 0; i < count; ++i)
+        {
+            KAlarmItem item;
+
+            item.setId(KAlarmItem::newId());
+            item.setAlarmEnabled(true);
+            item.setName(QString("Synthetic %1").arg(item.id()));
+            item.setStartTime(QTime(randomInt(0, 23), randomInt(0, 59)));
+
+            if (type == KAlarmItem::IntervalAlarm)
+            {
+                int interval = randomInt(minInterval, maxInterval);
+
+                item.setIntervalTime(QTime(interval / 60, interval % 60));
+            }
+            else if (type == KAlarmItem::WeeklyAlarm)
+            {
+                // At least one weekday
+                int mask = randomInt(1, 127);
+
+                for (int day = KAlarmItem::FirstDay;
+                     day <= KAlarmItem::LastDay; ++day)
+                    item.setWeekDayEnabled(
+                                static_cast<KAlarmItem::KWeekDay>(day),
+                                mask & (1 << day));
+            }
+
+            item.setAlarmType(static_cast<KAlarmItem::KAlarmType>(type));
+
+            items->append(item);
+        }
+    }
+}
+
+/* Whether an occurrence of weekDays falls on date, found day by day */
+static bool isOccurrence(const KAlarmCalendar &calendar, const QDate &date,
+                         int weekDays)
+{
+    if (calendar.isExcluded(date))
+        return false;
+
+    if (weekDays & (1 << (date.dayOfWeek() - 1)))
+        return true;
+
+    if (calendar.mode() == KAlarmCalendar::SkipMode)
+        return false;
+
+    // Occurrences on excluded days just before are shifted to date
+    for (QDate day(date.addDays(-1)); calendar.isExcluded(day);
+         day = day.addDays(-1))
+    {
+        if (weekDays & (1 << (day.dayOfWeek() - 1)))
+            return true;
+    }
+
+    return false;
+}
+
+/*
+ * Compare next days and next alarm times computed with bit sets of
+ * KAlarmCalendar with ones found day by day, around runs of excluded days
+ * across new years, a leap day and 64-day words. Returns the number of
+ * mismatches.
+ */
+static int checkCalendar()
+{
+    KAlarmCalendar calendar("check");
+
+    calendar.setExcluded(QDate(2023, 12, 23), QDate(2024, 1, 3));
+    calendar.setExcluded(QDate(2024, 2, 26), QDate(2024, 3, 1));
+    calendar.setExcluded(QDate(2024, 4, 10), QDate(2024, 7, 20));
+    calendar.setExcluded(QDate(2024, 12, 28), QDate(2025, 1, 1));
+    calendar.setExcluded(QDate(2025, 3, 5));
+    calendar.setExcluded(QDate(2025, 3, 7));
+
+    QDate first(2023, 12, 1);
+    QDate last(2025, 3, 31);
+
+    qint64 cases = 0;
+    int failures = 0;
+
+    for (QDate date(first); date <= last; date = date.addDays(1))
+    {
+        QDate expected(date);
+        while (calendar.isExcluded(expected))
+            expected = expected.addDays(1);
+
+        ++cases;
+
+        if (calendar.nextIncluded(date) != expected)
+        {
+            if (++failures <= 10)
+                out << "nextIncluded(" << date.toString("yyyy-MM-dd")
+                    << ") = "
+                    << calendar.nextIncluded(date).toString("yyyy-MM-dd")
+                    << ", expected " << expected.toString("yyyy-MM-dd")
+                    << "\n";
+        }
+    }
+
+    for (int mode = KAlarmCalendar::SkipMode;
+         mode <= KAlarmCalendar::ShiftMode; ++mode)
+    {
+        calendar.setMode(static_cast<KAlarmCalendar::KMode>(mode));
+
+        for (int weekDays = 1; weekDays <= 127; ++weekDays)
+        {
+            for (QDate date(first); date <= last; date = date.addDays(1))
+            {
+                QDate expected(date);
+                while (!isOccurrence(calendar, expected, weekDays))
+                    expected = expected.addDays(1);
+
+                QDate next(calendar.nextOccurrence(date, weekDays));
+
+                ++cases;
+
+                if (next != expected && ++failures <= 10)
+                    out << "nextOccurrence(" << date.toString("yyyy-MM-dd")
+                        << ", " << weekDays << ") in mode " << mode << " = "
+                        << next.toString("yyyy-MM-dd") << ", expected "
+                        << expected.toString("yyyy-MM-dd") << "\n";
+            }
+        }
+    }
+
+    // Interval alarms on excluded days are moved to the first step on the
+    // next day not excluded
+    QHash<QString, KAlarmCalendar> calendars;
+    calendars.insert(calendar.name(), calendar);
+
+    Schedule schedule;
+    schedule.setCalendars(calendars, QHash<QString, QString>());
+
+    const QTime intervals[] = {QTime(0, 10), QTime(7, 0), QTime(13, 45),
+                               QTime(23, 59)};
+
+    for (QDate date(first); date <= last; date = date.addDays(1))
+    {
+        schedule.clock().setNow(QDateTime(date, QTime(0, 0)));
+
+        for (int i = 0; i < 4; ++i)
+        {
+            KAlarmItem item;
+
+            item.setAlarmType(KAlarmItem::IntervalAlarm);
+            item.setStartTime(QTime(23, 30));
+            item.setIntervalTime(intervals[i]);
+            item.setCalendar(calendar.name());
+
+            QDateTime dt(date, item.startTime());
+            qint64 interval = QTime(0, 0).secsTo(intervals[i]);
+
+            QDateTime expected(dt);
+            while (calendar.isExcluded(expected.date()))
+                expected = expected.addSecs(interval);
+
+            QDateTime next(schedule.findNextAlarm(item, dt, true));
+
+            ++cases;
+
+            if (next != expected && ++failures <= 10)
+                out << "Interval " << intervals[i].toString("HH:mm")
+                    << " from " << dt.toString("yyyy-MM-dd HH:mm") << " = "
+                    << next.toString("yyyy-MM-dd HH:mm") << ", expected "
+                    << expected.toString("yyyy-MM-dd HH:mm") << "\n";
+        }
+    }
+
+    out << "Calendar check:            " << cases << " cases, " << failures
+        << " failures\n";
+
+    return failures;
+}
+
+static double cpuMSecs(clock_t start, clock_t end)
+{
+    return (end - start) * 1000.0 / CLOCKS_PER_SEC;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    QCoreApplication::setOrganizationName("KO Myung-Hun");
+    QCoreApplication::setApplicationName("K Alarm");
+
+    QStringList args(QCoreApplication::arguments());
+
+    QString storeFile;
+    int synthetic = 0;
+    QDate startDate(QDate::currentDate());
+    int days = 365;
+    int minInterval = 60;
+    int maxInterval = 23 * 60 + 59;
+    uint seed = 1;
+
+    for (int i = 1; i < args.size(); ++i)
+    {
+        QString arg(args.at(i));
+        QString value(i + 1 < args.size() ? args.at(i + 1) : QString());
+
+        if (arg == "--check-calendar")
+            return checkCalendar() == 0 ? 0 : 1;
+
+        if (arg == "--store")
+            storeFile = value;
+        else if (arg == "--synthetic")
+            synthetic = value.toInt();
+        else if (arg == "--start")
+            startDate = QDate::fromString(value, "yyyy-MM-dd");
+        else if (arg == "--days")
+            days = value.toInt();
+        else if (arg == "--min-interval")
+            minInterval = value.toInt();
+        else if (arg == "--max-interval")
+            maxInterval = value.toInt();
+        else if (arg == "--seed")
+            seed = value.toUInt();
+        else
+        {
+            usage();
+
+            return arg == "--help" ? 0 : 1;
+        }
+
+        ++i;
+    }
+
+    // An interval is a time of a day
+    if (!startDate.isValid() || days <= 0 || minInterval <= 0
+            || maxInterval < minInterval || maxInterval >= 24 * 60)
+    {
+        usage();
+
+        return 1;
+    }
+
+    QList<KAlarmItem> items;
+
+    if (!storeFile.isEmpty())
+    {
+        QSettings settings(storeFile, QSettings::IniFormat);
+
+        loadAlarms(settings, &items);
+    }
+
+    if (synthetic > 0)
+    {
+        seedRandom(seed);
+
+        generateAlarms(synthetic, minInterval, maxInterval, &items);
+    }
+
+    if (storeFile.isEmpty() && synthetic <= 0)
+    {
+        QSettings settings;
+
+        loadAlarms(settings, &items);
+    }
+
+    QDateTime start(startDate, QTime(0, 0));
+    QDateTime end(startDate.addDays(days), QTime(0, 0));
+
+    Schedule schedule((KAlarmVirtualClock(start)));
+
+    // Schedule alarms one at a time, as K Alarm did before a full rebuild
+    // was done in parallel. It gives a serial time to compare with.
+    QElapsedTimer serialTimer;
+    serialTimer.start();
+
+    clock_t loadStart = clock();
+
+    foreach (const KAlarmItem &item, items)
+        schedule.add(item);
+
+    clock_t loadEnd = clock();
+
+    qint64 serialNSecs = serialTimer.nsecsElapsed();
+
+    // Recompute all the next alarm times at once, as on a profile switch
+    // or a time zone change. Timed by a wall clock, as it runs on all the
+    // cores.
+    QElapsedTimer rebuildTimer;
+    rebuildTimer.start();
+
+    schedule.modify(items);
+
+    qint64 rebuildNSecs = rebuildTimer.nsecsElapsed();
+
+    // Simulate by jumping to the earliest next alarm time. Every tick
+    // processes one minute.
+    qint64 firings = 0;
+    qint64 firingsByType[3] = {0, 0, 0};
+    qint64 ticks = 0;
+    int peakFirings = 0;
+    QDateTime peakMinute;
+
+    QDate day(startDate);
+    clock_t dayStart = clock();
+    double maxDayCpu = 0;
+    QDate maxDay(startDate);
+
+    clock_t runStart = dayStart;
+
+    QList<Schedule::Entry> bells;
+
+    for (;;)
+    {
+        QDateTime deadline(schedule.nextDeadline());
+
+        if (!deadline.isValid() || deadline >= end)
+            break;
+
+        while (day < deadline.date())
+        {
+            clock_t now = clock();
+            double dayCpu = cpuMSecs(dayStart, now);
+
+            if (dayCpu > maxDayCpu)
+            {
+                maxDayCpu = dayCpu;
+                maxDay = day;
+            }
+
+            dayStart = now;
+            day = day.addDays(1);
+        }
+
+        schedule.clock().setNow(deadline);
+
+        bells.clear();
+        schedule.tick(&bells, 0);
+        ++ticks;
+
+        int minuteFirings = 0;
+
+        foreach (const Schedule::Entry &entry, bells)
+        {
+            if (entry.item.isAlarmEnabled())
+            {
+                ++minuteFirings;
+                ++firingsByType[entry.item.alarmType()];
+            }
+        }
+
+        firings += minuteFirings;
+
+        if (minuteFirings > peakFirings)
+        {
+            peakFirings = minuteFirings;
+            peakMinute = deadline;
+        }
+    }
+
+    clock_t runEnd = clock();
+
+    double lastDayCpu = cpuMSecs(dayStart, runEnd);
+    if (lastDayCpu > maxDayCpu)
+    {
+        maxDayCpu = lastDayCpu;
+        maxDay = day;
+    }
+
+    // Measure a recurrence computation alone
+    const int recurrenceRounds = 10;
+    qint64 recurrences = 0;
+    QDateTime from(start.addDays(days / 2));
+
+    schedule.clock().setNow(from);
+
+    clock_t recurrenceStart = clock();
+
+    for (int round = 0; round < recurrenceRounds; ++round)
+    {
+        foreach (const KAlarmItem &item, items)
+        {
+            schedule.findNextAlarm(item, QDateTime(from.date(),
+                                                   item.startTime()), true);
+            ++recurrences;
+        }
+    }
+
+    clock_t recurrenceEnd = clock();
+
+    double runCpu = cpuMSecs(runStart, runEnd);
+    double recurrenceCpu = cpuMSecs(recurrenceStart, recurrenceEnd);
+
+    out << "Alarms:                    " << items.size() << "\n";
+    out << "Simulated period:          "
+        << start.toString("yyyy-MM-dd") << " - "
+        << end.addDays(-1).toString("yyyy-MM-dd")
+        << " (" << days << " days)\n";
+    out << "\n";
+    out << "Total firings:             " << firings << "\n";
+    out << "  Interval alarms:         "
+        << firingsByType[KAlarmItem::IntervalAlarm] << "\n";
+    out << "  Weekly alarms:           "
+        << firingsByType[KAlarmItem::WeeklyAlarm] << "\n";
+    out << "  Single-shot alarms:      "
+        << firingsByType[KAlarmItem::SingleShotAlarm] << "\n";
+    out << "Minutes with firings:      " << ticks << "\n";
+    out << "Peak firings per minute:   " << peakFirings;
+    if (peakMinute.isValid())
+        out << " at " << peakMinute.toString("yyyy-MM-dd HH:mm");
+    out << "\n";
+    out << "\n";
+    out << "Rebuild of " << items.size() << " alarms\n";
+    out << "  One at a time:           "
+        << QString::number(serialNSecs / 1000000.0, 'f', 1)
+        << " ms elapsed\n";
+    out << "  In parallel:             "
+        << QString::number(rebuildNSecs / 1000000.0, 'f', 1)
+        << " ms elapsed on " << QThread::idealThreadCount() << " threads";
+    if (rebuildNSecs > 0)
+        out << ", " << QString::number(double(serialNSecs) / rebuildNSecs,
+                                       'f', 1) << " times faster";
+    out << "\n";
+    out << "\n";
+    out << "Scheduler CPU time\n";
+    out << "  Initial scheduling:      "
+        << QString::number(cpuMSecs(loadStart, loadEnd), 'f', 1) << " ms\n";
+    out << "  Total:                   "
+        << QString::number(runCpu, 'f', 1) << " ms\n";
+    out << "  Per simulated day:       "
+        << QString::number(runCpu / days, 'f', 3) << " ms\n";
+    out << "  Busiest simulated day:   "
+        << QString::number(maxDayCpu, 'f', 3) << " ms on "
+        << maxDay.toString("yyyy-MM-dd") << "\n";
+    out << "  Per firing:              "
+        << (firings ? QString::number(runCpu * 1000000 / firings, 'f', 0)
+                    : QString("-")) << " ns\n";
+    out << "Recurrence computation:    "
+        << (recurrences ? QString::number(recurrenceCpu * 1000000
+                                          / recurrences, 'f', 0)
+                        : QString("-"))
+        << " ns per next alarm time (" << recurrences << " computed)\n";
+
+    return 0;
+}
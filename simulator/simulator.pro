@@ -0,0 +1,28 @@
+#-------------------------------------------------
+#
+# K Alarm scheduling simulator
+#
+#-------------------------------------------------
+
+QT       += core
+QT       -= gui
+
+greaterThan(QT_MAJOR_VERSION, 4): QT += concurrent
+
+TARGET = kalarmsim
+CONFIG   += console
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+INCLUDEPATH += ..
+
+SOURCES += main.cpp \
+    ../kalarmitem.cpp \
+    ../kalarmcalendar.cpp \
+    ../kalarmstringpool.cpp
+
+HEADERS  += ../kalarmitem.h \
+    ../kalarmschedule.h \
+    ../kalarmcalendar.h \
+    ../kalarmstringpool.h